@@ -5,8 +5,10 @@ CONFIG += ordered
 SUBDIRS += \
     common \
     server \
-    client
+    client \
+    tests
 
 client.depends = common
 server.depends = common
+tests.depends = common
 
@@ -17,7 +17,7 @@ SOURCES += \
     src/ChatClient.cpp \
     src/MainWindow.cpp
 
-LIBS += -L$$OUT_PWD/../common -lKukarachaCommon
+LIBS += -L$$OUT_PWD/../common -lKukarachaCommon -lz
 
 DEPENDPATH += $$PWD/../common/src
 
@@ -1,13 +1,28 @@
 #include "ChatClient.h"
 
+#include "FrameType.h"
+#include "JsonCodec.h"
+#include "StreamCompression.h"
+
 #include <QDateTime>
 #include <QLoggingCategory>
+#include <QSignalBlocker>
 #include <QStringList>
 
 #include <exception>
+#include <utility>
 
 Q_LOGGING_CATEGORY(chatClient, "kukaracha.client")
 
+namespace {
+// Клиент отправляет мало, поэтому уровень сжатия исходящего потока фиксирован
+constexpr int kClientCompressionLevel = 6;
+// Старый сервер не отвечает на HELLO — ждём недолго и входим без рукопожатия
+constexpr int kHandshakeTimeoutMs = 3000;
+// Самый длинный кадр, который клиент готов принять (пакеты истории крупнее уходят по одному)
+constexpr quint32 kClientMaxFrameSize = 4 * 1024 * 1024;
+} // namespace
+
 ChatClient::ChatClient(QObject *parent)
     : QObject(parent)
 {
@@ -15,8 +30,14 @@ ChatClient::ChatClient(QObject *parent)
     connect(&m_socket, &QTcpSocket::connected, this, &ChatClient::handleConnected);
     connect(&m_socket, &QTcpSocket::disconnected, this, &ChatClient::handleDisconnected);
     connect(&m_socket, &QTcpSocket::errorOccurred, this, &ChatClient::handleSocketError);
+
+    m_handshakeTimer.setSingleShot(true);
+    m_handshakeTimer.setInterval(kHandshakeTimeoutMs);
+    connect(&m_handshakeTimer, &QTimer::timeout, this, &ChatClient::handleHandshakeTimeout);
 }
 
+ChatClient::~ChatClient() = default;
+
 void ChatClient::connectToServer(const QString &host, quint16 port, QString userName, QString password)
 {
     // Если уже подключены, отключаемся
@@ -27,7 +48,16 @@ void ChatClient::connectToServer(const QString &host, quint16 port, QString user
     // Сохраняем данные для авторизации
     m_userName = userName;
     m_password = password;
+    m_host = host;
+    m_port = port;
+    m_legacyOnly = false;
+    m_legacyReconnect = false;
     setAuthenticated(false);
+    m_handshakeTimer.stop();
+    m_compression.reset();
+    m_headerDecoder = HeaderDecoder();
+    m_capabilities = SessionCapabilities::legacy();
+    m_buffer.clear();
     
     // Подключаемся к серверу
     m_socket.connectToHost(host, port);
@@ -35,6 +65,12 @@ void ChatClient::connectToServer(const QString &host, quint16 port, QString user
 
 void ChatClient::disconnectFromServer()
 {
+    // Сокет переподключения ещё не соединён и disconnected не испустит
+    if (std::exchange(m_legacyReconnect, false)) {
+        m_socket.abort();
+        emit connectionStateChanged(false);
+        return;
+    }
     m_socket.disconnectFromHost();
 }
 
@@ -63,14 +99,38 @@ void ChatClient::sendMessage(const QString &text)
     ChatMessage message(m_userName, text, currentTime);
     
     // Сериализуем и отправляем
-    QByteArray payload = m_serializer.serialize(message);
+    QByteArray payload = JsonCodec<ChatMessage>::encode(message);
     payload.append('\n');
 
-    qint64 bytesWritten = m_socket.write(payload);
-    if (bytesWritten == -1) {
-        QString error = m_socket.errorString();
-        emit errorOccurred(error);
+    // Сервер сообщил в WELCOME, какой кадр готов принять
+    const quint32 maxFrameSize = m_capabilities.maxFrameSize();
+    if (maxFrameSize != 0 && payload.size() > qsizetype(maxFrameSize)) {
+        emit errorOccurred(tr("Сообщение слишком длинное"));
+        return;
     }
+    writeFrame(payload);
+}
+
+void ChatClient::sendTyping()
+{
+    // Клиенты без рукопожатия отметок не шлют: сервер принял бы их за текст
+    if (isConnected() == false || m_authenticated == false || m_capabilities.isLegacy()) {
+        return;
+    }
+    writeFrame(ControlMessage::typing().encodeFrame());
+}
+
+void ChatClient::sendReaction(const QString &author, qint64 timestampMs, const QString &reaction)
+{
+    if (isConnected() == false || m_authenticated == false || m_capabilities.isLegacy()) {
+        return;
+    }
+    writeFrame(ControlMessage::react(author, timestampMs, reaction).encodeFrame());
+}
+
+void ChatClient::setCompressionEnabled(bool enabled)
+{
+    m_compressionEnabled = enabled;
 }
 
 bool ChatClient::isConnected() const
@@ -92,6 +152,9 @@ void ChatClient::handleReadyRead()
 {
     // Читаем все доступные данные
     QByteArray data = m_socket.readAll();
+    if (m_compression && inflate(data) == false) {
+        return;
+    }
     m_buffer.append(data);
 
     // Обрабатываем все сообщения в буфере
@@ -102,23 +165,62 @@ void ChatClient::handleReadyRead()
         m_buffer.remove(0, newlineIndex + 1);
         
         // Обрабатываем сообщение
+        const bool wasCompressed = m_compression != nullptr;
         processPayload(payload);
+
+        // Сжатие включилось посреди порции: остаток буфера уже сжат
+        if (!wasCompressed && m_compression && inflate(m_buffer) == false) {
+            return;
+        }
         
         // Ищем следующее сообщение
         newlineIndex = m_buffer.indexOf('\n');
     }
 }
 
+bool ChatClient::inflate(QByteArray &data)
+{
+    QByteArray inflated;
+    if (m_compression->decompress(data, inflated) == false) {
+        m_buffer.clear();
+        emit errorOccurred(tr("Повреждён сжатый поток от сервера"));
+        m_socket.abort();
+        return false;
+    }
+    data = std::move(inflated);
+    return true;
+}
+
 void ChatClient::handleConnected()
 {
     qCInfo(chatClient) << "Подключено к серверу";
-    emit connectionStateChanged(true);
-    sendAuthentication();
+    // Переподключение после таймаута рукопожатия для окна продолжает прежнее подключение
+    if (std::exchange(m_legacyReconnect, false) == false) {
+        emit connectionStateChanged(true);
+    }
+
+    // Старый сервер не понял HELLO — входим сразу, без рукопожатия
+    if (m_legacyOnly) {
+        sendAuthentication();
+        return;
+    }
+
+    // Сообщаем серверу, что умеем, и входим после WELCOME
+    const auto compression = m_compressionEnabled ? SessionCapabilities::Compression::Deflate
+                                                  : SessionCapabilities::Compression::None;
+    quint16 features = SessionCapabilities::HistoryBatch;
+    if (m_compressionEnabled) {
+        features |= SessionCapabilities::HeaderCompression;
+    }
+    writeFrame(SessionCapabilities::local(compression, kClientMaxFrameSize, features).toHello().encodeFrame());
+    m_handshakeTimer.start();
 }
 
 void ChatClient::handleDisconnected()
 {
     qCInfo(chatClient) << "Отключено от сервера";
+    m_handshakeTimer.stop();
+    m_compression.reset();
     emit connectionStateChanged(false);
     setAuthenticated(false);
 }
@@ -127,51 +229,55 @@ void ChatClient::handleSocketError(QAbstractSocket::SocketError error)
 {
     Q_UNUSED(error)
     emit errorOccurred(m_socket.errorString());
+    // Переподключиться не удалось: для окна закрывается прежнее подключение
+    if (std::exchange(m_legacyReconnect, false)) {
+        m_socket.abort();
+        emit connectionStateChanged(false);
+    }
+}
+
+void ChatClient::handleHandshakeTimeout()
+{
+    // Новый сервер мог уже перейти на согласованные параметры, и старый логин в этом же
+    // сокете он бы отбросил, а при сжатии — закрыл соединение. Поэтому два протокола
+    // в одном сокете не смешиваются: рвём его и подключаемся заново без HELLO
+    qCInfo(chatClient) << "Сервер не ответил на рукопожатие, переподключение по старому протоколу";
+    m_legacyOnly = true;
+    m_legacyReconnect = true;
+    {
+        const QSignalBlocker blocker(m_socket);
+        m_socket.abort();
+    }
+    m_compression.reset();
+    m_headerDecoder = HeaderDecoder();
+    m_capabilities = SessionCapabilities::legacy();
+    m_buffer.clear();
+    m_socket.connectToHost(m_host, m_port);
 }
 
 void ChatClient::processPayload(const QByteArray &payload)
 {
     try {
+        if (hasFrameType(payload, FrameType::Control)) {
+            processControl(payload);
+            return;
+        }
+
+        // Пакет истории разбираем целиком и отдаём окну одним сигналом
+        if (hasFrameType(payload, FrameType::HistoryBatch)) {
+            QList<ChatMessage> messages = m_serializer.deserializeBatch(payload.sliced(1));
+            emit messagesReceived(messages);
+            return;
+        }
+
         // Десериализуем сообщение
-        ChatMessage message = m_serializer.deserialize(payload);
-
-        // Проверяем, системное ли это сообщение
-        QString sender = message.sender();
-        if (sender == "SERVER") {
-            QString text = message.text();
-            
-            // Обрабатываем успешную авторизацию
-            if (text.startsWith("AUTH_OK")) {
-                setAuthenticated(true);
-                QDateTime currentTime = QDateTime::currentDateTimeUtc();
-                ChatMessage successMsg("SERVER", tr("Авторизация успешна"), currentTime);
-                emit messageReceived(successMsg);
-                return;
-            }
-
-            // Обрабатываем ошибку авторизации
-            if (text.startsWith("AUTH_FAIL:")) {
-                int prefixLength = QString("AUTH_FAIL:").size();
-                QString reason = text.mid(prefixLength);
-                QString trimmedReason = reason.trimmed();
-                QDateTime currentTime = QDateTime::currentDateTimeUtc();
-                ChatMessage failMsg("SERVER", tr("Авторизация не удалась: %1").arg(trimmedReason), currentTime);
-                emit messageReceived(failMsg);
-                m_socket.disconnectFromHost();
-                return;
-            }
-
-            // Обрабатываем список пользователей
-            if (text.startsWith("USER_LIST:")) {
-                int prefixLength = QString("USER_LIST:").size();
-                QString userListStr = text.mid(prefixLength);
-                QStringList userList;
-                if (userListStr.isEmpty() == false) {
-                    userList = userListStr.split(",", Qt::SkipEmptyParts);
-                }
-                emit userListReceived(userList);
-                return;
-            }
+        ChatMessage message = hasFrameType(payload, FrameType::HeaderCompressed)
+            ? m_headerDecoder.decode(payload.sliced(1))
+            : JsonCodec<ChatMessage>::decode(payload);
+
+        // Старый сервер передаёт управляющие сообщения текстом от "SERVER"
+        if (m_capabilities.isLegacy() && processLegacyControl(message)) {
+            return;
         }
 
         // Отправляем обычное сообщение
@@ -182,6 +288,131 @@ void ChatClient::processPayload(const QByteArray &payload)
     }
 }
 
+const std::array<ChatClient::ControlHandler, std::size_t(ControlKind::Count)> ChatClient::kControlHandlers = {
+    nullptr,                      // Login
+    &ChatClient::handleAuthOk,    // AuthOk
+    &ChatClient::handleAuthFail,  // AuthFail
+    &ChatClient::handleUserList,  // UserList
+    nullptr,                      // Hello
+    &ChatClient::handleWelcome,   // Welcome
+    &ChatClient::handleRoom,      // Room
+    &ChatClient::handleDirect,    // Direct
+    &ChatClient::handleTyping,    // Typing
+    nullptr,                      // React
+    &ChatClient::handleReactions, // Reactions
+};
+
+void ChatClient::processControl(const QByteArray &payload)
+{
+    const ControlMessage message = ControlMessage::decode(payload);
+    const ControlHandler handler = kControlHandlers[std::size_t(message.kind())];
+    if (handler == nullptr) {
+        qCWarning(chatClient) << "Неожиданный управляющий кадр от сервера" << int(message.kind());
+        return;
+    }
+    (this->*handler)(message);
+}
+
+bool ChatClient::processLegacyControl(const ChatMessage &message)
+{
+    if (message.sender() != QLatin1String("SERVER")) {
+        return false;
+    }
+
+    const QString &text = message.text();
+    if (text.startsWith(QLatin1String("AUTH_OK"))) {
+        handleAuthOk(ControlMessage::authOk());
+        return true;
+    }
+    if (text.startsWith(QLatin1String("AUTH_FAIL:"))) {
+        handleAuthFail(ControlMessage::authFail(text.mid(QLatin1String("AUTH_FAIL:").size()).trimmed()));
+        return true;
+    }
+    if (text.startsWith(QLatin1String("USER_LIST:"))) {
+        const QString userListStr = text.mid(QLatin1String("USER_LIST:").size());
+        handleUserList(ControlMessage::userList(userListStr.split(QLatin1Char(','), Qt::SkipEmptyParts)));
+        return true;
+    }
+    return false;
+}
+
+void ChatClient::handleAuthOk(const ControlMessage &message)
+{
+    Q_UNUSED(message)
+    setAuthenticated(true);
+    QDateTime currentTime = QDateTime::currentDateTimeUtc();
+    ChatMessage successMsg("SERVER", tr("Авторизация успешна"), currentTime);
+    emit messageReceived(successMsg);
+}
+
+void ChatClient::handleAuthFail(const ControlMessage &message)
+{
+    QDateTime currentTime = QDateTime::currentDateTimeUtc();
+    ChatMessage failMsg("SERVER", tr("Авторизация не удалась: %1").arg(message.reason()), currentTime);
+    emit messageReceived(failMsg);
+    m_socket.disconnectFromHost();
+}
+
+void ChatClient::handleUserList(const ControlMessage &message)
+{
+    emit userListReceived(message.users());
+}
+
+void ChatClient::handleRoom(const ControlMessage &message)
+{
+    emit roomChanged(message.roomName());
+}
+
+void ChatClient::handleDirect(const ControlMessage &message)
+{
+    emit directMessageReceived(message.sender(), message.recipient(), message.text(), message.sentAt());
+}
+
+void ChatClient::handleTyping(const ControlMessage &message)
+{
+    emit typingChanged(message.typingUsers());
+}
+
+void ChatClient::handleReactions(const ControlMessage &message)
+{
+    emit reactionsUpdated(message.author(), message.messageTimestampMs(), message.reactionCounts());
+}
+
+void ChatClient::handleWelcome(const ControlMessage &message)
+{
+    // WELCOME без нашего HELLO не ожидается: после таймаута сокет уже другой
+    if (m_handshakeTimer.isActive() == false) {
+        return;
+    }
+    m_handshakeTimer.stop();
+
+    try {
+        m_capabilities = SessionCapabilities::fromControl(message);
+    } catch (const std::exception &exception) {
+        // Сервер уже перешёл на согласованные параметры, которые мы не поняли
+        emit errorOccurred(tr("Некорректный ответ на рукопожатие: %1").arg(QString::fromUtf8(exception.what())));
+        m_socket.abort();
+        return;
+    }
+
+    qCInfo(chatClient) << "Протокол версии" << m_capabilities.version();
+    if (m_capabilities.has(SessionCapabilities::HeaderCompression)) {
+        qCInfo(chatClient) << "Заголовки сообщений сжимаются";
+    }
+    if (m_capabilities.compression() == SessionCapabilities::Compression::Deflate) {
+        m_compression = std::make_unique<StreamCompression>(kClientCompressionLevel);
+        if (m_compression->isValid() == false) {
+            // Сервер уже перешёл на сжатый поток, продолжать без сжатия нельзя
+            m_compression.reset();
+            emit errorOccurred(tr("Не удалось включить сжатие трафика"));
+            m_socket.abort();
+            return;
+        }
+        qCInfo(chatClient) << "Трафик сжимается";
+    }
+    sendAuthentication();
+}
+
 void ChatClient::setAuthenticated(bool authenticated)
 {
     if (m_authenticated == authenticated) {
@@ -201,15 +432,24 @@ void ChatClient::sendAuthentication()
         return;
     }
 
-    // Создаем сообщение авторизации
+    if (m_capabilities.isLegacy() == false) {
+        writeFrame(ControlMessage::login(m_userName, m_password).encodeFrame());
+        return;
+    }
+
+    // Старый сервер ждёт логин и пароль первым обычным сообщением
     QDateTime currentTime = QDateTime::currentDateTimeUtc();
     ChatMessage authMessage(m_userName, m_password, currentTime);
     
     // Сериализуем и отправляем
-    QByteArray payload = m_serializer.serialize(authMessage);
+    QByteArray payload = JsonCodec<ChatMessage>::encode(authMessage);
     payload.append('\n');
-    
-    qint64 bytesWritten = m_socket.write(payload);
+    writeFrame(payload);
+}
+
+void ChatClient::writeFrame(const QByteArray &frame)
+{
+    qint64 bytesWritten = m_socket.write(m_compression ? m_compression->compress(frame) : frame);
     if (bytesWritten == -1) {
         QString error = m_socket.errorString();
         emit errorOccurred(error);
@@ -1,20 +1,37 @@
 #pragma once
 
 #include "ChatMessage.h"
+#include "ControlMessage.h"
+#include "HeaderCompression.h"
 #include "JsonMessageSerializer.h"
+#include "SessionCapabilities.h"
 
 #include <QObject>
 #include <QTcpSocket>
+#include <QTimer>
+
+#include <array>
+#include <memory>
+
+class StreamCompression;
 
 class ChatClient final : public QObject {
     Q_OBJECT
 
 public:
     explicit ChatClient(QObject *parent = nullptr);
+    ~ChatClient() override;
 
     void connectToServer(const QString &host, quint16 port, QString userName, QString password);
     void disconnectFromServer();
     void sendMessage(const QString &text);
+    // Сообщает, что пользователь набирает текст. Только после рукопожатия,
+    // частоту ограничивает вызывающий.
+    void sendTyping();
+    // Ставит или снимает реакцию на сообщение author, отправленное в timestampMs.
+    void sendReaction(const QString &author, qint64 timestampMs, const QString &reaction);
+    // Предлагать ли серверу в рукопожатии сжатие трафика и заголовков.
+    void setCompressionEnabled(bool enabled);
 
     [[nodiscard]] bool isConnected() const;
     [[nodiscard]] const QString &userName() const;
@@ -22,27 +39,68 @@ public:
 
 signals:
     void messageReceived(const ChatMessage &message);
+    void messagesReceived(const QList<ChatMessage> &messages);
     void connectionStateChanged(bool connected);
     void errorOccurred(const QString &message);
     void authenticatedChanged(bool authenticated);
     void userListReceived(const QStringList &users);
+    // Сервер перевёл клиента в комнату room; дальше придёт её история.
+    void roomChanged(const QString &room);
+    // Личное сообщение; своё сервер возвращает копией с sender == userName().
+    void directMessageReceived(const QString &sender, const QString &recipient, const QString &text,
+                               const QDateTime &sentAt);
+    // Кто сейчас набирает сообщение в комнате (может включать нас самих).
+    void typingChanged(const QStringList &users);
+    // Новые значения счётчиков реакций сообщения; 0 — реакцию сняли все.
+    void reactionsUpdated(const QString &author, qint64 timestampMs, const QList<std::pair<QString, int>> &counts);
 
 private slots:
     void handleReadyRead();
     void handleConnected();
     void handleDisconnected();
     void handleSocketError(QAbstractSocket::SocketError error);
+    void handleHandshakeTimeout();
 
 private:
+    using ControlHandler = void (ChatClient::*)(const ControlMessage &message);
+    // Обработчики управляющих кадров по ControlKind; nullptr — вид не ожидается от сервера.
+    static const std::array<ControlHandler, std::size_t(ControlKind::Count)> kControlHandlers;
+
+    bool inflate(QByteArray &data);
     void processPayload(const QByteArray &payload);
+    void processControl(const QByteArray &payload);
+    bool processLegacyControl(const ChatMessage &message);
+    void handleAuthOk(const ControlMessage &message);
+    void handleAuthFail(const ControlMessage &message);
+    void handleUserList(const ControlMessage &message);
+    void handleWelcome(const ControlMessage &message);
+    void handleRoom(const ControlMessage &message);
+    void handleDirect(const ControlMessage &message);
+    void handleTyping(const ControlMessage &message);
+    void handleReactions(const ControlMessage &message);
     void setAuthenticated(bool authenticated);
     void sendAuthentication();
+    void writeFrame(const QByteArray &frame);
 
     QTcpSocket m_socket;
     JsonMessageSerializer m_serializer;
+    // Зеркало таблицы заголовков сервера; заполняется, только если сжатие заголовков согласовано
+    HeaderDecoder m_headerDecoder;
     QByteArray m_buffer;
     QString m_userName;
     QString m_password;
+    std::unique_ptr<StreamCompression> m_compression;
+    QTimer m_handshakeTimer;
+    // Адрес последнего подключения: по нему переподключаемся без рукопожатия
+    QString m_host;
+    quint16 m_port = 0;
+    // Сервер не ответил на HELLO: следующее подключение идёт сразу по старому протоколу
+    bool m_legacyOnly = false;
+    // Идёт переподключение после таймаута рукопожатия; окно о нём не уведомляется
+    bool m_legacyReconnect = false;
+    // Результат рукопожатия; legacy() — старый сервер или рукопожатие ещё не завершено
+    SessionCapabilities m_capabilities;
+    bool m_compressionEnabled = true;
     bool m_authenticated = false;
 };
 
@@ -9,8 +9,12 @@
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QLineEdit>
+#include <QMenu>
 #include <QPushButton>
 #include <QSystemTrayIcon>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
 #include <QTextEdit>
 #include <QToolBar>
 #include <QVBoxLayout>
@@ -20,8 +24,19 @@
 #include <QListWidget>
 #include <QSplitter>
 
+#include <algorithm>
 #include <memory>
 
+namespace {
+// Не чаще этого шлём отметку о наборе текста: сервер держит её дольше и сам гасит
+constexpr qint64 kTypingRefreshMs = 2000;
+// Реакции контекстного меню; повторный выбор снимает свою реакцию
+const QStringList kReactionPalette = {
+    QStringLiteral("👍"), QStringLiteral("❤️"), QStringLiteral("😂"),
+    QStringLiteral("😮"), QStringLiteral("😢"), QStringLiteral("🔥"),
+};
+} // namespace
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
@@ -107,8 +122,15 @@ void MainWindow::buildUi()
 
     m_chatView = new QTextEdit(chatWidget);
     m_chatView->setReadOnly(true);
+    // Реакции ставятся из контекстного меню сообщения
+    m_chatView->setContextMenuPolicy(Qt::CustomContextMenu);
     layout->addWidget(m_chatView, 1);
 
+    // Строка «кто печатает» под чатом; пустая, пока никто не печатает
+    m_typingLabel = new QLabel(chatWidget);
+    m_typingLabel->setStyleSheet("font-style:italic;");
+    layout->addWidget(m_typingLabel);
+
     // Layout для ввода сообщения
     QHBoxLayout *messageLayout = new QHBoxLayout();
     m_messageEdit = new QLineEdit(chatWidget);
@@ -165,14 +187,21 @@ void MainWindow::bindSignals()
 {
     connect(m_sendButton, &QPushButton::clicked, this, &MainWindow::onSendClicked);
     connect(m_messageEdit, &QLineEdit::returnPressed, this, &MainWindow::onSendClicked);
+    connect(m_messageEdit, &QLineEdit::textEdited, this, &MainWindow::onMessageEdited);
     connect(m_connectButton, &QPushButton::clicked, this, &MainWindow::onConnectClicked);
     connect(m_themeButton, &QPushButton::clicked, this, &MainWindow::onThemeChanged);
 
     connect(m_client.get(), &ChatClient::messageReceived, this, &MainWindow::onMessageReceived);
+    connect(m_client.get(), &ChatClient::messagesReceived, this, &MainWindow::onMessagesReceived);
     connect(m_client.get(), &ChatClient::connectionStateChanged, this, &MainWindow::onConnectionStateChanged);
     connect(m_client.get(), &ChatClient::errorOccurred, this, &MainWindow::onErrorOccurred);
     connect(m_client.get(), &ChatClient::authenticatedChanged, this, &MainWindow::onAuthenticatedChanged);
     connect(m_client.get(), &ChatClient::userListReceived, this, &MainWindow::updateUserList);
+    connect(m_client.get(), &ChatClient::roomChanged, this, &MainWindow::onRoomChanged);
+    connect(m_client.get(), &ChatClient::directMessageReceived, this, &MainWindow::onDirectMessageReceived);
+    connect(m_client.get(), &ChatClient::typingChanged, this, &MainWindow::onTypingChanged);
+    connect(m_client.get(), &ChatClient::reactionsUpdated, this, &MainWindow::onReactionsUpdated);
+    connect(m_chatView, &QTextEdit::customContextMenuRequested, this, &MainWindow::onChatContextMenu);
 }
 
 void MainWindow::onSendClicked()
@@ -190,8 +219,9 @@ void MainWindow::onSendClicked()
         return;
     }
 
-    // Отправляем сообщение
+    // Отправляем сообщение; отметку о наборе сервер снимет сам
     m_client->sendMessage(text);
+    m_lastTypingSentMs = 0;
     
     // Очищаем поле ввода
     m_messageEdit->clear();
@@ -229,22 +259,42 @@ void MainWindow::onConnectClicked()
         return;
     }
 
+    // Сжатие трафика можно отключить в настройках (экономия CPU на слабых устройствах)
+    QSettings settings;
+    m_client->setCompressionEnabled(settings.value("compression", true).toBool());
+
     // Подключаемся к серверу
     m_client->connectToServer(host, port, trimmedName, password);
 }
 
 void MainWindow::onMessageReceived(const ChatMessage &message)
+{
+    appendMessage(message);
+    
+    // Уведомляем только о сообщениях пользователей
+    if (message.sender() != "SERVER") {
+        showMessageNotification(message);
+    }
+}
+
+void MainWindow::onMessagesReceived(const QList<ChatMessage> &messages)
+{
+    // Пакет истории добавляем целиком: одна перерисовка и без уведомлений
+    m_chatHistory.reserve(m_chatHistory.size() + messages.size());
+    m_chatView->setUpdatesEnabled(false);
+    for (const ChatMessage &message : messages) {
+        appendMessage(message);
+    }
+    m_chatView->setUpdatesEnabled(true);
+}
+
+void MainWindow::appendMessage(const ChatMessage &message)
 {
     // Проверяем, системное ли это сообщение
     QString sender = message.sender();
     if (sender == "SERVER") {
         // Сохраняем в историю
-        ChatEntry entry;
-        entry.sender = "SERVER";
-        entry.text = message.text();
-        entry.timestamp = message.timestamp();
-        entry.isSystem = true;
-        m_chatHistory.append(entry);
+        m_chatHistory.append(ChatEntry{CompactMessage(message, m_chatSenders), EntryKind::System});
         
         // Форматируем время
         QDateTime timestamp = message.timestamp();
@@ -269,13 +319,13 @@ void MainWindow::onMessageReceived(const ChatMessage &message)
     }
 
     // Обычное сообщение от пользователя
-    ChatEntry entry;
-    entry.sender = message.sender();
-    entry.text = message.text();
-    entry.timestamp = message.timestamp();
-    entry.isSystem = false;
-    m_chatHistory.append(entry);
+    m_chatHistory.append(ChatEntry{CompactMessage(message, m_chatSenders), EntryKind::User});
+    m_chatView->append(QStringLiteral("<div>%1</div>").arg(userMessageSpans(message)));
+    registerMessageBlock({message.sender(), message.timestamp().toMSecsSinceEpoch()});
+}
 
+QString MainWindow::userMessageSpans(const ChatMessage &message) const
+{
     // Форматируем время
     QDateTime timestamp = message.timestamp();
     QDateTime localTime = timestamp.toLocalTime();
@@ -318,12 +368,30 @@ void MainWindow::onMessageReceived(const ChatMessage &message)
     }
     
     // Формируем HTML для сообщения
-    QString html = QString("<div><span style=\"%1\">[%2]</span> <span style=\"%3\">%4</span>: <span style=\"%5\">%6</span></div>")
+    QString html = QString("<span style=\"%1\">[%2]</span> <span style=\"%3\">%4</span>: <span style=\"%5\">%6</span>")
                       .arg(timeStyle, escapedTime, senderStyle, escapedSender, textStyle, escapedText);
-    m_chatView->append(html);
-    
-    // Показываем уведомление
-    showMessageNotification(message);
+    return html + reactionsHtml({senderName, timestamp.toMSecsSinceEpoch()});
+}
+
+QString MainWindow::reactionsHtml(const MessageKey &key) const
+{
+    const auto it = m_reactions.constFind(key);
+    if (it == m_reactions.constEnd()) {
+        return {};
+    }
+    QStringList parts;
+    for (auto reaction = it->cbegin(); reaction != it->cend(); ++reaction) {
+        parts.append(QStringLiteral("%1&nbsp;%2").arg(htmlEscape(reaction.key())).arg(reaction.value()));
+    }
+    QString reactionColor = m_currentTheme == Theme::Dark ? "#aaaaaa" : "#555555";
+    return QString(" <span style=\"color:%1;\">%2</span>").arg(reactionColor, parts.join(QStringLiteral("&nbsp; ")));
+}
+
+void MainWindow::registerMessageBlock(const MessageKey &key)
+{
+    const int block = m_chatView->document()->blockCount() - 1;
+    m_messageBlocks.insert(key, block);
+    m_blockMessages.insert(block, key);
 }
 
 void MainWindow::onConnectionStateChanged(bool connected)
@@ -332,13 +400,158 @@ void MainWindow::onConnectionStateChanged(bool connected)
         m_authenticated = false;
         // Очищаем историю при отключении, чтобы избежать дубликатов при повторном подключении
         m_chatHistory.clear();
+        m_chatSenders.clear();
         m_chatView->clear();
+        m_reactions.clear();
+        m_messageBlocks.clear();
+        m_blockMessages.clear();
         m_userListWidget->clear();
+        m_currentRoom.clear();
+        m_typingLabel->clear();
+        m_lastTypingSentMs = 0;
+        setWindowTitle(tr("Кукарача Мессенджер"));
     }
     updateControls();
     appendSystemMessage(connected ? tr("Подключение установлено") : tr("Подключение закрыто"));
 }
 
+void MainWindow::onRoomChanged(const QString &room)
+{
+    // При смене комнаты сервер пришлёт историю новой, сообщения прежней убираем.
+    // Первая комната после входа ничего не очищает: в чате уже ответ на вход.
+    if (!m_currentRoom.isEmpty() && m_currentRoom != room) {
+        m_chatHistory.clear();
+        m_chatSenders.clear();
+        m_chatView->clear();
+        m_messageBlocks.clear();
+        m_blockMessages.clear();
+    }
+    // Реакции следующей комнаты придут сразу за этим кадром
+    m_reactions.clear();
+    m_currentRoom = room;
+    m_typingLabel->clear();
+    setWindowTitle(tr("Кукарача Мессенджер — %1").arg(room));
+}
+
+void MainWindow::onDirectMessageReceived(const QString &sender, const QString &recipient, const QString &text,
+                                         const QDateTime &sentAt)
+{
+    // В записи храним собеседника: для своих сообщений это получатель
+    const bool outgoing = QString::compare(sender, m_client->userName(), Qt::CaseInsensitive) == 0;
+    // Сообщения из почтового ящика приходят со временем отправки, а не доставки
+    const ChatMessage message(outgoing ? recipient : sender, text, sentAt);
+    m_chatHistory.append(ChatEntry{CompactMessage(message, m_chatSenders),
+                                   outgoing ? EntryKind::DirectOut : EntryKind::DirectIn});
+    m_chatView->append(directMessageHtml(message, outgoing));
+
+    if (!outgoing) {
+        showMessageNotification(message);
+    }
+}
+
+QString MainWindow::directMessageHtml(const ChatMessage &message, bool outgoing) const
+{
+    QDateTime localTime = message.timestamp().toLocalTime();
+    QString escapedTime = htmlEscape(localTime.toString("hh:mm:ss"));
+    QString escapedPeer = htmlEscape(message.sender());
+    QString escapedText = htmlEscape(message.text());
+
+    // Личные сообщения выделены цветом и курсивом, чтобы их не спутать с сообщениями комнаты
+    QString directColor;
+    if (m_currentTheme == Theme::Dark) {
+        directColor = "#d7a8ff";
+    } else {
+        directColor = "#7a2e9e";
+    }
+
+    QString header = outgoing ? tr("ЛС для %1").arg(escapedPeer) : tr("ЛС от %1").arg(escapedPeer);
+    return QString("<div style=\"color:%1\">[%2] <b>%3</b>: <i>%4</i></div>").arg(directColor, escapedTime, header, escapedText);
+}
+
+void MainWindow::onMessageEdited(const QString &text)
+{
+    if (m_authenticated == false || text.trimmed().isEmpty() || text.startsWith(QLatin1Char('/'))) {
+        return;
+    }
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (now - m_lastTypingSentMs < kTypingRefreshMs) {
+        return;
+    }
+    m_lastTypingSentMs = now;
+    m_client->sendTyping();
+}
+
+void MainWindow::onTypingChanged(const QStringList &users)
+{
+    QStringList others;
+    for (const QString &user : users) {
+        if (QString::compare(user, m_client->userName(), Qt::CaseInsensitive) != 0) {
+            others.append(user);
+        }
+    }
+
+    if (others.isEmpty()) {
+        m_typingLabel->clear();
+    } else if (others.size() == 1) {
+        m_typingLabel->setText(tr("%1 печатает…").arg(others.first()));
+    } else if (others.size() <= 3) {
+        m_typingLabel->setText(tr("%1 печатают…").arg(others.join(QStringLiteral(", "))));
+    } else {
+        m_typingLabel->setText(tr("Печатают %1 человек…").arg(others.size()));
+    }
+}
+
+void MainWindow::onReactionsUpdated(const QString &author, qint64 timestampMs,
+                                    const QList<std::pair<QString, int>> &counts)
+{
+    const MessageKey key{author, timestampMs};
+    QMap<QString, int> &reactions = m_reactions[key];
+    for (const auto &[reaction, count] : counts) {
+        if (count > 0) {
+            reactions.insert(reaction, count);
+        } else {
+            reactions.remove(reaction);
+        }
+    }
+    if (reactions.isEmpty()) {
+        m_reactions.remove(key);
+    }
+
+    // Перерисовываем только строку этого сообщения, а не весь чат
+    const auto blockIt = m_messageBlocks.constFind(key);
+    if (blockIt == m_messageBlocks.constEnd()) {
+        return;
+    }
+    const QTextBlock block = m_chatView->document()->findBlockByNumber(blockIt.value());
+    const auto entryIt = std::find_if(m_chatHistory.crbegin(), m_chatHistory.crend(), [&](const ChatEntry &entry) {
+        return entry.kind == EntryKind::User && entry.message.timestampMs() == timestampMs
+               && m_chatSenders.name(entry.message.senderId()) == author;
+    });
+    if (!block.isValid() || entryIt == m_chatHistory.crend()) {
+        return;
+    }
+    QTextCursor cursor(block);
+    cursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+    cursor.insertHtml(userMessageSpans(entryIt->message.toChatMessage(m_chatSenders)));
+}
+
+void MainWindow::onChatContextMenu(const QPoint &pos)
+{
+    std::unique_ptr<QMenu> menu(m_chatView->createStandardContextMenu(pos));
+    const int block = m_chatView->cursorForPosition(pos).blockNumber();
+    const auto it = m_blockMessages.constFind(block);
+    if (m_authenticated && it != m_blockMessages.constEnd()) {
+        menu->addSeparator();
+        QMenu *reactMenu = menu->addMenu(tr("Реакция"));
+        for (const QString &reaction : kReactionPalette) {
+            reactMenu->addAction(reaction, this, [this, key = it.value(), reaction]() {
+                m_client->sendReaction(key.first, key.second, reaction);
+            });
+        }
+    }
+    menu->exec(m_chatView->viewport()->mapToGlobal(pos));
+}
+
 void MainWindow::updateUserList(const QStringList &users)
 {
     // Очищаем список
@@ -385,16 +598,22 @@ void MainWindow::renderAllMessages()
 {
     // Очищаем чат
     m_chatView->clear();
+    m_messageBlocks.clear();
+    m_blockMessages.clear();
     
     // Перерисовываем все сообщения из истории
     for (const ChatEntry &entry : m_chatHistory) {
+        // Разворачиваем компактную запись только на время отрисовки
+        const ChatMessage message = entry.message.toChatMessage(m_chatSenders);
         
-        if (entry.isSystem) {
+        if (entry.kind == EntryKind::DirectIn || entry.kind == EntryKind::DirectOut) {
+            m_chatView->append(directMessageHtml(message, entry.kind == EntryKind::DirectOut));
+        } else if (entry.kind == EntryKind::System) {
             // Системное сообщение
-            QDateTime localTime = entry.timestamp.toLocalTime();
+            QDateTime localTime = message.timestamp().toLocalTime();
             QString timeStamp = localTime.toString("hh:mm:ss");
             QString escapedTime = htmlEscape(timeStamp);
-            QString escapedText = htmlEscape(entry.text);
+            QString escapedText = htmlEscape(message.text());
             
             QString systemColor;
             if (m_currentTheme == Theme::Dark) {
@@ -407,44 +626,8 @@ void MainWindow::renderAllMessages()
             m_chatView->append(html);
         } else {
             // Обычное сообщение
-            QDateTime localTime = entry.timestamp.toLocalTime();
-            QString timeStamp = localTime.toString("hh:mm:ss");
-            QString escapedTime = htmlEscape(timeStamp);
-            QString escapedSender = htmlEscape(entry.sender);
-            QString escapedText = htmlEscape(entry.text);
-            
-            // Проверяем, наше ли это сообщение
-            QString myName = m_client->userName();
-            bool isSelf = (QString::compare(entry.sender, myName, Qt::CaseInsensitive) == 0);
-            
-            // Выбираем стили
-            QString senderStyle;
-            QString textStyle;
-            QString timeStyle;
-            
-            if (m_currentTheme == Theme::Dark) {
-                timeStyle = "color:#888888;";
-                if (isSelf) {
-                    senderStyle = "font-weight:600;color:#5fb8ff;";
-                    textStyle = "color:#d0ecff;";
-                } else {
-                    senderStyle = "font-weight:600;color:#ffffff;";
-                    textStyle = "color:#ffffff;";
-                }
-            } else {
-                timeStyle = "color:#666666;";
-                if (isSelf) {
-                    senderStyle = "font-weight:600;color:#0066cc;";
-                    textStyle = "color:#003366;";
-                } else {
-                    senderStyle = "font-weight:600;color:#000000;";
-                    textStyle = "color:#000000;";
-                }
-            }
-            
-            QString html = QString("<div><span style=\"%1\">[%2]</span> <span style=\"%3\">%4</span>: <span style=\"%5\">%6</span></div>")
-                              .arg(timeStyle, escapedTime, senderStyle, escapedSender, textStyle, escapedText);
-            m_chatView->append(html);
+            m_chatView->append(QStringLiteral("<div>%1</div>").arg(userMessageSpans(message)));
+            registerMessageBlock({message.sender(), message.timestamp().toMSecsSinceEpoch()});
         }
     }
 }
@@ -1,20 +1,27 @@
 #pragma once
 
+#include "ChatMessage.h"
+#include "CompactMessage.h"
+#include "SenderTable.h"
+
 #include <QMainWindow>
 #include <QDateTime>
+#include <QHash>
 #include <QList>
+#include <QMap>
 #include <QString>
 
 #include <memory>
+#include <utility>
 
 class ChatClient;
-class ChatMessage;
 class QTextEdit;
 class QLineEdit;
 class QPushButton;
 class QSystemTrayIcon;
 class QListWidget;
 class QLabel;
+class QPoint;
 class QWidget;
 
 class MainWindow final : public QMainWindow {
@@ -28,9 +35,17 @@ private slots:
     void onSendClicked();
     void onConnectClicked();
     void onMessageReceived(const ChatMessage &message);
+    void onMessagesReceived(const QList<ChatMessage> &messages);
     void onConnectionStateChanged(bool connected);
     void onErrorOccurred(const QString &message);
     void onAuthenticatedChanged(bool authenticated);
+    void onRoomChanged(const QString &room);
+    void onDirectMessageReceived(const QString &sender, const QString &recipient, const QString &text,
+                                 const QDateTime &sentAt);
+    void onMessageEdited(const QString &text);
+    void onTypingChanged(const QStringList &users);
+    void onReactionsUpdated(const QString &author, qint64 timestampMs, const QList<std::pair<QString, int>> &counts);
+    void onChatContextMenu(const QPoint &pos);
     void onThemeChanged();
 
 private:
@@ -42,6 +57,7 @@ private:
     void buildUi();
     void bindSignals();
     void appendSystemMessage(const QString &message);
+    void appendMessage(const ChatMessage &message);
     void updateControls();
     void showMessageNotification(const ChatMessage &message);
     void applyTheme(Theme theme);
@@ -49,13 +65,28 @@ private:
     void saveTheme();
     static QString htmlEscape(const QString &text);
 
+    enum class EntryKind : quint8 {
+        User,
+        System,
+        DirectIn,   // личное сообщение нам, отправитель — собеседник
+        DirectOut   // наше личное сообщение, в поле отправителя — получатель
+    };
+
     struct ChatEntry {
-        QString sender;
-        QString text;
-        QDateTime timestamp;
-        bool isSystem;
+        CompactMessage message;
+        EntryKind kind;
     };
 
+    // Сообщение комнаты определяется автором и временем отправки в мс, как в кадрах реакций
+    using MessageKey = std::pair<QString, qint64>;
+
+    [[nodiscard]] QString directMessageHtml(const ChatMessage &message, bool outgoing) const;
+    // Содержимое строки сообщения комнаты без обёртки: время, автор, текст и реакции.
+    [[nodiscard]] QString userMessageSpans(const ChatMessage &message) const;
+    [[nodiscard]] QString reactionsHtml(const MessageKey &key) const;
+    // Запоминает, в каком блоке документа стоит только что добавленное сообщение.
+    void registerMessageBlock(const MessageKey &key);
+
     void renderAllMessages();
     void updateUserList(const QStringList &users);
 
@@ -73,9 +104,19 @@ private:
     QSystemTrayIcon *m_trayIcon = nullptr;
     QListWidget *m_userListWidget = nullptr;
     QLabel *m_userListLabel = nullptr;
+    QLabel *m_typingLabel = nullptr;
     QWidget *m_userListPanel = nullptr;
     bool m_authenticated = false;
+    QString m_currentRoom;
+    // Когда серверу последний раз ушла отметка о наборе текста, мс
+    qint64 m_lastTypingSentMs = 0;
     Theme m_currentTheme = Theme::Dark;
     QList<ChatEntry> m_chatHistory;
+    SenderTable m_chatSenders;
+    // Счётчики реакций по сообщениям; могут прийти раньше самих сообщений истории
+    QHash<MessageKey, QMap<QString, int>> m_reactions;
+    // Номера блоков документа чата: при изменении счётчика перерисовывается одна строка
+    QHash<MessageKey, int> m_messageBlocks;
+    QHash<int, MessageKey> m_blockMessages;
 };
 
@@ -9,10 +9,26 @@ INCLUDEPATH += $$PWD/src
 
 HEADERS += \
     src/ChatMessage.h \
+    src/CompactMessage.h \
+    src/ControlMessage.h \
+    src/FrameType.h \
+    src/HeaderCompression.h \
     src/IMessageSerializer.h \
-    src/JsonMessageSerializer.h
+    src/JsonCodec.h \
+    src/JsonMessageSerializer.h \
+    src/MessageSchema.h \
+    src/SenderTable.h \
+    src/SessionCapabilities.h \
+    src/StreamCompression.h
 
 SOURCES += \
     src/ChatMessage.cpp \
-    src/JsonMessageSerializer.cpp
+    src/CompactMessage.cpp \
+    src/ControlMessage.cpp \
+    src/HeaderCompression.cpp \
+    src/JsonCodec.cpp \
+    src/JsonMessageSerializer.cpp \
+    src/SenderTable.cpp \
+    src/SessionCapabilities.cpp \
+    src/StreamCompression.cpp
 
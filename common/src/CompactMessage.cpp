@@ -0,0 +1,77 @@
+#include "CompactMessage.h"
+
+#include "ChatMessage.h"
+#include "SenderTable.h"
+
+#include <QStringEncoder>
+#include <QTimeZone>
+
+namespace {
+// Длина текста в UTF-8. Одиночный суррогат считается за три байта — не меньше его замены
+// при кодировании, поэтому результат всегда достаточен для буфера
+qsizetype utf8Length(QStringView text)
+{
+    qsizetype length = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        const char16_t unit = text[i].unicode();
+        if (unit < 0x80) {
+            length += 1;
+        } else if (unit < 0x800) {
+            length += 2;
+        } else if (QChar::isHighSurrogate(unit) && i + 1 < text.size() && QChar::isLowSurrogate(text[i + 1].unicode())) {
+            length += 4;
+            ++i;
+        } else {
+            length += 3;
+        }
+    }
+    return length;
+}
+} // namespace
+
+CompactMessage::CompactMessage(const ChatMessage &message, SenderTable &senders)
+    : m_timestampMs(message.timestamp().toMSecsSinceEpoch())
+    , m_senderId(senders.intern(message.sender()))
+{
+    // Текст кодируется сразу в буфер точного размера: одно выделение без запаса под худший случай
+    const QString &text = message.text();
+    const qsizetype length = utf8Length(text);
+    if (length == 0) {
+        return;
+    }
+    // reserve выделяет ровно столько, сколько просили; resize сам выделил бы с запасом на рост
+    m_text.reserve(length);
+    m_text.resize(length);
+    QStringEncoder encoder(QStringConverter::Utf8, QStringConverter::Flag::Stateless);
+    const char *end = encoder.appendToBuffer(m_text.data(), text);
+    m_text.truncate(end - m_text.constData());
+}
+
+ChatMessage CompactMessage::toChatMessage(const SenderTable &senders) const
+{
+    return ChatMessage{
+        senders.name(m_senderId),
+        QString::fromUtf8(m_text),
+        QDateTime::fromMSecsSinceEpoch(m_timestampMs, QTimeZone::utc())
+    };
+}
+
+quint32 CompactMessage::senderId() const
+{
+    return m_senderId;
+}
+
+const QByteArray &CompactMessage::textUtf8() const
+{
+    return m_text;
+}
+
+qint64 CompactMessage::timestampMs() const
+{
+    return m_timestampMs;
+}
+
+qsizetype CompactMessage::footprint() const
+{
+    return qsizetype(sizeof(CompactMessage)) + m_text.capacity();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QByteArray>
+#include <QtGlobal>
+
+class ChatMessage;
+class SenderTable;
+
+// Представление сообщения для хранения: текст в UTF-8, отправитель —
+// идентификатор из SenderTable, время — миллисекунды от эпохи (UTC).
+// В ChatMessage и обратно преобразуется только на границах (приём/отправка).
+class CompactMessage {
+public:
+    CompactMessage() = default;
+    CompactMessage(const ChatMessage &message, SenderTable &senders);
+
+    [[nodiscard]] ChatMessage toChatMessage(const SenderTable &senders) const;
+
+    [[nodiscard]] quint32 senderId() const;
+    [[nodiscard]] const QByteArray &textUtf8() const;
+    [[nodiscard]] qint64 timestampMs() const;
+
+    // Сколько байт занимает запись вместе с текстом в куче.
+    [[nodiscard]] qsizetype footprint() const;
+
+private:
+    QByteArray m_text;
+    qint64 m_timestampMs = 0;
+    quint32 m_senderId = 0;
+};
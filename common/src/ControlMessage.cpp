@@ -0,0 +1,290 @@
+#include "ControlMessage.h"
+
+#include "FrameType.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTimeZone>
+
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+constexpr char kKindBase = 'A';
+// Сколько аргументов у каждого вида; -1 — любое количество
+constexpr std::array<qsizetype, std::size_t(ControlKind::Count)> kArgumentCounts = {
+    2,  // Login
+    0,  // AuthOk
+    1,  // AuthFail
+    -1, // UserList
+    5,  // Hello
+    5,  // Welcome
+    1,  // Room
+    4,  // Direct
+    -1, // Typing
+    3,  // React
+    -1, // Reactions
+};
+
+// Виды, к которым новые версии протокола дописывают поля в конец: их число
+// аргументов из kArgumentCounts — минимум, лишние поля старая сторона пропускает
+bool isExtensible(ControlKind kind)
+{
+    return kind == ControlKind::Hello || kind == ControlKind::Welcome;
+}
+
+const QString &argument(const QStringList &arguments, qsizetype index)
+{
+    Q_ASSERT(index < arguments.size());
+    return arguments.at(index);
+}
+} // namespace
+
+ControlMessage::ControlMessage(ControlKind kind, QStringList arguments)
+    : m_arguments(std::move(arguments))
+    , m_kind(kind)
+{
+}
+
+ControlMessage ControlMessage::login(const QString &userName, const QString &password)
+{
+    return ControlMessage(ControlKind::Login, {userName, password});
+}
+
+ControlMessage ControlMessage::authOk()
+{
+    return ControlMessage(ControlKind::AuthOk, {});
+}
+
+ControlMessage ControlMessage::authFail(const QString &reason)
+{
+    return ControlMessage(ControlKind::AuthFail, {reason});
+}
+
+ControlMessage ControlMessage::userList(const QStringList &users)
+{
+    return ControlMessage(ControlKind::UserList, users);
+}
+
+ControlMessage ControlMessage::hello(const QStringList &fields)
+{
+    return ControlMessage(ControlKind::Hello, fields);
+}
+
+ControlMessage ControlMessage::welcome(const QStringList &fields)
+{
+    return ControlMessage(ControlKind::Welcome, fields);
+}
+
+ControlMessage ControlMessage::room(const QString &name)
+{
+    return ControlMessage(ControlKind::Room, {name});
+}
+
+ControlMessage ControlMessage::direct(const QString &sender, const QString &recipient, const QString &text,
+                                      const QDateTime &sentAt)
+{
+    return ControlMessage(ControlKind::Direct, {sender, recipient, text, QString::number(sentAt.toMSecsSinceEpoch())});
+}
+
+ControlMessage ControlMessage::typing(const QStringList &users)
+{
+    return ControlMessage(ControlKind::Typing, users);
+}
+
+ControlMessage ControlMessage::react(const QString &author, qint64 timestampMs, const QString &reaction)
+{
+    return ControlMessage(ControlKind::React, {author, QString::number(timestampMs), reaction});
+}
+
+ControlMessage ControlMessage::reactions(const QString &author, qint64 timestampMs,
+                                         const QList<std::pair<QString, int>> &counts)
+{
+    QStringList arguments{author, QString::number(timestampMs)};
+    arguments.reserve(2 + counts.size() * 2);
+    for (const auto &[reaction, count] : counts) {
+        arguments.append(reaction);
+        arguments.append(QString::number(count));
+    }
+    return ControlMessage(ControlKind::Reactions, std::move(arguments));
+}
+
+ControlKind ControlMessage::kind() const
+{
+    return m_kind;
+}
+
+const QString &ControlMessage::userName() const
+{
+    Q_ASSERT(m_kind == ControlKind::Login);
+    return argument(m_arguments, 0);
+}
+
+const QString &ControlMessage::password() const
+{
+    Q_ASSERT(m_kind == ControlKind::Login);
+    return argument(m_arguments, 1);
+}
+
+const QString &ControlMessage::reason() const
+{
+    Q_ASSERT(m_kind == ControlKind::AuthFail);
+    return argument(m_arguments, 0);
+}
+
+const QStringList &ControlMessage::users() const
+{
+    Q_ASSERT(m_kind == ControlKind::UserList);
+    return m_arguments;
+}
+
+const QString &ControlMessage::roomName() const
+{
+    Q_ASSERT(m_kind == ControlKind::Room);
+    return argument(m_arguments, 0);
+}
+
+const QString &ControlMessage::sender() const
+{
+    Q_ASSERT(m_kind == ControlKind::Direct);
+    return argument(m_arguments, 0);
+}
+
+const QString &ControlMessage::recipient() const
+{
+    Q_ASSERT(m_kind == ControlKind::Direct);
+    return argument(m_arguments, 1);
+}
+
+const QString &ControlMessage::text() const
+{
+    Q_ASSERT(m_kind == ControlKind::Direct);
+    return argument(m_arguments, 2);
+}
+
+QDateTime ControlMessage::sentAt() const
+{
+    Q_ASSERT(m_kind == ControlKind::Direct);
+    bool ok = false;
+    const qint64 msecs = argument(m_arguments, 3).toLongLong(&ok);
+    return ok ? QDateTime::fromMSecsSinceEpoch(msecs, QTimeZone::utc()) : QDateTime::currentDateTimeUtc();
+}
+
+const QStringList &ControlMessage::typingUsers() const
+{
+    Q_ASSERT(m_kind == ControlKind::Typing);
+    return m_arguments;
+}
+
+const QString &ControlMessage::author() const
+{
+    Q_ASSERT(m_kind == ControlKind::React || m_kind == ControlKind::Reactions);
+    return argument(m_arguments, 0);
+}
+
+qint64 ControlMessage::messageTimestampMs() const
+{
+    Q_ASSERT(m_kind == ControlKind::React || m_kind == ControlKind::Reactions);
+    return m_arguments.size() > 1 ? m_arguments.at(1).toLongLong() : 0;
+}
+
+const QString &ControlMessage::reaction() const
+{
+    Q_ASSERT(m_kind == ControlKind::React);
+    return argument(m_arguments, 2);
+}
+
+QList<std::pair<QString, int>> ControlMessage::reactionCounts() const
+{
+    Q_ASSERT(m_kind == ControlKind::Reactions);
+    QList<std::pair<QString, int>> counts;
+    for (qsizetype i = 2; i + 1 < m_arguments.size(); i += 2) {
+        bool ok = false;
+        const int count = m_arguments.at(i + 1).toInt(&ok);
+        if (ok && count >= 0) {
+            counts.append({m_arguments.at(i), count});
+        }
+    }
+    return counts;
+}
+
+const QStringList &ControlMessage::fields() const
+{
+    Q_ASSERT(m_kind == ControlKind::Hello || m_kind == ControlKind::Welcome);
+    return m_arguments;
+}
+
+QByteArray ControlMessage::encodeFrame() const
+{
+    QByteArray frame;
+    frame.append(static_cast<char>(FrameType::Control));
+    frame.append(static_cast<char>(kKindBase + static_cast<char>(m_kind)));
+    frame.append(QJsonDocument(QJsonArray::fromStringList(m_arguments)).toJson(QJsonDocument::Compact));
+    frame.append('\n');
+    return frame;
+}
+
+QString ControlMessage::legacyText() const
+{
+    switch (m_kind) {
+    case ControlKind::AuthOk:
+        return QStringLiteral("AUTH_OK");
+    case ControlKind::AuthFail:
+        return QStringLiteral("AUTH_FAIL: %1").arg(reason());
+    case ControlKind::UserList:
+        return QStringLiteral("USER_LIST:") + m_arguments.join(QLatin1Char(','));
+    case ControlKind::Direct:
+        return QStringLiteral("[ЛС] %1 → %2: %3").arg(sender(), recipient(), text());
+    case ControlKind::Login:
+    case ControlKind::Hello:
+    case ControlKind::Welcome:
+    case ControlKind::Room:
+    case ControlKind::Typing:
+    case ControlKind::React:
+    case ControlKind::Reactions:
+    case ControlKind::Count:
+        break;
+    }
+    return QString();
+}
+
+ControlMessage ControlMessage::decode(const QByteArray &payload)
+{
+    if (payload.size() < 2 || !hasFrameType(payload, FrameType::Control)) {
+        throw std::runtime_error("Invalid control frame: too short");
+    }
+
+    const int kindIndex = payload.at(1) - kKindBase;
+    if (kindIndex < 0 || kindIndex >= int(ControlKind::Count)) {
+        throw std::runtime_error("Invalid control frame: unknown kind");
+    }
+
+    const auto document = QJsonDocument::fromJson(payload.sliced(2));
+    if (!document.isArray()) {
+        throw std::runtime_error("Invalid control frame: payload is not a JSON array");
+    }
+
+    QStringList arguments;
+    const auto array = document.array();
+    arguments.reserve(array.size());
+    for (const auto &value : array) {
+        if (!value.isString()) {
+            throw std::runtime_error("Invalid control frame: non-string argument");
+        }
+        arguments.append(value.toString());
+    }
+
+    const qsizetype expected = kArgumentCounts[std::size_t(kindIndex)];
+    const bool countOk = isExtensible(ControlKind(kindIndex)) ? arguments.size() >= expected
+                                                              : arguments.size() == expected;
+    if (expected >= 0 && !countOk) {
+        throw std::runtime_error("Invalid control frame: wrong number of arguments");
+    }
+    // Счётчики реакций идут парами после автора и времени сообщения
+    if (ControlKind(kindIndex) == ControlKind::Reactions && (arguments.size() < 2 || arguments.size() % 2 != 0)) {
+        throw std::runtime_error("Invalid control frame: malformed reaction counts");
+    }
+
+    return ControlMessage(static_cast<ControlKind>(kindIndex), std::move(arguments));
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+#include <utility>
+
+// Вид управляющего сообщения. Значения плотные: по ним индексируются таблицы
+// обработчиков на клиенте и сервере. Новый вид добавляется перед Count.
+enum class ControlKind : quint8 {
+    Login,      // клиент → сервер: [логин, пароль]
+    AuthOk,     // сервер → клиент: []
+    AuthFail,   // сервер → клиент: [причина]
+    UserList,   // сервер → клиент: [имя, ...]
+    Hello,      // клиент → сервер: поля SessionCapabilities (что клиент умеет)
+    Welcome,    // сервер → клиент: поля SessionCapabilities (что выбрано)
+    Room,       // сервер → клиент: [комната], в которой теперь клиент
+    Direct,     // оба направления: [отправитель, получатель, текст, время в мс UTC] — личное сообщение
+    Typing,     // клиент → сервер: [] — пользователь печатает; сервер → клиент: [имя, ...] — кто печатает в комнате
+    React,      // клиент → сервер: [автор, время в мс UTC, реакция] — поставить или снять реакцию на сообщение
+    Reactions,  // сервер → клиент: [автор, время в мс UTC, реакция, счётчик, ...] — новые значения счётчиков
+    Count
+};
+
+// Управляющее сообщение протокола. Идёт отдельным кадром FrameType::Control,
+// а не текстом от "SERVER", поэтому не попадает в историю и лог и не
+// пересекается с пользовательскими сообщениями.
+// Кадр: 'K', байт вида ('A' + значение ControlKind), JSON-массив строк.
+class ControlMessage {
+public:
+    ControlMessage() = default;
+
+    [[nodiscard]] static ControlMessage login(const QString &userName, const QString &password);
+    [[nodiscard]] static ControlMessage authOk();
+    [[nodiscard]] static ControlMessage authFail(const QString &reason);
+    [[nodiscard]] static ControlMessage userList(const QStringList &users);
+    [[nodiscard]] static ControlMessage hello(const QStringList &fields);
+    [[nodiscard]] static ControlMessage welcome(const QStringList &fields);
+    [[nodiscard]] static ControlMessage room(const QString &name);
+    [[nodiscard]] static ControlMessage direct(const QString &sender, const QString &recipient, const QString &text,
+                                               const QDateTime &sentAt);
+    [[nodiscard]] static ControlMessage typing(const QStringList &users = {});
+    // Сообщение определяется автором и временем: оба поля есть в любом виде кадра сообщения.
+    [[nodiscard]] static ControlMessage react(const QString &author, qint64 timestampMs, const QString &reaction);
+    [[nodiscard]] static ControlMessage reactions(const QString &author, qint64 timestampMs,
+                                                  const QList<std::pair<QString, int>> &counts);
+
+    [[nodiscard]] ControlKind kind() const;
+
+    // Поля по видам; обращаться только к полям своего вида.
+    [[nodiscard]] const QString &userName() const;
+    [[nodiscard]] const QString &password() const;
+    [[nodiscard]] const QString &reason() const;
+    [[nodiscard]] const QStringList &users() const;
+    [[nodiscard]] const QString &roomName() const;
+    [[nodiscard]] const QString &sender() const;
+    [[nodiscard]] const QString &recipient() const;
+    [[nodiscard]] const QString &text() const;
+    // Время отправки; если поле не разобрать — текущее.
+    [[nodiscard]] QDateTime sentAt() const;
+    [[nodiscard]] const QStringList &typingUsers() const;
+    // Поля React и Reactions.
+    [[nodiscard]] const QString &author() const;
+    [[nodiscard]] qint64 messageTimestampMs() const;
+    [[nodiscard]] const QString &reaction() const;
+    // Пары (реакция, счётчик); счётчик 0 — реакцию сняли все. Некорректные пары пропускаются.
+    [[nodiscard]] QList<std::pair<QString, int>> reactionCounts() const;
+    // Поля рукопожатия (Hello, Welcome) — разбирает SessionCapabilities.
+    [[nodiscard]] const QStringList &fields() const;
+
+    // Кадр с завершающим переводом строки.
+    [[nodiscard]] QByteArray encodeFrame() const;
+    // Текстовая форма для клиентов, не знающих управляющих кадров ("AUTH_OK", "USER_LIST:...").
+    [[nodiscard]] QString legacyText() const;
+
+    // Разбирает кадр целиком (вместе с байтом типа). При ошибке бросает
+    // std::runtime_error, как JsonMessageSerializer.
+    [[nodiscard]] static ControlMessage decode(const QByteArray &payload);
+
+private:
+    ControlMessage(ControlKind kind, QStringList arguments);
+
+    QStringList m_arguments;
+    ControlKind m_kind = ControlKind::Count;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <QByteArray>
+
+// Тип кадра определяется его первым байтом. Обычное сообщение — это JSON-объект
+// без префикса (совместимо со старыми клиентами), остальные типы помечаются
+// одним ASCII-символом перед телом кадра.
+enum class FrameType : char {
+    Message = '{',
+    HistoryBatch = 'B',
+    // Сообщение со сжатыми заголовками (HeaderCompression.h)
+    HeaderCompressed = 'H',
+    // Управляющее сообщение (ControlMessage.h)
+    Control = 'K'
+};
+
+[[nodiscard]] inline bool hasFrameType(const QByteArray &payload, FrameType type)
+{
+    return !payload.isEmpty() && payload.front() == static_cast<char>(type);
+}
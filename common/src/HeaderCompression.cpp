@@ -0,0 +1,88 @@
+#include "HeaderCompression.h"
+
+#include "ChatMessage.h"
+#include "FrameType.h"
+#include "JsonCodec.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTimeZone>
+
+#include <stdexcept>
+
+namespace {
+constexpr qsizetype kKnownSenderSize = 3;
+constexpr qsizetype kNewSenderSize = 4;
+} // namespace
+
+QByteArray HeaderEncoder::encodeText(const QString &text)
+{
+    QByteArray encoded;
+    appendJsonString(encoded, text);
+    return encoded;
+}
+
+QByteArray HeaderEncoder::encode(const ChatMessage &message, const QByteArray &encodedText)
+{
+    const QString &sender = message.sender();
+    const bool known = m_senders.contains(sender);
+    if (!known && m_senders.size() >= kMaxSenders) {
+        return QByteArray();
+    }
+
+    const quint32 id = m_senders.intern(sender);
+    const qint64 timestampMs = message.timestamp().toMSecsSinceEpoch();
+    const qint64 delta = timestampMs - m_lastTimestampMs;
+    m_lastTimestampMs = timestampMs;
+
+    QByteArray frame;
+    frame.reserve(encodedText.size() + 32);
+    frame.append(static_cast<char>(FrameType::HeaderCompressed));
+    frame.append('[');
+    frame.append(QByteArray::number(id));
+    if (!known) {
+        frame.append(',');
+        appendJsonString(frame, sender);
+    }
+    frame.append(',');
+    frame.append(QByteArray::number(delta));
+    frame.append(',');
+    frame.append(encodedText);
+    frame.append("]\n");
+    return frame;
+}
+
+ChatMessage HeaderDecoder::decode(const QByteArray &body)
+{
+    const auto document = QJsonDocument::fromJson(body);
+    if (!document.isArray()) {
+        throw std::runtime_error("Invalid compressed header frame: not a JSON array");
+    }
+
+    const auto array = document.array();
+    if (array.size() != kKnownSenderSize && array.size() != kNewSenderSize) {
+        throw std::runtime_error("Invalid compressed header frame: unexpected size");
+    }
+
+    const qint64 id = array.at(0).toInteger(-1);
+    if (array.size() == kNewSenderSize) {
+        // Новое имя получает следующий номер — он должен совпасть с номером кодировщика
+        const auto name = array.at(1).toString();
+        if (name.isEmpty() || m_senders.size() >= HeaderEncoder::kMaxSenders
+            || m_senders.contains(name) || id != m_senders.size()) {
+            throw std::runtime_error("Invalid compressed header frame: sender table out of sync");
+        }
+        (void)m_senders.intern(name);
+    } else if (id < 0 || id >= m_senders.size()) {
+        throw std::runtime_error("Invalid compressed header frame: unknown sender");
+    }
+
+    const auto text = array.at(array.size() - 1).toString();
+    if (text.isEmpty()) {
+        throw std::runtime_error("Invalid compressed header frame: missing text");
+    }
+
+    m_lastTimestampMs += array.at(array.size() - 2).toInteger();
+    return ChatMessage{m_senders.name(quint32(id)), text,
+                       QDateTime::fromMSecsSinceEpoch(m_lastTimestampMs, QTimeZone::utc())};
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "SenderTable.h"
+
+#include <QByteArray>
+#include <QString>
+
+class ChatMessage;
+
+// Сжатие заголовков сообщения (отправитель и время) в пределах одного
+// соединения, по образцу HPACK. Отправитель получает номер при первом
+// появлении, дальше кадр ссылается на номер; время передаётся разницей
+// с предыдущим таким кадром. Кодировщик на сервере и декодер на клиенте
+// ведут одинаковые таблицы, поэтому кадры этого типа нельзя терять или
+// переставлять — они идут по тому же TCP-потоку в порядке отправки.
+//
+// Тело кадра FrameType::HeaderCompressed:
+//   [номер, дельта (мс), "текст"]          — отправитель уже известен;
+//   [номер, "имя", дельта (мс), "текст"]   — отправитель встречается впервые.
+class HeaderEncoder {
+public:
+    // Предел таблицы отправителей на соединение; дальше новые имена идут обычными кадрами.
+    static constexpr qsizetype kMaxSenders = 1024;
+
+    // Текст в виде JSON-строки. Не зависит от соединения, поэтому при рассылке
+    // кодируется один раз и подставляется в кадр каждого получателя.
+    [[nodiscard]] static QByteArray encodeText(const QString &text);
+
+    // Кадр с завершающим переводом строки или пустой массив, если отправителя
+    // нельзя добавить в таблицу — тогда вызывающий отправляет обычный кадр.
+    [[nodiscard]] QByteArray encode(const ChatMessage &message, const QByteArray &encodedText);
+
+private:
+    SenderTable m_senders;
+    qint64 m_lastTimestampMs = 0;
+};
+
+class HeaderDecoder {
+public:
+    // Разбирает тело кадра без байта типа. При нарушении протокола бросает
+    // std::runtime_error, как JsonMessageSerializer.
+    [[nodiscard]] ChatMessage decode(const QByteArray &body);
+
+private:
+    SenderTable m_senders;
+    qint64 m_lastTimestampMs = 0;
+};
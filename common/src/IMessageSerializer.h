@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QByteArray>
+#include <QList>
 
 class ChatMessage;
 
@@ -10,5 +11,9 @@ public:
 
     [[nodiscard]] virtual QByteArray serialize(const ChatMessage &message) const = 0;
     [[nodiscard]] virtual ChatMessage deserialize(const QByteArray &payload) const = 0;
+
+    // Пакет сообщений (история): общий словарь отправителей и разностные метки времени.
+    [[nodiscard]] virtual QByteArray serializeBatch(const QList<ChatMessage> &messages) const = 0;
+    [[nodiscard]] virtual QList<ChatMessage> deserializeBatch(const QByteArray &payload) const = 0;
 };
 
@@ -0,0 +1,135 @@
+#include "JsonCodec.h"
+
+#include <QStringEncoder>
+#include <QStringView>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+bool needsEscaping(char c)
+{
+    return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+}
+
+void appendEscaped(QByteArray &out, char c)
+{
+    switch (c) {
+    case '"':
+        out.append("\\\"");
+        break;
+    case '\\':
+        out.append("\\\\");
+        break;
+    case '\b':
+        out.append("\\b");
+        break;
+    case '\f':
+        out.append("\\f");
+        break;
+    case '\n':
+        out.append("\\n");
+        break;
+    case '\r':
+        out.append("\\r");
+        break;
+    case '\t':
+        out.append("\\t");
+        break;
+    default: {
+        static constexpr char kHex[] = "0123456789abcdef";
+        const auto byte = static_cast<unsigned char>(c);
+        const char escaped[] = {'\\', 'u', '0', '0', kHex[byte >> 4], kHex[byte & 0xf]};
+        out.append(escaped, sizeof(escaped));
+        break;
+    }
+    }
+}
+} // namespace
+
+void appendJsonString(QByteArray &out, QStringView value)
+{
+    // UTF-8 пишется прямо в хвост буфера: под кавычки и худший случай кодирования
+    const qsizetype start = out.size();
+    const qsizetype required = start + value.size() * 3 + 2;
+    if (out.capacity() < required) {
+        out.reserve(required);
+    }
+    out.resize(required);
+    char *begin = out.data() + start;
+    *begin++ = '"';
+    QStringEncoder encoder(QStringConverter::Utf8, QStringConverter::Flag::Stateless);
+    char *end = encoder.appendToBuffer(begin, value);
+
+    if (std::find_if(begin, end, needsEscaping) == end) {
+        *end++ = '"';
+        out.truncate(end - out.constData());
+        return;
+    }
+
+    // Есть спецсимволы (редкий случай): участки без них копируются целиком
+    const QByteArray utf8(begin, end - begin);
+    out.truncate(start + 1);
+    const char *run = utf8.constData();
+    const char *last = run + utf8.size();
+    for (const char *it = run; it != last; ++it) {
+        if (needsEscaping(*it)) {
+            out.append(run, it - run);
+            appendEscaped(out, *it);
+            run = it + 1;
+        }
+    }
+    out.append(run, last - run);
+    out.append('"');
+}
+
+qsizetype JsonValueCodec<QString>::sizeHint(const QString &value)
+{
+    return value.size() * 3 + 2;
+}
+
+void JsonValueCodec<QString>::write(QByteArray &out, const QString &value)
+{
+    appendJsonString(out, value);
+}
+
+bool JsonValueCodec<QString>::read(const QJsonValue &json, QString &value)
+{
+    value = json.toString();
+    return !value.isEmpty();
+}
+
+qsizetype JsonValueCodec<QDateTime>::sizeHint(const QDateTime &)
+{
+    // "yyyy-MM-ddTHH:mm:ss.zzz+hh:mm" в кавычках
+    return 31;
+}
+
+void JsonValueCodec<QDateTime>::write(QByteArray &out, const QDateTime &value)
+{
+    // Время сообщений хранится в UTC: его строка собирается без промежуточного QString,
+    // результат совпадает с toString(Qt::ISODateWithMs)
+    const QDate date = value.date();
+    if (!value.isValid() || value.timeRepresentation().timeSpec() != Qt::UTC || date.year() < 1
+        || date.year() > 9999) {
+        appendJsonString(out, value.toString(Qt::ISODateWithMs));
+        return;
+    }
+
+    const QTime time = value.time();
+    char text[32];
+    const int length = std::snprintf(text, sizeof(text), "\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\"", date.year(),
+                                     date.month(), date.day(), time.hour(), time.minute(), time.second(),
+                                     time.msec());
+    out.append(text, qBound(0, length, int(sizeof(text)) - 1));
+}
+
+bool JsonValueCodec<QDateTime>::read(const QJsonValue &json, QDateTime &value)
+{
+    value = QDateTime::fromString(json.toString(), Qt::ISODateWithMs);
+    if (!value.isValid()) {
+        return false;
+    }
+    value = value.toUTC();
+    return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "MessageSchema.h"
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+#include <stdexcept>
+
+// Кодек JSON-объекта, собранный по схеме сообщения (MessageSchema.h).
+// Ключи и порядок полей известны на этапе компиляции: кодирование пишет
+// текст напрямую, разбор ищет поля по статическим именам.
+// Формат совпадает с прежним: {"sender":"...","text":"...","timestamp":"..."}.
+
+// Кодирование значений поля по типу. Разбор возвращает false, если
+// значения нет или оно некорректно: все поля схемы обязательны.
+// sizeHint — сколько байт обычно займёт значение; по сумме подсказок
+// буфер кадра резервируется один раз.
+template <typename Value>
+struct JsonValueCodec;
+
+template <>
+struct JsonValueCodec<QString> {
+    [[nodiscard]] static qsizetype sizeHint(const QString &value);
+    static void write(QByteArray &out, const QString &value);
+    [[nodiscard]] static bool read(const QJsonValue &json, QString &value);
+};
+
+template <>
+struct JsonValueCodec<QDateTime> {
+    [[nodiscard]] static qsizetype sizeHint(const QDateTime &value);
+    static void write(QByteArray &out, const QDateTime &value);
+    [[nodiscard]] static bool read(const QJsonValue &json, QDateTime &value);
+};
+
+// Экранированная JSON-строка в UTF-8 вместе с кавычками.
+void appendJsonString(QByteArray &out, QStringView value);
+
+template <typename Message>
+class JsonCodec {
+public:
+    using Schema = SchemaOf<Message>;
+
+    [[nodiscard]] static QByteArray encode(const Message &message)
+    {
+        // Скобки объекта и место под завершающий перевод строки кадра
+        qsizetype capacity = 3;
+        Schema::forEachField([&](auto field) {
+            using F = decltype(field);
+            capacity += qsizetype(F::name.size()) + 4 + JsonValueCodec<typename F::Value>::sizeHint(F::get(message));
+        });
+
+        QByteArray out;
+        out.reserve(capacity);
+        out.append('{');
+        bool first = true;
+        Schema::forEachField([&](auto field) {
+            using F = decltype(field);
+            if (!first) {
+                out.append(',');
+            }
+            first = false;
+            out.append('"');
+            out.append(F::name.data(), qsizetype(F::name.size()));
+            out.append("\":");
+            JsonValueCodec<typename F::Value>::write(out, F::get(message));
+        });
+        out.append('}');
+        return out;
+    }
+
+    // Бросает std::runtime_error, если это не объект или какого-то поля нет.
+    [[nodiscard]] static Message decode(const QByteArray &payload)
+    {
+        const auto document = QJsonDocument::fromJson(payload);
+        if (!document.isObject()) {
+            throw std::runtime_error("Invalid message payload: not a JSON object");
+        }
+
+        const auto object = document.object();
+        Message message;
+        const bool complete = Schema::allFields([&](auto field) {
+            using F = decltype(field);
+            typename F::Value value;
+            const auto json = object.value(QLatin1StringView(F::name.data(), qsizetype(F::name.size())));
+            if (!JsonValueCodec<typename F::Value>::read(json, value)) {
+                return false;
+            }
+            F::set(message, value);
+            return true;
+        });
+        if (!complete) {
+            throw std::runtime_error("Invalid message payload: missing required fields");
+        }
+        return message;
+    }
+};
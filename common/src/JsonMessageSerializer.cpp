@@ -1,46 +1,90 @@
 #include "JsonMessageSerializer.h"
 
 #include "ChatMessage.h"
+#include "JsonCodec.h"
 
+#include <QHash>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QTimeZone>
 #include <stdexcept>
 
 namespace {
-constexpr auto kSenderKey = "sender";
-constexpr auto kTextKey = "text";
-constexpr auto kTimestampKey = "timestamp";
+// Пакет: [базовое время (мс), [отправители], [[индекс отправителя, дельта (мс), текст], ...]]
+constexpr qsizetype kBatchBaseIndex = 0;
+constexpr qsizetype kBatchSendersIndex = 1;
+constexpr qsizetype kBatchRowsIndex = 2;
+constexpr qsizetype kBatchSize = 3;
+constexpr qsizetype kRowSize = 3;
 }
 
 QByteArray JsonMessageSerializer::serialize(const ChatMessage &message) const
 {
-    QJsonObject object{
-        {QString::fromLatin1(kSenderKey), message.sender()},
-        {QString::fromLatin1(kTextKey), message.text()},
-        {QString::fromLatin1(kTimestampKey), message.timestamp().toString(Qt::ISODateWithMs)}
-    };
+    return JsonCodec<ChatMessage>::encode(message);
+}
+
+ChatMessage JsonMessageSerializer::deserialize(const QByteArray &payload) const
+{
+    return JsonCodec<ChatMessage>::decode(payload);
+}
+
+QByteArray JsonMessageSerializer::serializeBatch(const QList<ChatMessage> &messages) const
+{
+    QHash<QString, qsizetype> senderIndexes;
+    QJsonArray senders;
+    QJsonArray rows;
+    const qint64 base = messages.isEmpty() ? 0 : messages.first().timestamp().toMSecsSinceEpoch();
+    qint64 previous = base;
+
+    for (const auto &message : messages) {
+        auto it = senderIndexes.constFind(message.sender());
+        if (it == senderIndexes.constEnd()) {
+            it = senderIndexes.insert(message.sender(), senders.size());
+            senders.append(message.sender());
+        }
+        const qint64 timestamp = message.timestamp().toMSecsSinceEpoch();
+        rows.append(QJsonArray{qint64(it.value()), timestamp - previous, message.text()});
+        previous = timestamp;
+    }
 
-    QJsonDocument document{object};
+    QJsonDocument document{QJsonArray{base, senders, rows}};
     return document.toJson(QJsonDocument::Compact);
 }
 
-ChatMessage JsonMessageSerializer::deserialize(const QByteArray &payload) const
+QList<ChatMessage> JsonMessageSerializer::deserializeBatch(const QByteArray &payload) const
 {
     const auto document = QJsonDocument::fromJson(payload);
-    if (!document.isObject()) {
-        throw std::runtime_error("Invalid message payload: not a JSON object");
+    const auto batch = document.array();
+    if (!document.isArray() || batch.size() != kBatchSize) {
+        throw std::runtime_error("Invalid batch payload: not a batch array");
     }
 
-    const auto object = document.object();
-    const auto sender = object.value(QString::fromLatin1(kSenderKey)).toString();
-    const auto text = object.value(QString::fromLatin1(kTextKey)).toString();
-    const auto timestampString = object.value(QString::fromLatin1(kTimestampKey)).toString();
-    const auto timestamp = QDateTime::fromString(timestampString, Qt::ISODateWithMs);
+    const auto senders = batch.at(kBatchSendersIndex).toArray();
+    const auto rows = batch.at(kBatchRowsIndex).toArray();
+    qint64 timestamp = batch.at(kBatchBaseIndex).toInteger();
 
-    if (sender.isEmpty() || text.isEmpty() || !timestamp.isValid()) {
-        throw std::runtime_error("Invalid message payload: missing required fields");
+    QList<ChatMessage> messages;
+    messages.reserve(rows.size());
+    for (const auto &value : rows) {
+        const auto row = value.toArray();
+        if (row.size() != kRowSize) {
+            throw std::runtime_error("Invalid batch payload: malformed row");
+        }
+        const auto senderIndex = row.at(0).toInteger(-1);
+        if (senderIndex < 0 || senderIndex >= senders.size()) {
+            throw std::runtime_error("Invalid batch payload: unknown sender");
+        }
+        timestamp += row.at(1).toInteger();
+        const auto text = row.at(2).toString();
+        if (text.isEmpty()) {
+            throw std::runtime_error("Invalid batch payload: missing text");
+        }
+        messages.append(ChatMessage{
+            senders.at(senderIndex).toString(),
+            text,
+            QDateTime::fromMSecsSinceEpoch(timestamp, QTimeZone::utc())
+        });
     }
-
-    return ChatMessage{sender, text, timestamp.toUTC()};
+    return messages;
 }
-
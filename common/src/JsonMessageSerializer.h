@@ -6,5 +6,7 @@ class JsonMessageSerializer final : public IMessageSerializer {
 public:
     [[nodiscard]] QByteArray serialize(const ChatMessage &message) const override;
     [[nodiscard]] ChatMessage deserialize(const QByteArray &payload) const override;
+    [[nodiscard]] QByteArray serializeBatch(const QList<ChatMessage> &messages) const override;
+    [[nodiscard]] QList<ChatMessage> deserializeBatch(const QByteArray &payload) const override;
 };
 
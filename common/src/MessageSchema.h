@@ -0,0 +1,87 @@
+#pragma once
+
+#include "ChatMessage.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+
+// Описание полей сообщений на этапе компиляции. Схема типа — список Field
+// с именем поля на проводе, геттером и сеттером; кодеки каждого формата
+// (JsonCodec.h) обходят список шаблонно, без виртуальных вызовов и без
+// строк-ключей, собираемых во время работы. Новое поле — одна строка в схеме
+// и, если у него новый тип значения, кодек этого типа в каждом формате.
+
+// Имя поля как параметр шаблона.
+template <std::size_t N>
+struct FieldName {
+    constexpr FieldName(const char (&text)[N])
+    {
+        std::copy_n(text, N, value);
+    }
+
+    [[nodiscard]] constexpr std::string_view view() const
+    {
+        return std::string_view(value, N - 1);
+    }
+
+    char value[N];
+};
+
+template <typename Getter>
+struct GetterTraits;
+
+template <typename Class, typename Result>
+struct GetterTraits<Result (Class::*)() const> {
+    using Owner = Class;
+    using Value = std::remove_cvref_t<Result>;
+};
+
+template <FieldName Name, auto Getter, auto Setter>
+struct Field {
+    using Owner = typename GetterTraits<decltype(Getter)>::Owner;
+    using Value = typename GetterTraits<decltype(Getter)>::Value;
+
+    static constexpr std::string_view name = Name.view();
+
+    [[nodiscard]] static decltype(auto) get(const Owner &object)
+    {
+        return (object.*Getter)();
+    }
+
+    static void set(Owner &object, const Value &value)
+    {
+        (object.*Setter)(value);
+    }
+};
+
+template <typename... Fields>
+struct MessageSchema {
+    static constexpr std::size_t fieldCount = sizeof...(Fields);
+
+    // Вызывает visitor для каждого поля по порядку; visitor получает Field<...>{}.
+    template <typename Visitor>
+    static constexpr void forEachField(Visitor &&visitor)
+    {
+        (visitor(Fields{}), ...);
+    }
+
+    // То же, но с остановкой, как только visitor вернёт false.
+    template <typename Visitor>
+    static constexpr bool allFields(Visitor &&visitor)
+    {
+        return (visitor(Fields{}) && ...);
+    }
+};
+
+// Схема конкретного типа сообщения задаётся специализацией.
+template <typename Message>
+struct SchemaOf;
+
+template <>
+struct SchemaOf<ChatMessage> : MessageSchema<
+    Field<"sender", &ChatMessage::sender, &ChatMessage::setSender>,
+    Field<"text", &ChatMessage::text, &ChatMessage::setText>,
+    Field<"timestamp", &ChatMessage::timestamp, &ChatMessage::setTimestamp>> {
+};
@@ -0,0 +1,62 @@
+#include "SenderTable.h"
+
+quint32 SenderTable::intern(const QString &name)
+{
+    const auto it = m_ids.constFind(name);
+    if (it != m_ids.constEnd()) {
+        return it.value();
+    }
+
+    quint32 id;
+    if (!m_freeIds.isEmpty()) {
+        id = m_freeIds.takeLast();
+        m_names[id] = name;
+    } else {
+        id = static_cast<quint32>(m_names.size());
+        m_names.append(name);
+    }
+    m_ids.insert(name, id);
+    return id;
+}
+
+bool SenderTable::contains(const QString &name) const
+{
+    return m_ids.contains(name);
+}
+
+quint32 SenderTable::idOf(const QString &name) const
+{
+    return m_ids.value(name, kNoId);
+}
+
+const QString &SenderTable::name(quint32 id) const
+{
+    Q_ASSERT(id < static_cast<quint32>(m_names.size()));
+    return m_names.at(id);
+}
+
+qsizetype SenderTable::size() const
+{
+    return m_names.size();
+}
+
+void SenderTable::release(quint32 id)
+{
+    Q_ASSERT(id < static_cast<quint32>(m_names.size()));
+    m_ids.remove(m_names.at(id));
+    m_names[id] = QString();
+    m_freeIds.append(id);
+}
+
+void SenderTable::clear()
+{
+    m_ids.clear();
+    m_names.clear();
+    m_freeIds.clear();
+}
+
+qsizetype SenderTable::footprint(const QString &name)
+{
+    // Строка в списке и узел хэша (ключ и значение); данные ключ разделяет со строкой списка
+    return 2 * qsizetype(sizeof(QString)) + qsizetype(sizeof(quint32)) + name.capacity() * qsizetype(sizeof(QChar));
+}
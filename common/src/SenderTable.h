@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+// Таблица интернирования имён отправителей: каждое имя хранится один раз,
+// сообщения ссылаются на него по компактному идентификатору.
+// Пока имена не освобождаются, идентификаторы выдаются подряд с нуля.
+class SenderTable {
+public:
+    // Идентификатор, которого нет ни у одного имени
+    static constexpr quint32 kNoId = 0xffffffffu;
+
+    [[nodiscard]] quint32 intern(const QString &name);
+    [[nodiscard]] bool contains(const QString &name) const;
+    // Идентификатор имени или kNoId.
+    [[nodiscard]] quint32 idOf(const QString &name) const;
+    [[nodiscard]] const QString &name(quint32 id) const;
+    // Число выданных идентификаторов, включая освобождённые.
+    [[nodiscard]] qsizetype size() const;
+    // Забывает имя; идентификатор достанется следующему новому имени.
+    void release(quint32 id);
+    // Забывает все имена; ссылающиеся на таблицу записи должны быть удалены вместе с ней.
+    void clear();
+
+    // Сколько памяти занимает одно имя в таблице (строка, ключ и узел хэша).
+    [[nodiscard]] static qsizetype footprint(const QString &name);
+
+private:
+    QHash<QString, quint32> m_ids;
+    QList<QString> m_names;
+    QList<quint32> m_freeIds;
+};
@@ -0,0 +1,174 @@
+#include "SessionCapabilities.h"
+
+#include "ControlMessage.h"
+
+#include <QByteArray>
+#include <QStringList>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace {
+constexpr auto kCodecJson = "json";
+constexpr auto kCompressionDeflate = "deflate";
+constexpr auto kCompressionNone = "none";
+
+struct FeatureName {
+    SessionCapabilities::Feature feature;
+    const char *name;
+};
+
+constexpr std::array<FeatureName, 2> kFeatureNames = {{
+    {SessionCapabilities::HistoryBatch, "batch"},
+    {SessionCapabilities::HeaderCompression, "headers"},
+}};
+
+enum FieldIndex : qsizetype { VersionField, CodecsField, CompressionField, MaxFrameField, FeaturesField, FieldCount };
+
+QStringList splitList(const QString &value)
+{
+    return value.split(QLatin1Char(','), Qt::SkipEmptyParts);
+}
+
+QStringList featureNames(quint16 features)
+{
+    QStringList names;
+    for (const auto &entry : kFeatureNames) {
+        if (features & entry.feature) {
+            names.append(QLatin1String(entry.name));
+        }
+    }
+    return names;
+}
+
+quint16 parseFeatures(const QString &value)
+{
+    // Незнакомые имена пропускаем: их мог добавить более новый собеседник
+    quint16 features = 0;
+    for (const auto &name : splitList(value)) {
+        for (const auto &entry : kFeatureNames) {
+            if (name == QLatin1String(entry.name)) {
+                features |= entry.feature;
+            }
+        }
+    }
+    return features;
+}
+} // namespace
+
+SessionCapabilities SessionCapabilities::legacy()
+{
+    return SessionCapabilities();
+}
+
+SessionCapabilities SessionCapabilities::local(Compression compression, quint32 maxFrameSize, quint16 features)
+{
+    SessionCapabilities capabilities;
+    capabilities.m_version = kProtocolVersion;
+    capabilities.m_compression = compression;
+    capabilities.m_maxFrameSize = maxFrameSize;
+    capabilities.m_features = features;
+    return capabilities;
+}
+
+std::optional<SessionCapabilities> SessionCapabilities::negotiate(const SessionCapabilities &offer) const
+{
+    if (offer.m_version == 0 || offer.m_codecSupported == false) {
+        return std::nullopt;
+    }
+
+    SessionCapabilities result;
+    result.m_version = std::min(m_version, offer.m_version);
+    result.m_codec = Codec::Json;
+    result.m_compression = (m_compression == Compression::Deflate && offer.m_compression == Compression::Deflate)
+        ? Compression::Deflate
+        : Compression::None;
+    result.m_maxFrameSize = offer.m_maxFrameSize;
+    result.m_features = m_features & offer.m_features;
+    return result;
+}
+
+ControlMessage SessionCapabilities::toHello() const
+{
+    return ControlMessage::hello({
+        QString::number(m_version),
+        QLatin1String(kCodecJson),
+        m_compression == Compression::Deflate ? QLatin1String(kCompressionDeflate) : QString(),
+        QString::number(m_maxFrameSize),
+        featureNames(m_features).join(QLatin1Char(',')),
+    });
+}
+
+ControlMessage SessionCapabilities::toWelcome(quint32 serverMaxFrameSize) const
+{
+    return ControlMessage::welcome({
+        QString::number(m_version),
+        QLatin1String(kCodecJson),
+        QLatin1String(m_compression == Compression::Deflate ? kCompressionDeflate : kCompressionNone),
+        QString::number(serverMaxFrameSize),
+        featureNames(m_features).join(QLatin1Char(',')),
+    });
+}
+
+SessionCapabilities SessionCapabilities::fromControl(const ControlMessage &message)
+{
+    // Поля читаются по фиксированным индексам; дописанные новыми версиями в конец пропускаются
+    const QStringList &fields = message.fields();
+    if (fields.size() < FieldCount) {
+        throw std::runtime_error("Invalid handshake: missing fields");
+    }
+
+    bool versionOk = false;
+    bool frameOk = false;
+    const uint version = fields.at(VersionField).toUInt(&versionOk);
+    const uint maxFrameSize = fields.at(MaxFrameField).toUInt(&frameOk);
+    if (!versionOk || version == 0 || version > 0xff || !frameOk) {
+        throw std::runtime_error("Invalid handshake: bad version or frame size");
+    }
+
+    SessionCapabilities capabilities;
+    capabilities.m_version = quint8(version);
+    capabilities.m_maxFrameSize = maxFrameSize;
+    capabilities.m_codecSupported = splitList(fields.at(CodecsField)).contains(QLatin1String(kCodecJson));
+    capabilities.m_compression = splitList(fields.at(CompressionField)).contains(QLatin1String(kCompressionDeflate))
+        ? Compression::Deflate
+        : Compression::None;
+    capabilities.m_features = parseFeatures(fields.at(FeaturesField));
+    return capabilities;
+}
+
+bool SessionCapabilities::isLegacy() const
+{
+    return m_version == 0;
+}
+
+quint8 SessionCapabilities::version() const
+{
+    return m_version;
+}
+
+SessionCapabilities::Codec SessionCapabilities::codec() const
+{
+    return m_codec;
+}
+
+SessionCapabilities::Compression SessionCapabilities::compression() const
+{
+    return m_compression;
+}
+
+quint32 SessionCapabilities::maxFrameSize() const
+{
+    return m_maxFrameSize;
+}
+
+bool SessionCapabilities::has(Feature feature) const
+{
+    return (m_features & feature) != 0;
+}
+
+void SessionCapabilities::setCompression(Compression compression)
+{
+    m_compression = compression;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <optional>
+
+class ControlMessage;
+
+// Параметры сессии, которые клиент и сервер согласуют рукопожатием
+// HELLO/WELCOME до авторизации. В HELLO клиент перечисляет, что умеет,
+// в WELCOME сервер сообщает выбранное; дальше оба работают по результату.
+// Клиент, начавший сразу со входа, получает legacy(): версия 0, JSON без
+// сжатия и только кадры, понятные первым версиям клиента.
+//
+// Поля кадра: [версия, кодеки, сжатие, макс. размер кадра, возможности];
+// списки — имена через запятую, чтобы новые значения не ломали старый разбор.
+class SessionCapabilities {
+public:
+    static constexpr quint8 kProtocolVersion = 1;
+
+    enum class Codec : quint8 { Json };
+    enum class Compression : quint8 { None, Deflate };
+    enum Feature : quint16 {
+        HistoryBatch = 0x1,      // история пакетами (FrameType::HistoryBatch)
+        HeaderCompression = 0x2, // сжатые заголовки (FrameType::HeaderCompressed)
+    };
+
+    [[nodiscard]] static SessionCapabilities legacy();
+    // Что умеет эта сторона. maxFrameSize — сколько байт она готова принять одним кадром.
+    [[nodiscard]] static SessionCapabilities local(Compression compression, quint32 maxFrameSize, quint16 features);
+
+    // Сервер: общее подмножество своих возможностей и предложения клиента.
+    // В результате maxFrameSize — предел клиента (больше сервер ему не шлёт).
+    // std::nullopt — общей версии или кодека нет.
+    [[nodiscard]] std::optional<SessionCapabilities> negotiate(const SessionCapabilities &offer) const;
+
+    [[nodiscard]] ControlMessage toHello() const;
+    // В WELCOME сервер сообщает собственный предел кадра, а не предел клиента.
+    [[nodiscard]] ControlMessage toWelcome(quint32 serverMaxFrameSize) const;
+    // Разбирает HELLO или WELCOME. При ошибке бросает std::runtime_error.
+    [[nodiscard]] static SessionCapabilities fromControl(const ControlMessage &message);
+
+    [[nodiscard]] bool isLegacy() const;
+    [[nodiscard]] quint8 version() const;
+    [[nodiscard]] Codec codec() const;
+    [[nodiscard]] Compression compression() const;
+    // Сколько байт другая сторона принимает одним кадром; 0 — без ограничения.
+    [[nodiscard]] quint32 maxFrameSize() const;
+    [[nodiscard]] bool has(Feature feature) const;
+
+    void setCompression(Compression compression);
+
+private:
+    quint32 m_maxFrameSize = 0;
+    quint16 m_features = 0;
+    quint8 m_version = 0;
+    Codec m_codec = Codec::Json;
+    Compression m_compression = Compression::None;
+    // Кодек из предложения клиента, который этот сервер знает
+    bool m_codecSupported = true;
+};
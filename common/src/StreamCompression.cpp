@@ -0,0 +1,124 @@
+#include "StreamCompression.h"
+
+#include <QtGlobal>
+
+#include <zlib.h>
+
+namespace {
+// Окно 4 КиБ и уменьшенный memLevel держат состояние около 40 КиБ на соединение
+// вместо ~300 КиБ при настройках zlib по умолчанию.
+constexpr int kWindowBits = 12;
+constexpr int kMemLevel = 5;
+constexpr qsizetype kInflateChunk = 4096;
+
+// Общий словарь: типичные фрагменты кадров. Самые частые — ближе к концу.
+constexpr char kDictionary[] =
+    "USER_LIST:AUTH_FAIL: AUTH_OK--- История комнаты  сообщений) --- Конец истории ---"
+    "\"timestamp\":\"2026-01-01T00:00:00.000Z\"}\n"
+    "{\"sender\":\"SERVER\",\"text\":\"";
+} // namespace
+
+struct StreamCompression::Streams {
+    z_stream deflater{};
+    z_stream inflater{};
+    bool deflaterReady = false;
+    bool inflaterReady = false;
+};
+
+StreamCompression::StreamCompression(int level)
+    : d(std::make_unique<Streams>())
+{
+    const auto *dictionary = reinterpret_cast<const Bytef *>(kDictionary);
+    const auto dictionarySize = static_cast<uInt>(sizeof(kDictionary) - 1);
+
+    // Сырой deflate (отрицательное окно): без заголовков и контрольных сумм zlib
+    if (deflateInit2(&d->deflater, qBound(1, level, 9), Z_DEFLATED, -kWindowBits, kMemLevel, Z_DEFAULT_STRATEGY) == Z_OK) {
+        d->deflaterReady = deflateSetDictionary(&d->deflater, dictionary, dictionarySize) == Z_OK;
+    }
+    if (inflateInit2(&d->inflater, -kWindowBits) == Z_OK) {
+        d->inflaterReady = inflateSetDictionary(&d->inflater, dictionary, dictionarySize) == Z_OK;
+    }
+}
+
+StreamCompression::~StreamCompression()
+{
+    deflateEnd(&d->deflater);
+    inflateEnd(&d->inflater);
+}
+
+bool StreamCompression::isValid() const
+{
+    return d->deflaterReady && d->inflaterReady;
+}
+
+QByteArray StreamCompression::compress(const QByteArray &data)
+{
+    QByteArray output;
+    if (!d->deflaterReady) {
+        return output;
+    }
+
+    // deflateBound не учитывает маркер синхронного сброса — добавляем запас
+    output.resize(qsizetype(deflateBound(&d->deflater, uLong(data.size()))) + 16);
+    d->deflater.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    d->deflater.avail_in = uInt(data.size());
+
+    qsizetype produced = 0;
+    while (true) {
+        d->deflater.next_out = reinterpret_cast<Bytef *>(output.data() + produced);
+        d->deflater.avail_out = uInt(output.size() - produced);
+        const int result = deflate(&d->deflater, Z_SYNC_FLUSH);
+        produced = output.size() - d->deflater.avail_out;
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            return QByteArray();
+        }
+        if (d->deflater.avail_out != 0) {
+            break;
+        }
+        output.resize(output.size() * 2);
+    }
+    output.truncate(produced);
+    return output;
+}
+
+bool StreamCompression::decompress(const QByteArray &input, QByteArray &output)
+{
+    qsizetype offset = 0;
+    while (true) {
+        switch (inflateStep(input, offset, output, kInflateChunk)) {
+        case InflateResult::Progress:
+            break;
+        case InflateResult::Finished:
+            return true;
+        case InflateResult::Error:
+            return false;
+        }
+    }
+}
+
+StreamCompression::InflateResult StreamCompression::inflateStep(const QByteArray &input, qsizetype &offset,
+                                                                QByteArray &output, qsizetype maxOutput)
+{
+    Q_ASSERT(offset >= 0 && offset <= input.size() && maxOutput > 0);
+    if (!d->inflaterReady) {
+        return InflateResult::Error;
+    }
+
+    d->inflater.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.constData() + offset));
+    d->inflater.avail_in = uInt(input.size() - offset);
+
+    const qsizetype start = output.size();
+    output.resize(start + maxOutput);
+    d->inflater.next_out = reinterpret_cast<Bytef *>(output.data() + start);
+    d->inflater.avail_out = uInt(maxOutput);
+    const int result = inflate(&d->inflater, Z_SYNC_FLUSH);
+    offset = input.size() - d->inflater.avail_in;
+    output.truncate(output.size() - d->inflater.avail_out);
+
+    if (result != Z_OK && result != Z_BUF_ERROR) {
+        return InflateResult::Error;
+    }
+    // Место в output осталось — значит, распаковщику больше нечего выдать из этой порции
+    return d->inflater.avail_in == 0 && d->inflater.avail_out != 0 ? InflateResult::Finished
+                                                                     : InflateResult::Progress;
+}
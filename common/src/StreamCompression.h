@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QByteArray>
+
+#include <memory>
+
+// Потоковое сжатие deflate для одного соединения. Исходящие кадры сжимаются
+// с синхронным сбросом на границе каждого кадра (получатель может разобрать
+// кадр сразу, без ожидания следующих), входящие байты распаковываются.
+// Обе стороны используют общий словарь с типичными фрагментами протокола.
+class StreamCompression {
+public:
+    // level: 1 — быстрее, 9 — компактнее.
+    explicit StreamCompression(int level);
+    ~StreamCompression();
+
+    StreamCompression(const StreamCompression &) = delete;
+    StreamCompression &operator=(const StreamCompression &) = delete;
+
+    [[nodiscard]] bool isValid() const;
+
+    enum class InflateResult {
+        Progress, // выдано maxOutput байт, вход или распакованное ещё остались
+        Finished, // порция входа распакована целиком
+        Error,    // поток повреждён
+    };
+
+    [[nodiscard]] QByteArray compress(const QByteArray &data);
+    // Дописывает в output всю распаковку input. false — поток повреждён.
+    [[nodiscard]] bool decompress(const QByteArray &input, QByteArray &output);
+    // Один шаг распаковки: дописывает в output не больше maxOutput байт, начиная
+    // со входа input[offset] и сдвигая offset на прочитанное. Получатель обрабатывает
+    // каждый шаг сразу, поэтому маленький вход не раздувается в память целиком.
+    [[nodiscard]] InflateResult inflateStep(const QByteArray &input, qsizetype &offset, QByteArray &output,
+                                            qsizetype maxOutput);
+
+private:
+    struct Streams;
+    std::unique_ptr<Streams> d;
+};
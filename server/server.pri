@@ -0,0 +1,50 @@
+# Исходники сервера без main.cpp: общие для server.pro и тестов
+
+INCLUDEPATH += $$PWD/src \
+                $$PWD/../common/src
+
+HEADERS += \
+    $$PWD/src/Actor.h \
+    $$PWD/src/BlockLists.h \
+    $$PWD/src/ChatRoom.h \
+    $$PWD/src/ChatServer.h \
+    $$PWD/src/ClientConnection.h \
+    $$PWD/src/ClusterRelay.h \
+    $$PWD/src/HistorySegments.h \
+    $$PWD/src/IClusterSink.h \
+    $$PWD/src/IMessageSink.h \
+    $$PWD/src/IReplicaSink.h \
+    $$PWD/src/MailboxStore.h \
+    $$PWD/src/MessageHistory.h \
+    $$PWD/src/OutboundExecutor.h \
+    $$PWD/src/PeerLink.h \
+    $$PWD/src/PresenceDirectory.h \
+    $$PWD/src/ReplicaFeed.h \
+    $$PWD/src/SessionEncoder.h \
+    $$PWD/src/SlabPool.h \
+    $$PWD/src/StandbyReplica.h \
+    $$PWD/src/TextSanitizer.h \
+    $$PWD/src/UserStore.h \
+    $$PWD/src/WorkStealingPool.h
+
+SOURCES += \
+    $$PWD/src/Actor.cpp \
+    $$PWD/src/BlockLists.cpp \
+    $$PWD/src/ChatRoom.cpp \
+    $$PWD/src/ChatServer.cpp \
+    $$PWD/src/ClientConnection.cpp \
+    $$PWD/src/ClusterRelay.cpp \
+    $$PWD/src/HistorySegments.cpp \
+    $$PWD/src/MailboxStore.cpp \
+    $$PWD/src/MessageHistory.cpp \
+    $$PWD/src/OutboundExecutor.cpp \
+    $$PWD/src/PeerLink.cpp \
+    $$PWD/src/PresenceDirectory.cpp \
+    $$PWD/src/ReplicaFeed.cpp \
+    $$PWD/src/SessionEncoder.cpp \
+    $$PWD/src/StandbyReplica.cpp \
+    $$PWD/src/TextSanitizer.cpp \
+    $$PWD/src/UserStore.cpp \
+    $$PWD/src/WorkStealingPool.cpp
+
+DEPENDPATH += $$PWD/../common/src
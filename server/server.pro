@@ -5,21 +5,9 @@ QT += core network
 
 TARGET = KukarachaServer
 
-INCLUDEPATH += $$PWD/src \
-                $$PWD/../common/src
-
-HEADERS += \
-    src/ChatServer.h \
-    src/ClientConnection.h \
-    src/UserStore.h
+include(server.pri)
 
 SOURCES += \
-    src/main.cpp \
-    src/ChatServer.cpp \
-    src/ClientConnection.cpp \
-    src/UserStore.cpp
-
-LIBS += -L$$OUT_PWD/../common -lKukarachaCommon
-
-DEPENDPATH += $$PWD/../common/src
+    src/main.cpp
 
+LIBS += -L$$OUT_PWD/../common -lKukarachaCommon -lz
@@ -0,0 +1,60 @@
+#include "Actor.h"
+
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+Actor::Actor(WorkStealingPool *pool)
+    : m_pool(pool)
+{
+}
+
+void Actor::post(Task task)
+{
+    if (m_pool == nullptr) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_mailbox.push_back(std::move(task));
+        if (m_scheduled) {
+            return;
+        }
+        m_scheduled = true;
+    }
+    m_pool->submit([this]() { drain(); });
+}
+
+void Actor::drain()
+{
+    // m_running трогает только поток, выполняющий порцию: m_scheduled не даёт запустить вторую
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_mailbox.size() <= kBatchLimit) {
+            m_running.swap(m_mailbox);
+        } else {
+            const auto batchEnd = m_mailbox.begin() + std::ptrdiff_t(kBatchLimit);
+            m_running.assign(std::make_move_iterator(m_mailbox.begin()), std::make_move_iterator(batchEnd));
+            m_mailbox.erase(m_mailbox.begin(), batchEnd);
+        }
+    }
+
+    for (Task &task : m_running) {
+        task();
+    }
+    m_running.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_mailbox.empty()) {
+            m_scheduled = false;
+            return;
+        }
+    }
+    // Остаток — новой задачей пула, а не циклом здесь: длинный ящик не держит поток бесконечно
+    m_pool->submit([this]() { drain(); });
+}
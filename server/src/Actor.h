@@ -0,0 +1,39 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class WorkStealingPool;
+
+// Актор: почтовый ящик задач над состоянием, которым владеет только он.
+// Задачи выполняются строго по одной и в порядке постановки, но не
+// привязаны к потоку: очередную порцию ящика пул отдаёт любому свободному
+// потоку. Поэтому состоянию актора не нужны блокировки, а разные акторы
+// работают параллельно.
+class Actor {
+public:
+    using Task = std::function<void()>;
+
+    // Без пула задачи выполняются сразу в вызывающем потоке.
+    explicit Actor(WorkStealingPool *pool);
+
+    Actor(const Actor &) = delete;
+    Actor &operator=(const Actor &) = delete;
+
+    // Можно вызывать из любого потока.
+    void post(Task task);
+
+private:
+    // Сколько задач ящика выполняется за одну постановку в пул
+    static constexpr std::size_t kBatchLimit = 64;
+
+    void drain();
+
+    WorkStealingPool *m_pool;
+    std::mutex m_mutex;
+    std::vector<Task> m_mailbox;
+    std::vector<Task> m_running;
+    // Порция ящика уже стоит в пуле или выполняется
+    bool m_scheduled = false;
+};
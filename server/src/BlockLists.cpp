@@ -0,0 +1,215 @@
+#include "BlockLists.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+Q_LOGGING_CATEGORY(chatBlockLists, "kukaracha.server.blocks")
+} // namespace
+
+BlockLists::BlockLists(QString storagePath)
+    : m_storagePath(std::move(storagePath))
+{
+}
+
+bool BlockLists::load()
+{
+    QFile file(m_storagePath);
+    if (!file.exists()) {
+        return true;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(chatBlockLists) << "Не удалось открыть файл блокировок:" << file.errorString();
+        return false;
+    }
+
+    const auto doc = QJsonDocument::fromJson(file.readAll());
+    file.close();
+    if (!doc.isObject()) {
+        qCWarning(chatBlockLists) << "Файл блокировок повреждён";
+        return false;
+    }
+
+    // Формат: {"логин": ["кого он заблокировал", ...], ...}
+    const auto object = doc.object();
+    for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+        const quint32 user = intern(it.key());
+        std::vector<quint32> &list = m_lists[user];
+        for (const auto &value : it.value().toArray()) {
+            const QString target = value.toString();
+            if (target.isEmpty() || target == it.key() || qsizetype(list.size()) >= kMaxBlockedPerUser) {
+                continue;
+            }
+            list.push_back(intern(target));
+        }
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+        if (list.empty()) {
+            m_lists.remove(user);
+            continue;
+        }
+        for (const quint32 target : list) {
+            setMaskBit(target, user, true);
+        }
+    }
+    return true;
+}
+
+bool BlockLists::block(const QString &user, const QString &target)
+{
+    const quint32 userId = intern(user);
+    const quint32 targetId = intern(target);
+    std::vector<quint32> &list = m_lists[userId];
+    const auto it = std::lower_bound(list.begin(), list.end(), targetId);
+    if ((it != list.end() && *it == targetId) || qsizetype(list.size()) >= kMaxBlockedPerUser) {
+        if (list.empty()) {
+            m_lists.remove(userId);
+        }
+        return false;
+    }
+    list.insert(it, targetId);
+    setMaskBit(targetId, userId, true);
+    if (!save()) {
+        qCWarning(chatBlockLists) << "Блокировка" << target << "не сохранена на диск";
+    }
+    return true;
+}
+
+bool BlockLists::unblock(const QString &user, const QString &target)
+{
+    const quint32 userId = idOf(user);
+    const quint32 targetId = idOf(target);
+    const auto listIt = m_lists.find(userId);
+    if (userId == kNoId || targetId == kNoId || listIt == m_lists.end()) {
+        return false;
+    }
+    std::vector<quint32> &list = listIt.value();
+    const auto it = std::lower_bound(list.begin(), list.end(), targetId);
+    if (it == list.end() || *it != targetId) {
+        return false;
+    }
+    list.erase(it);
+    if (list.empty()) {
+        m_lists.erase(listIt);
+    }
+    setMaskBit(targetId, userId, false);
+    if (!save()) {
+        qCWarning(chatBlockLists) << "Снятие блокировки" << target << "не сохранено на диск";
+    }
+    return true;
+}
+
+qsizetype BlockLists::blockedCount(const QString &user) const
+{
+    const auto it = m_lists.constFind(idOf(user));
+    return it == m_lists.constEnd() ? 0 : qsizetype(it->size());
+}
+
+QStringList BlockLists::blockedBy(const QString &user) const
+{
+    QStringList names;
+    const auto it = m_lists.constFind(idOf(user));
+    if (it == m_lists.constEnd()) {
+        return names;
+    }
+    names.reserve(qsizetype(it->size()));
+    for (const quint32 target : *it) {
+        names.append(m_names.at(target));
+    }
+    names.sort(Qt::CaseInsensitive);
+    return names;
+}
+
+bool BlockLists::blocks(const QString &user, const QString &target) const
+{
+    const QBitArray *mask = blockersOf(target);
+    return mask != nullptr && isInMask(*mask, idOf(user));
+}
+
+const QBitArray *BlockLists::blockersOf(const QString &sender) const
+{
+    // Пока никто никого не блокировал, рассылка не платит даже за поиск
+    if (m_blockers.isEmpty()) {
+        return nullptr;
+    }
+    const auto it = m_blockers.constFind(idOf(sender));
+    return it == m_blockers.constEnd() ? nullptr : &it.value();
+}
+
+quint32 BlockLists::userId(const QString &user)
+{
+    return intern(user);
+}
+
+bool BlockLists::isInMask(const QBitArray &mask, quint32 userId)
+{
+    return qsizetype(userId) < mask.size() && mask.testBit(qsizetype(userId));
+}
+
+quint32 BlockLists::intern(const QString &name)
+{
+    const auto it = m_ids.constFind(name);
+    if (it != m_ids.constEnd()) {
+        return it.value();
+    }
+    const auto id = quint32(m_names.size());
+    m_ids.insert(name, id);
+    m_names.append(name);
+    return id;
+}
+
+quint32 BlockLists::idOf(const QString &name) const
+{
+    return m_ids.value(name, kNoId);
+}
+
+void BlockLists::setMaskBit(quint32 target, quint32 blocker, bool value)
+{
+    if (value) {
+        QBitArray &mask = m_blockers[target];
+        if (mask.size() <= qsizetype(blocker)) {
+            mask.resize(qsizetype(blocker) + 1);
+        }
+        mask.setBit(qsizetype(blocker));
+        return;
+    }
+
+    const auto it = m_blockers.find(target);
+    if (it == m_blockers.end() || it->size() <= qsizetype(blocker)) {
+        return;
+    }
+    it->clearBit(qsizetype(blocker));
+    if (it->count(true) == 0) {
+        m_blockers.erase(it);
+    }
+}
+
+bool BlockLists::save() const
+{
+    QJsonObject object;
+    for (auto it = m_lists.constBegin(); it != m_lists.constEnd(); ++it) {
+        QJsonArray targets;
+        for (const quint32 target : it.value()) {
+            targets.append(m_names.at(target));
+        }
+        object.insert(m_names.at(it.key()), targets);
+    }
+
+    QDir().mkpath(QFileInfo(m_storagePath).path());
+    QFile file(m_storagePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(chatBlockLists) << "Не удалось записать файл блокировок:" << file.errorString();
+        return false;
+    }
+    const auto bytesWritten = file.write(QJsonDocument(object).toJson(QJsonDocument::Indented));
+    file.close();
+    return bytesWritten != -1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QBitArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+#include <vector>
+
+// Списки блокировки пользователей (/block). Логины интернируются в плотные
+// номера: у каждого пользователя — отсортированный вектор номеров тех, кого он
+// заблокировал, а у заблокированного — битовая маска тех, кто его заблокировал.
+// Маска отвечает рассылке: сообщение отправителя, которого никто не
+// блокировал, обходится без проверок, иначе каждый получатель проверяется
+// одним битом по номеру, полученному при входе (userId). Списки хранятся в JSON-файле, как база пользователей.
+class BlockLists {
+public:
+    // Сколько пользователей может заблокировать один пользователь
+    static constexpr qsizetype kMaxBlockedPerUser = 1024;
+    // Номер, которого нет ни в одной маске
+    static constexpr quint32 kNoId = 0xffffffffu;
+
+    explicit BlockLists(QString storagePath);
+
+    [[nodiscard]] bool load();
+
+    // false — ничего не изменилось (уже заблокирован, лимит, не был заблокирован).
+    [[nodiscard]] bool block(const QString &user, const QString &target);
+    [[nodiscard]] bool unblock(const QString &user, const QString &target);
+    [[nodiscard]] qsizetype blockedCount(const QString &user) const;
+    [[nodiscard]] QStringList blockedBy(const QString &user) const;
+    [[nodiscard]] bool blocks(const QString &user, const QString &target) const;
+    // Номер пользователя; запрашивается один раз при входе и не меняется до остановки сервера.
+    [[nodiscard]] quint32 userId(const QString &user);
+
+    // Маска тех, кто заблокировал sender; nullptr — никто, рассылка без проверок.
+    [[nodiscard]] const QBitArray *blockersOf(const QString &sender) const;
+    [[nodiscard]] static bool isInMask(const QBitArray &mask, quint32 userId);
+
+private:
+    quint32 intern(const QString &name);
+    [[nodiscard]] quint32 idOf(const QString &name) const;
+    void setMaskBit(quint32 target, quint32 blocker, bool value);
+    [[nodiscard]] bool save() const;
+
+    QString m_storagePath;
+    QHash<QString, quint32> m_ids;
+    QStringList m_names;
+    // Кто кого заблокировал: номер → отсортированные номера
+    QHash<quint32, std::vector<quint32>> m_lists;
+    // Кем заблокирован: номер → маска номеров; пустые маски не хранятся
+    QHash<quint32, QBitArray> m_blockers;
+};
@@ -0,0 +1,205 @@
+#include "ChatRoom.h"
+
+#include <QRegularExpression>
+#include <iterator>
+#include <utility>
+
+const QString ChatRoom::kDefaultName = QStringLiteral("general");
+
+ChatRoom::ChatRoom(QString name, qsizetype maxBytes, qsizetype maxMessages, QString segmentDirectory)
+    : m_name(std::move(name))
+    , m_history(maxBytes, maxMessages, std::move(segmentDirectory))
+{
+}
+
+QString ChatRoom::normalizedName(QStringView name)
+{
+    // Имя становится именем каталога истории и полем строк кластера: только буквы, цифры, '_' и '-'
+    static const QRegularExpression pattern(QStringLiteral("^[\\w-]{1,%1}$").arg(kMaxNameLength),
+                                            QRegularExpression::UseUnicodePropertiesOption);
+    const QString lowered = name.trimmed().toString().toLower();
+    return pattern.match(lowered).hasMatch() ? lowered : QString();
+}
+
+const QString &ChatRoom::name() const
+{
+    return m_name;
+}
+
+MessageHistory &ChatRoom::history()
+{
+    return m_history;
+}
+
+const MessageHistory &ChatRoom::history() const
+{
+    return m_history;
+}
+
+const std::vector<ClientConnection *> &ChatRoom::members() const
+{
+    return m_members;
+}
+
+qsizetype ChatRoom::addMember(ClientConnection *client)
+{
+    m_members.push_back(client);
+    return qsizetype(m_members.size()) - 1;
+}
+
+ClientConnection *ChatRoom::removeMember(qsizetype slot)
+{
+    Q_ASSERT(slot >= 0 && std::size_t(slot) < m_members.size());
+    ClientConnection *moved = m_members.back();
+    m_members.pop_back();
+    if (std::size_t(slot) == m_members.size()) {
+        return nullptr;
+    }
+    m_members[std::size_t(slot)] = moved;
+    return moved;
+}
+
+void ChatRoom::markTyping(const QString &user, qint64 nowMs)
+{
+    auto it = m_typing.find(user);
+    if (it == m_typing.end()) {
+        m_typing.insert(user, nowMs);
+        m_typingChanged = true;
+        return;
+    }
+    it.value() = nowMs;
+}
+
+void ChatRoom::clearTyping(const QString &user)
+{
+    if (m_typing.remove(user) > 0) {
+        m_typingChanged = true;
+    }
+}
+
+void ChatRoom::expireTyping(qint64 nowMs, qint64 timeoutMs)
+{
+    for (auto it = m_typing.begin(); it != m_typing.end();) {
+        if (nowMs - it.value() > timeoutMs) {
+            it = m_typing.erase(it);
+            m_typingChanged = true;
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool ChatRoom::hasTyping() const
+{
+    return !m_typing.isEmpty();
+}
+
+QStringList ChatRoom::typingUsers() const
+{
+    QStringList users = m_typing.keys();
+    users.sort(Qt::CaseInsensitive);
+    return users;
+}
+
+bool ChatRoom::typingChanged() const
+{
+    return m_typingChanged;
+}
+
+bool ChatRoom::takeTypingChanged()
+{
+    return std::exchange(m_typingChanged, false);
+}
+
+quint64 ChatRoom::findMessage(const QString &author, qint64 timestampMs) const
+{
+    return m_history.findMessage(author, timestampMs);
+}
+
+bool ChatRoom::toggleReaction(quint64 seq, const QString &reaction, const QString &user)
+{
+    Reactions &reactions = m_reactions[seq];
+    auto it = reactions.users.find(reaction);
+    if (it == reactions.users.end()) {
+        if (reactions.users.size() >= kMaxReactionKinds) {
+            if (reactions.users.isEmpty()) {
+                m_reactions.remove(seq);
+            }
+            return false;
+        }
+        it = reactions.users.insert(reaction, {});
+    }
+
+    if (it->remove(user) == false) {
+        it->insert(user);
+    } else if (it->isEmpty()) {
+        reactions.users.erase(it);
+    }
+    reactions.changed.insert(reaction);
+    m_changedReactions.insert(seq);
+    return true;
+}
+
+bool ChatRoom::hasReactionChanges() const
+{
+    return !m_changedReactions.isEmpty();
+}
+
+QList<ControlMessage> ChatRoom::takeReactionDeltas()
+{
+    QList<ControlMessage> frames;
+    const quint64 firstSeq = m_history.firstSeq();
+    for (const quint64 seq : std::as_const(m_changedReactions)) {
+        const auto it = m_reactions.find(seq);
+        if (it == m_reactions.end()) {
+            continue;
+        }
+        if (seq < firstSeq) {
+            m_reactions.erase(it);
+            continue;
+        }
+
+        QList<std::pair<QString, int>> counts;
+        counts.reserve(it->changed.size());
+        for (const QString &reaction : std::as_const(it->changed)) {
+            counts.append({reaction, int(it->users.value(reaction).size())});
+        }
+        it->changed.clear();
+        frames.append(reactionFrame(seq, counts));
+        if (it->users.isEmpty()) {
+            m_reactions.erase(it);
+        }
+    }
+    m_changedReactions.clear();
+
+    // Реакции на вытесненные сообщения больше никому не покажут
+    for (auto it = m_reactions.begin(); it != m_reactions.end();) {
+        it = it.key() < firstSeq ? m_reactions.erase(it) : std::next(it);
+    }
+    return frames;
+}
+
+QList<ControlMessage> ChatRoom::reactionSnapshot() const
+{
+    QList<ControlMessage> frames;
+    const quint64 firstSeq = m_history.firstSeq();
+    for (auto it = m_reactions.cbegin(); it != m_reactions.cend(); ++it) {
+        if (it.key() < firstSeq || it->users.isEmpty()) {
+            continue;
+        }
+        QList<std::pair<QString, int>> counts;
+        counts.reserve(it->users.size());
+        for (auto user = it->users.cbegin(); user != it->users.cend(); ++user) {
+            counts.append({user.key(), int(user->size())});
+        }
+        frames.append(reactionFrame(it.key(), counts));
+    }
+    return frames;
+}
+
+ControlMessage ChatRoom::reactionFrame(quint64 seq, const QList<std::pair<QString, int>> &counts) const
+{
+    const MessageHistory::Entry &entry = m_history.entry(seq);
+    return ControlMessage::reactions(m_history.senders().name(entry.message.senderId()), entry.message.timestampMs(),
+                                     counts);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ControlMessage.h"
+#include "MessageHistory.h"
+
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+#include <vector>
+
+class ClientConnection;
+
+// Комната чата: свои подписчики и своя история. Подписчики лежат плотным
+// вектором, поэтому рассылка — проход по участникам комнаты, а не по всему
+// серверу. Место подписчика в векторе хранит ChatServer: выход из комнаты
+// переставляет последнего на освободившееся место и занимает O(1).
+class ChatRoom {
+public:
+    // Имя комнаты по умолчанию; её история лежит прямо в каталоге истории.
+    static const QString kDefaultName;
+    static constexpr qsizetype kMaxNameLength = 32;
+
+    ChatRoom(QString name, qsizetype maxBytes, qsizetype maxMessages, QString segmentDirectory);
+
+    // Имя, приведённое к нижнему регистру, или пустая строка, если оно недопустимо.
+    [[nodiscard]] static QString normalizedName(QStringView name);
+
+    [[nodiscard]] const QString &name() const;
+    [[nodiscard]] MessageHistory &history();
+    [[nodiscard]] const MessageHistory &history() const;
+
+    [[nodiscard]] const std::vector<ClientConnection *> &members() const;
+    // Возвращает место нового подписчика.
+    qsizetype addMember(ClientConnection *client);
+    // Освобождает место slot. Возвращает подписчика, переставленного на него, или nullptr.
+    ClientConnection *removeMember(qsizetype slot);
+
+    // Кто сейчас набирает сообщение. Живёт только в памяти: не сохраняется,
+    // не пишется в лог и не реплицируется. Повторный сигнал лишь продлевает
+    // срок, список меняется только при появлении или уходе пользователя.
+    void markTyping(const QString &user, qint64 nowMs);
+    void clearTyping(const QString &user);
+    // Убирает тех, от кого не было сигнала дольше timeoutMs.
+    void expireTyping(qint64 nowMs, qint64 timeoutMs);
+    [[nodiscard]] bool hasTyping() const;
+    [[nodiscard]] QStringList typingUsers() const;
+    // Менялся ли список с прошлой рассылки; take — со сбросом.
+    [[nodiscard]] bool typingChanged() const;
+    [[nodiscard]] bool takeTypingChanged();
+
+    // Реакции на сообщения истории, по номеру записи. Изменения копятся и уходят
+    // одним кадром на сообщение за интервал, сколько бы щелчков ни было.
+    static constexpr qsizetype kMaxReactionKinds = 16;
+    // Номер записи сообщения author/timestampMs или 0, если его уже нет в истории (см. MessageHistory::findMessage).
+    [[nodiscard]] quint64 findMessage(const QString &author, qint64 timestampMs) const;
+    // Ставит реакцию пользователя или снимает уже поставленную; false — лимит видов реакций.
+    bool toggleReaction(quint64 seq, const QString &reaction, const QString &user);
+    [[nodiscard]] bool hasReactionChanges() const;
+    // Новые значения изменившихся счётчиков, по кадру на сообщение; забывает реакции вытесненных сообщений.
+    [[nodiscard]] QList<ControlMessage> takeReactionDeltas();
+    // Все ненулевые счётчики — для того, кто входит в комнату.
+    [[nodiscard]] QList<ControlMessage> reactionSnapshot() const;
+
+private:
+    struct Reactions {
+        // Реакция → кто её поставил; пустые множества не хранятся
+        QHash<QString, QSet<QString>> users;
+        QSet<QString> changed;
+    };
+
+    [[nodiscard]] ControlMessage reactionFrame(quint64 seq, const QList<std::pair<QString, int>> &counts) const;
+
+    QString m_name;
+    std::vector<ClientConnection *> m_members;
+    MessageHistory m_history;
+    // Имя → время последнего сигнала, мс
+    QHash<QString, qint64> m_typing;
+    bool m_typingChanged = false;
+    QHash<quint64, Reactions> m_reactions;
+    QSet<quint64> m_changedReactions;
+};
@@ -1,23 +1,35 @@
 #include "ChatServer.h"
 
 #include "ChatMessage.h"
+#include "ChatRoom.h"
 #include "ClientConnection.h"
+#include "MessageHistory.h"
+#include "PresenceDirectory.h"
 #include "JsonMessageSerializer.h"
+#include "TextSanitizer.h"
 
 #include <QCoreApplication>
 #include <QHostAddress>
+#include <QHostInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QPointer>
+#include <QThread>
+#include <QTimer>
 #include <QLoggingCategory>
-#include <QTcpSocket>
 #include <QtGlobal>
-#include <QFile>
-#include <QTextStream>
 #include <QDir>
 #include <QDateTime>
 
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <optional>
+#include <utility>
 
 Q_LOGGING_CATEGORY(chatServerCore, "kukaracha.server.core")
+// Текст каждого сообщения пишется только при явном включении категории
+Q_LOGGING_CATEGORY(chatServerMessages, "kukaracha.server.messages", QtWarningMsg)
 
 namespace {
 bool parseAllowRegistration()
@@ -30,14 +42,170 @@ bool parseAllowRegistration()
     return false;
 }
 
+bool parseFlagSetting(const char *name, bool defaultValue)
+{
+    if (qEnvironmentVariableIsSet(name) == false) {
+        return defaultValue;
+    }
+    return qEnvironmentVariableIntValue(name) != 0;
+}
+
+qsizetype parseSizeSetting(const char *name, qsizetype defaultValue)
+{
+    if (qEnvironmentVariableIsSet(name) == false) {
+        return defaultValue;
+    }
+    bool ok = false;
+    const qsizetype value = qEnvironmentVariable(name).toLongLong(&ok);
+    if (ok == false || value <= 0) {
+        qCWarning(chatServerCore) << "Некорректное значение" << name << "- используется" << defaultValue;
+        return defaultValue;
+    }
+    return value;
+}
+
+int parseLevelSetting(const char *name, int defaultValue, int minValue, int maxValue)
+{
+    if (qEnvironmentVariableIsSet(name) == false) {
+        return defaultValue;
+    }
+    bool ok = false;
+    const int value = qEnvironmentVariable(name).toInt(&ok);
+    if (ok == false || value < minValue || value > maxValue) {
+        qCWarning(chatServerCore) << "Некорректное значение" << name << "- используется" << defaultValue;
+        return defaultValue;
+    }
+    return value;
+}
+
+bool parseHostPort(const QString &text, QString &host, quint16 &port)
+{
+    const auto trimmed = text.trimmed();
+    const auto colon = trimmed.lastIndexOf(QLatin1Char(':'));
+    bool ok = false;
+    port = colon > 0 ? trimmed.sliced(colon + 1).toUShort(&ok) : 0;
+    if (ok == false || port == 0) {
+        return false;
+    }
+    host = trimmed.first(colon);
+    return true;
+}
+
+// Резерв на той же машине пишет историю в свой каталог, чтобы не делить сегменты с основным
+QString historyDirectory()
+{
+    const QString fallback = QCoreApplication::applicationDirPath()
+        + (qEnvironmentVariableIsSet("KUKARACHA_STANDBY_OF") ? "/history-standby" : "/history");
+    return qEnvironmentVariable("KUKARACHA_HISTORY_DIR", fallback);
+}
+
+// История комнаты по умолчанию лежит прямо в каталоге истории, как до появления комнат
+QString roomDirectory(const QString &room)
+{
+    if (room == ChatRoom::kDefaultName) {
+        return historyDirectory();
+    }
+    return historyDirectory() + QStringLiteral("/rooms/") + room;
+}
+
+ClusterRelay::Config parseClusterConfig(quint16 clientPort)
+{
+    ClusterRelay::Config config;
+    config.listenPort = quint16(parseLevelSetting("KUKARACHA_CLUSTER_PORT", 0, 0, 65535));
+    // Имя узла входит в каждую строку протокола между узлами и не содержит пробелов
+    config.nodeId = qEnvironmentVariable("KUKARACHA_NODE_ID",
+                                         QStringLiteral("%1:%2").arg(QHostInfo::localHostName()).arg(clientPort))
+                        .simplified()
+                        .replace(QLatin1Char(' '), QLatin1Char('_'));
+    config.secret = qEnvironmentVariable("KUKARACHA_CLUSTER_SECRET").toUtf8();
+
+    const auto peers = qEnvironmentVariable("KUKARACHA_CLUSTER_PEERS").split(QLatin1Char(','), Qt::SkipEmptyParts);
+    for (const auto &entry : peers) {
+        ClusterRelay::Peer peer;
+        if (parseHostPort(entry, peer.host, peer.port) == false) {
+            qCWarning(chatServerCore) << "Некорректный адрес соседа в KUKARACHA_CLUSTER_PEERS:" << entry;
+            continue;
+        }
+        config.peers.append(peer);
+    }
+    return config;
+}
+
+// Команда администратора для других узлов: ["kick"|"ban"|"unban", логин]
+QByteArray encodeAdminCommand(const QString &action, const QString &target)
+{
+    return QJsonDocument(QJsonArray{action, target}).toJson(QJsonDocument::Compact);
+}
+
 const QString kAdminUser = QStringLiteral("admin");
+constexpr qsizetype kDefaultHistoryBytes = 4 * 1024 * 1024;
+constexpr qsizetype kDefaultHistoryMessages = 1000;
+constexpr int kDefaultCompressionLevel = 6;
+constexpr int kDefaultMaxRooms = 32;
+constexpr qsizetype kDefaultMailboxBytes = 256 * 1024;
+constexpr qsizetype kDefaultFailoverTimeoutMs = 3000;
+// Пауза между попытками занять порт клиентов после повышения резерва
+constexpr int kTakeOverRetryMs = 1000;
+// Порог заполнения буфера сокета, ниже которого дописывается следующая порция истории
+constexpr qint64 kReplayLowWatermark = 64 * 1024;
+constexpr qint64 kReplayChunkBytes = 64 * 1024;
+// Такт рассылки отметок о наборе текста: не больше одного кадра на комнату за такт
+constexpr int kTypingTickMs = 1000;
+// Отметка гаснет, если клиент не подтвердил её за это время
+constexpr qint64 kTypingTimeoutMs = 5000;
+// Отметки эфемерны и отбрасываются первыми: клиенту с заполненным буфером сокета не шлём
+constexpr qint64 kTypingBackpressureBytes = 16 * 1024;
+// Интервал рассылки счётчиков реакций: щелчки за интервал сливаются в один кадр на сообщение
+constexpr int kReactionFlushMs = 500;
+// Узел повторяет свою запись каталога присутствия с этим интервалом; запись другого
+// узла, не подтверждённая за kPresenceExpiryMs, считается потерянной
+constexpr int kPresenceRefreshMs = 5000;
+constexpr qint64 kPresenceExpiryMs = 3 * kPresenceRefreshMs;
+// Реакция — один эмодзи или короткое слово, не текст сообщения
+constexpr qsizetype kMaxReactionLength = 16;
 } // namespace
 
 ChatServer::ChatServer(QObject *parent)
     : QTcpServer(parent)
     , m_userStore(QCoreApplication::applicationDirPath() + "/users.json")
+    , m_mailboxes(historyDirectory() + QStringLiteral("/mailboxes"),
+                  parseSizeSetting("KUKARACHA_MAILBOX_MAX_BYTES", kDefaultMailboxBytes))
+    , m_blocks(QCoreApplication::applicationDirPath() + "/blocks.json")
     , m_allowRegistration(parseAllowRegistration())
+    , m_historyMaxBytes(parseSizeSetting("KUKARACHA_HISTORY_MAX_BYTES", kDefaultHistoryBytes))
+    , m_historyMaxMessages(parseSizeSetting("KUKARACHA_HISTORY_MAX_MESSAGES", kDefaultHistoryMessages))
+    , m_maxRooms(parseLevelSetting("KUKARACHA_MAX_ROOMS", kDefaultMaxRooms, 1, 1024))
+    , m_batchHistory(parseFlagSetting("KUKARACHA_HISTORY_BATCH", true))
+    , m_cluster(this)
+    , m_standby(this)
 {
+    ClientConnection::setCompressionLevel(
+        parseLevelSetting("KUKARACHA_COMPRESSION_LEVEL", kDefaultCompressionLevel, 0, 9));
+    
+    // Что сервер предлагает клиентам в рукопожатии
+    quint16 features = SessionCapabilities::HeaderCompression;
+    if (m_batchHistory) {
+        features |= SessionCapabilities::HistoryBatch;
+    }
+    m_capabilities = SessionCapabilities::local(ClientConnection::compressionLevel() > 0
+                                                    ? SessionCapabilities::Compression::Deflate
+                                                    : SessionCapabilities::Compression::None,
+                                                quint32(ClientConnection::kMaxInboundFrameSize), features);
+    
+    // Кодирование исходящих кадров в рабочих потоках окупается только при сжатии,
+    // поэтому без него по умолчанию всё кодируется в главном потоке
+    m_outbound.start(parseLevelSetting("KUKARACHA_ENCODER_THREADS",
+                                       ClientConnection::compressionLevel() > 0 ? QThread::idealThreadCount() : 0,
+                                       0, 256));
+    ClientConnection::setOutboundExecutor(&m_outbound);
+
+    m_typingTimer.setInterval(kTypingTickMs);
+    connect(&m_typingTimer, &QTimer::timeout, this, &ChatServer::flushTyping);
+    m_reactionTimer.setInterval(kReactionFlushMs);
+    m_reactionTimer.setSingleShot(true);
+    connect(&m_reactionTimer, &QTimer::timeout, this, &ChatServer::flushReactions);
+    m_presenceTimer.setInterval(kPresenceRefreshMs);
+    connect(&m_presenceTimer, &QTimer::timeout, this, &ChatServer::refreshPresence);
     
     // Загружаем пользователей
     bool loaded = m_userStore.load();
@@ -55,237 +223,1079 @@ ChatServer::ChatServer(QObject *parent)
     QDateTime currentTime = QDateTime::currentDateTime();
     QString sessionStartTime = currentTime.toString("yyyy-MM-dd_hh-mm-ss");
     m_logFilePath = logsDir + "/session_" + sessionStartTime + ".log";
+    m_logFile.setFileName(m_logFilePath);
+    if (m_logFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text | QIODevice::Unbuffered) == false) {
+        qCWarning(chatServerCore) << "Не удалось открыть файл лога для записи:" << m_logFilePath;
+    }
     
     qCInfo(chatServerCore) << "Логи сессии будут сохраняться в:" << m_logFilePath;
+    // Поднимаем комнаты и их историю прошлых запусков из сегментов на диске
+    loadRooms();
+    if (m_blocks.load() == false) {
+        qCWarning(chatServerCore) << "Не удалось загрузить списки блокировок";
+    }
+    if (m_mailboxes.open() == false) {
+        qCWarning(chatServerCore) << "Почтовые ящики недоступны, личные сообщения доставляются только в сети";
+    }
+    qCInfo(chatServerCore) << "Уровень сжатия трафика:" << ClientConnection::compressionLevel();
+    qCInfo(chatServerCore) << "Потоков кодирования исходящих кадров:" << m_outbound.threadCount();
+    qCInfo(chatServerCore) << "Лимит истории каждой комнаты:" << m_historyMaxBytes << "байт,"
+                           << m_historyMaxMessages << "сообщений";
+}
+
+void ChatServer::loadRooms()
+{
+    findOrCreateRoom(ChatRoom::kDefaultName);
+
+    const QDir roomsDir(historyDirectory() + QStringLiteral("/rooms"));
+    const auto names = roomsDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+    for (const QString &entry : names) {
+        const QString name = ChatRoom::normalizedName(entry);
+        if (name.isEmpty() || name != entry) {
+            continue;
+        }
+        if (qsizetype(m_rooms.size()) >= m_maxRooms) {
+            qCWarning(chatServerCore) << "Превышен лимит комнат, история комнаты" << name << "не загружена";
+            continue;
+        }
+        findOrCreateRoom(name);
+    }
+    qCInfo(chatServerCore) << "Комнат:" << m_rooms.size();
+}
+
+ChatRoom &ChatServer::defaultRoom() const
+{
+    return *m_rooms.front();
+}
+
+ChatRoom &ChatServer::findOrCreateRoom(const QString &name)
+{
+    if (ChatRoom *room = m_roomsByName.value(name)) {
+        return *room;
+    }
+
+    auto room = std::make_unique<ChatRoom>(name, m_historyMaxBytes, m_historyMaxMessages, roomDirectory(name));
+    if (room->history().openSegments(JsonMessageSerializer{}) == false) {
+        qCWarning(chatServerCore) << "История комнаты" << name << "будет храниться только в памяти";
+    }
+    ChatRoom &created = *room;
+    m_rooms.push_back(std::move(room));
+    m_roomsByName.insert(name, &created);
+    m_replicaFeed.addHistory(name, created.history());
+    return created;
+}
+
+ChatRoom *ChatServer::findOrCreateRemoteRoom(const QString &name)
+{
+    if (ChatRoom *room = m_roomsByName.value(name)) {
+        return room;
+    }
+    // Комнаты живут до остановки сервера, поэтому соседний узел не должен заводить их без счёта
+    if (qsizetype(m_rooms.size()) >= m_maxRooms) {
+        if (m_remoteRoomLimitWarned == false) {
+            m_remoteRoomLimitWarned = true;
+            qCWarning(chatServerCore) << "Превышен лимит комнат, сообщения для новой комнаты" << name
+                                      << "и следующих отбрасываются";
+        } else {
+            qCDebug(chatServerCore) << "Сообщение для комнаты" << name << "отброшено: лимит комнат";
+        }
+        return nullptr;
+    }
+    return &findOrCreateRoom(name);
+}
+
+ChatRoom *ChatServer::roomOf(ClientConnection *client) const
+{
+    return m_memberships.value(client).room;
+}
+
+void ChatServer::joinRoom(ClientConnection *client, ChatRoom &room)
+{
+    ChatRoom *previous = roomOf(client);
+    if (previous == &room) {
+        return;
+    }
+    if (previous != nullptr) {
+        leaveRoom(client);
+        broadcastSystemMessage(*previous, tr("%1 вышел из комнаты").arg(client->userName()));
+    }
+
+    const qsizetype slot = room.addMember(client);
+    m_memberships.insert(client, Membership{&room, slot});
+
+    // Недосланная история прежней комнаты больше не нужна
+    if (m_historyReplays.remove(client)) {
+        client->setDrainNotification(false);
+    }
+    if (client->usesControlFrames()) {
+        client->sendControl(ControlMessage::room(room.name()));
+        if (room.hasTyping()) {
+            client->sendControl(ControlMessage::typing(room.typingUsers()));
+        }
+    }
+    sendMessageHistory(client, room);
+}
+
+void ChatServer::leaveRoom(ClientConnection *client)
+{
+    const auto it = m_memberships.constFind(client);
+    if (it == m_memberships.cend()) {
+        return;
+    }
+    const Membership membership = it.value();
+    m_memberships.erase(it);
+    if (client->hasUserName()) {
+        membership.room->clearTyping(client->userName());
+        scheduleTyping(*membership.room);
+    }
+
+    // Последний подписчик переехал на освободившееся место
+    if (ClientConnection *moved = membership.room->removeMember(membership.slot)) {
+        m_memberships[moved].slot = membership.slot;
+    }
+}
+
+bool ChatServer::start(quint16 port)
+{
+    m_port = port;
+
+    // Резерв не слушает порт клиентов, пока основной сервер жив
+    const auto primary = qEnvironmentVariable("KUKARACHA_STANDBY_OF");
+    if (!primary.isEmpty()) {
+        QString host;
+        quint16 replicationPort = 0;
+        if (parseHostPort(primary, host, replicationPort) == false) {
+            const auto errorMessage = tr("Некорректный адрес основного сервера: %1").arg(primary);
+            emit serverError(errorMessage);
+            qCCritical(chatServerCore) << errorMessage;
+            return false;
+        }
+        m_standby.start(host, replicationPort,
+                        int(parseSizeSetting("KUKARACHA_FAILOVER_TIMEOUT_MS", kDefaultFailoverTimeoutMs)));
+        return true;
+    }
+
+    if (!listen(QHostAddress::Any, port)) {
+        const auto errorMessage = tr("Не удалось запустить сервер: %1").arg(errorString());
+        emit serverError(errorMessage);
+        qCCritical(chatServerCore) << errorMessage;
+        return false;
+    }
+
+    return startServices();
+}
+
+bool ChatServer::startServices()
+{
+    qCInfo(chatServerCore) << "Сервер запущен на порту" << serverPort();
+
+    // Кластер включается портом для соседей или списком соседей
+    ClusterRelay::Config cluster = parseClusterConfig(serverPort());
+    m_presence.reset(cluster.nodeId, quint64(QDateTime::currentMSecsSinceEpoch()));
+    if (cluster.listenPort != 0 || !cluster.peers.isEmpty()) {
+        if (!m_cluster.start(std::move(cluster))) {
+            const auto errorMessage = tr("Не удалось открыть порт для узлов кластера: %1").arg(m_cluster.errorString());
+            emit serverError(errorMessage);
+            qCCritical(chatServerCore) << errorMessage;
+            close();
+            return false;
+        }
+        m_presenceTimer.start();
+    }
+
+    // Поток для резервного сервера: история, новые сообщения и бан-лист
+    const int replicationPort = parseLevelSetting("KUKARACHA_REPLICATION_PORT", 0, 0, 65535);
+    if (replicationPort != 0) {
+        if (!m_replicaFeed.start(quint16(replicationPort))) {
+            const auto errorMessage = tr("Не удалось открыть порт репликации: %1").arg(m_replicaFeed.errorString());
+            emit serverError(errorMessage);
+            qCCritical(chatServerCore) << errorMessage;
+            m_cluster.stop();
+            close();
+            return false;
+        }
+        m_replicaFeed.publishBans(m_bannedUsers);
+    }
+    return true;
+}
+
+qsizetype ChatServer::historyBytes() const
+{
+    qsizetype total = 0;
+    for (const auto &room : m_rooms) {
+        total += room->history().bytesUsed();
+    }
+    return total;
+}
+
+void ChatServer::stop()
+{
+    // Закрываем сервер
+    close();
+    m_presenceTimer.stop();
+    m_cluster.stop();
+    m_replicaFeed.stop();
+    m_standby.stop();
+    // Дожидаемся кадров, которые ещё кодируются в рабочих потоках
+    m_outbound.stop();
+    
+    // Удаляем всех клиентов
+    for (ClientConnection *client : m_clients) {
+        if (client) {
+            leaveRoom(client);
+            client->deleteLater();
+        }
+    }
+    
+    // Очищаем списки
+    m_clients.clear();
+    m_clientsByName.clear();
+    m_historyReplays.clear();
+    
+    qCInfo(chatServerCore) << "Сервер остановлен";
+}
+
+void ChatServer::incomingConnection(qintptr socketDescriptor)
+{
+    // Расход кучи на соединение меряется вокруг создания и привязки сокета:
+    // sizeof не видит приватных данных QTcpSocket, а они и есть основная часть
+    const qint64 heapBefore = ClientConnection::heapBytesInUse();
+
+    // Создаем объект соединения; сокет встроен в него и выделяется вместе с ним из пула
+    ClientConnection *connection = new ClientConnection(this, this);
+    
+    // Устанавливаем дескриптор сокета
+    bool ok = connection->setSocketDescriptor(socketDescriptor);
+    if (ok == false) {
+        qCWarning(chatServerCore) << "Не удалось принять подключение:" << connection->errorString();
+        delete connection;
+        return;
+    }
+    
+    // Сообщения приходят напрямую через IMessageSink, сигнал остаётся только для закрытия
+    connect(connection, &ClientConnection::connectionClosed, this, &ChatServer::onConnectionClosed);
+
+    // Добавляем в список клиентов
+    m_clients.push_back(connection);
+
+    qCInfo(chatServerCore) << "Новый клиент:" << connection->peerAddress().toString();
+    qCDebug(chatServerCore) << "Пул соединений:" << ClientConnection::pooledConnections() << "активных,"
+                            << ClientConnection::pooledBytes() << "байт зарезервировано";
+
+    // Слоты пула выделяются блоками, поэтому вклад отдельного подключения шумит; смотрим на среднее.
+    // Рабочие потоки кодирования тоже берут память, так что это оценка сверху.
+    const qint64 heapAfter = ClientConnection::heapBytesInUse();
+    if (heapBefore >= 0 && heapAfter >= heapBefore) {
+        m_idleHeapBytes += heapAfter - heapBefore;
+        ++m_idleHeapSamples;
+        const qint64 average = m_idleHeapBytes / m_idleHeapSamples;
+        qCDebug(chatServerCore) << "Куча на простаивающее соединение:" << heapAfter - heapBefore
+                                << "байт, в среднем" << average;
+        if (average > ClientConnection::kIdleHeapBudget && m_idleHeapWarned == false) {
+            m_idleHeapWarned = true;
+            qCWarning(chatServerCore) << "Простаивающее соединение занимает в среднем" << average
+                                      << "байт кучи, бюджет" << ClientConnection::kIdleHeapBudget;
+        }
+    }
+}
+
+void ChatServer::onMessageReceived(ChatMessage &&message, ClientConnection *sender)
+{
+    // Проверяем, что отправитель существует
+    if (sender == nullptr) {
+        qCWarning(chatServerCore) << "Получено сообщение, но отправитель неизвестен";
+        return;
+    }
+
+    // Имя берём как представление строки: на обычном пути сообщения копии не нужны
+    const QStringView requestedName = QStringView(message.sender()).trimmed();
+    
+    // Если пользователь еще не авторизован, обрабатываем авторизацию.
+    // После рукопожатия вход идёт только кадром Login.
+    if (sender->isAuthenticated() == false) {
+        if (sender->hasHandshake()) {
+            return;
+        }
+        handleAuthentication(requestedName.toString(), message.text(), sender);
+        return;
+    }
+
+    if (requestedName != sender->userName()) {
+        sender->sendMessage(ChatMessage{"SERVER", tr("Нельзя менять имя пользователя во время сессии")});
+        return;
+    }
+
+    // Управляющие символы и переключатели направления текста вырезаем до записи в историю и рассылки
+    if (TextSanitizer::containsUnsafe(message.text())) {
+        qCDebug(chatServerMessages) << "Из сообщения" << sender->userName() << "удалены управляющие символы";
+        message.setText(TextSanitizer::stripUnsafe(message.text()));
+    }
+
+    // Пустые сообщения не рассылаем
+    if (QStringView(message.text()).trimmed().isEmpty()) {
+        return;
+    }
+
+    // Команды комнат и личные сообщения доступны всем
+    if (handleRoomCommand(message, sender) || handleDirectCommand(message, sender)
+        || handleBlockCommand(message, sender)) {
+        return;
+    }
+
+    // Проверяем, является ли отправитель администратором
+    bool isAdmin = (QString::compare(sender->userName(), kAdminUser, Qt::CaseInsensitive) == 0);
+    if (isAdmin) {
+        bool handled = handleAdminCommand(message, sender);
+        if (handled) {
+            return;
+        }
+    }
+
+    qCDebug(chatServerMessages) << "Сообщение от" << message.sender() << ':' << message.text();
+    
+    // Имя отправителя разделяет данные с именем сессии (без копирования)
+    message.setSender(sender->userName());
+    
+    // Кодируем один раз для всех подписчиков комнаты, затем пишем в лог и сохраняем в историю комнаты
+    ChatRoom *room = roomOf(sender);
+    if (room == nullptr) {
+        return;
+    }
+    // Сообщение отправлено — отметка о наборе снимается
+    room->clearTyping(message.sender());
+    scheduleTyping(*room);
+    // Реакция находит сообщение по отправителю и времени, поэтому у своих сообщений
+    // одного отправителя в комнате время не повторяется
+    const qint64 timestampMs = message.timestamp().toMSecsSinceEpoch();
+    const qint64 freeMs = room->history().freeTimestampMs(message.sender(), timestampMs);
+    if (freeMs != timestampMs) {
+        message.setTimestamp(message.timestamp().addMSecs(freeMs - timestampMs));
+    }
+
+    const QByteArray frame = ClientConnection::encodeFrame(message);
+    saveMessageToLog(*room, message);
+    broadcastMessage(*room, message, frame);
+    m_cluster.relayMessage(room->name(), frame);
+    addMessageToHistory(*room, message, frame);
+}
+
+const std::array<ChatServer::ControlHandler, std::size_t(ControlKind::Count)> ChatServer::kControlHandlers = {
+    &ChatServer::handleLogin,  // Login
+    nullptr,                   // AuthOk
+    nullptr,                   // AuthFail
+    nullptr,                   // UserList
+    &ChatServer::handleHello,  // Hello
+    nullptr,                   // Welcome
+    nullptr,                   // Room
+    &ChatServer::handleDirect, // Direct
+    &ChatServer::handleTyping, // Typing
+    &ChatServer::handleReact,  // React
+    nullptr,                   // Reactions
+};
+
+void ChatServer::onControlReceived(ControlMessage &&message, ClientConnection *sender)
+{
+    if (sender == nullptr) {
+        return;
+    }
+
+    const ControlHandler handler = kControlHandlers[std::size_t(message.kind())];
+    if (handler == nullptr) {
+        qCWarning(chatServerCore) << "Неожиданный управляющий кадр от клиента" << int(message.kind());
+        return;
+    }
+    (this->*handler)(message, sender);
+}
+
+void ChatServer::handleHello(const ControlMessage &message, ClientConnection *sender)
+{
+    // Рукопожатие допускается один раз и только до входа
+    if (sender->hasHandshake() || sender->isAuthenticated()) {
+        return;
+    }
+
+    std::optional<SessionCapabilities> negotiated;
+    try {
+        negotiated = m_capabilities.negotiate(SessionCapabilities::fromControl(message));
+    } catch (const std::exception &error) {
+        qCWarning(chatServerCore) << "Некорректное рукопожатие:" << error.what();
+    }
+
+    if (!negotiated) {
+        // Клиент прислал HELLO, значит управляющий кадр поймёт и без сессии
+        sender->sendFrame(ControlMessage::authFail(tr("Несовместимая версия протокола")).encodeFrame());
+        sender->disconnectFromServer();
+        return;
+    }
+
+    qCDebug(chatServerCore) << "Рукопожатие: версия" << negotiated->version() << "сжатие"
+                            << int(negotiated->compression()) << "макс. кадр" << negotiated->maxFrameSize();
+    sender->startSession(*negotiated);
+}
+
+void ChatServer::handleLogin(const ControlMessage &message, ClientConnection *sender)
+{
+    if (sender->isAuthenticated()) {
+        return;
+    }
+    handleAuthentication(message.userName().trimmed(), message.password(), sender);
+}
+
+void ChatServer::handleAuthentication(const QString &requestedName, const QString &password, ClientConnection *sender)
+{
+    if (requestedName.isEmpty()) {
+        sender->sendControl(ControlMessage::authFail(tr("Логин не может быть пустым")));
+        sender->disconnectFromServer();
+        return;
+    }
+
+    if (TextSanitizer::containsUnsafe(requestedName)) {
+        sender->sendControl(ControlMessage::authFail(tr("Логин содержит недопустимые символы")));
+        sender->disconnectFromServer();
+        return;
+    }
+
+    // Каталог присутствия охватывает весь кластер и читается локально
+    if (m_presence.contains(requestedName)) {
+        sender->sendControl(ControlMessage::authFail(tr("Пользователь уже подключён")));
+        sender->disconnectFromServer();
+        return;
+    }
+
+    if (m_bannedUsers.contains(requestedName)) {
+        sender->sendControl(ControlMessage::authFail(tr("Пользователь заблокирован")));
+        sender->disconnectFromServer();
+        return;
+    }
+
+    QString errorMessage;
+    UserStore::AuthResult authResult;
+    
+    // Проверяем, существует ли пользователь
+    bool userExists = m_userStore.contains(requestedName);
+
+    if (userExists) {
+        // Пытаемся авторизовать существующего пользователя
+        authResult = m_userStore.authenticate(requestedName, password, errorMessage);
+    } else if (m_allowRegistration) {
+        // Регистрируем нового пользователя
+        authResult = m_userStore.registerUser(requestedName, password, errorMessage);
+    } else {
+        // Пользователь не найден и регистрация запрещена
+        authResult = UserStore::AuthResult::UserNotFound;
+        errorMessage = tr("Пользователь не найден. Обратитесь к администратору для регистрации");
+    }
+
+    switch (authResult) {
+    case UserStore::AuthResult::SuccessExisting:
+    case UserStore::AuthResult::RegisteredNew:
+        sender->setUserName(requestedName);
+        sender->setUserId(m_blocks.userId(requestedName));
+        sender->setAuthenticated(true);
+        m_clientsByName.insert(requestedName, sender);
+        sender->sendControl(ControlMessage::authOk());
+        if (authResult == UserStore::AuthResult::RegisteredNew) {
+            sender->sendMessage(ChatMessage{"SERVER", tr("Создан новый аккаунт и выполнен вход")});
+        } else {
+            sender->sendMessage(ChatMessage{"SERVER", tr("Вход выполнен")});
+        }
+        qCInfo(chatServerCore) << "Пользователь авторизован:" << requestedName;
+        
+        m_presence.addLocal(requestedName, QDateTime::currentMSecsSinceEpoch());
+        m_cluster.relay(ClusterEvent::Directory, m_presence.encodeLocal());
+
+        // Новый пользователь попадает в комнату по умолчанию и получает её историю
+        joinRoom(sender, defaultRoom());
+        
+        // Отправляем список пользователей новому пользователю
+        sendUserList(sender);
+        deliverMailbox(sender);
+        
+        broadcastSystemMessage(defaultRoom(), tr("%1 вошёл в чат").arg(requestedName));
+        
+        // Отправляем обновленный список пользователей всем (включая нового пользователя)
+        broadcastUserList();
+        break;
+    case UserStore::AuthResult::WrongPassword:
+    case UserStore::AuthResult::InvalidCredentials:
+    case UserStore::AuthResult::StorageError:
+    case UserStore::AuthResult::UserNotFound:
+        sender->sendControl(ControlMessage::authFail(errorMessage));
+        sender->disconnectFromServer();
+        break;
+    }
+}
+
+void ChatServer::onConnectionClosed(ClientConnection *connection)
+{
+    // Удаляем клиента из списка
+    std::vector<ClientConnection *>::iterator it = m_clients.begin();
+    while (it != m_clients.end()) {
+        if (*it == connection) {
+            it = m_clients.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    
+    m_historyReplays.remove(connection);
+    ChatRoom *room = roomOf(connection);
+    leaveRoom(connection);
+    
+    // Если у клиента было имя, удаляем его из списка имен
+    if (connection != nullptr && connection->hasUserName()) {
+        QString name = connection->userName();
+        m_clientsByName.remove(name);
+        m_presence.removeLocal(name);
+        m_cluster.relay(ClusterEvent::Directory, m_presence.encodeLocal());
+        // Сессия, закрытая из-за входа на другом узле, уход из чата не означает
+        if (m_presence.contains(name) == false && room != nullptr) {
+            broadcastSystemMessage(*room, tr("%1 покинул чат").arg(name));
+        }
+        
+        // Отправляем обновленный список пользователей всем остальным
+        broadcastUserList();
+    }
+    qCInfo(chatServerCore) << "Клиент отключился";
+}
+
+void ChatServer::broadcastSystemMessage(ChatRoom &room, const QString &text)
+{
+    // Создаем системное сообщение
+    ChatMessage systemMessage("SERVER", text);
+    const QByteArray frame = ClientConnection::encodeFrame(systemMessage);
+    saveMessageToLog(room, systemMessage);
+    
+    // Отправляем всем в комнате, в том числе на других узлах
+    broadcastMessage(room, systemMessage, frame);
+    m_cluster.relayMessage(room.name(), frame);
+    addMessageToHistory(room, systemMessage, frame);
+}
+
+void ChatServer::onRelayedMessage(const QString &room, ChatMessage &&message, const QByteArray &frame)
+{
+    // Комнату, впервые встреченную на другом узле, заводим и здесь
+    if (ChatRoom::normalizedName(room) != room) {
+        qCWarning(chatServerCore) << "Сообщение узла кластера для недопустимой комнаты" << room;
+        return;
+    }
+    // Сообщение уже принято узлом-источником: здесь только местная рассылка
+    ChatRoom *target = findOrCreateRemoteRoom(room);
+    if (target == nullptr) {
+        return;
+    }
+    saveMessageToLog(*target, message);
+    broadcastMessage(*target, message, frame);
+    addMessageToHistory(*target, message, frame);
+}
+
+void ChatServer::onClusterEvent(ClusterEvent kind, const QString &origin, const QByteArray &payload)
+{
+    switch (kind) {
+    case ClusterEvent::Directory:
+        mergePresence(payload);
+        break;
+    case ClusterEvent::Command:
+        qCInfo(chatServerCore) << "Команда администратора с узла" << origin;
+        handleClusterCommand(payload);
+        break;
+    case ClusterEvent::Message:
+        break;
+    }
+}
+
+void ChatServer::onNodeJoined(const QString &nodeId)
+{
+    // Соседу уходит весь каталог: после разделения сети так сходятся обе стороны
+    Q_UNUSED(nodeId)
+    m_cluster.relay(ClusterEvent::Directory, m_presence.encodeAll());
+}
+
+void ChatServer::onNodeLost(const QString &nodeId)
+{
+    if (m_presence.markLost(nodeId)) {
+        broadcastUserList();
+    }
+}
+
+void ChatServer::mergePresence(const QByteArray &payload)
+{
+    PresenceDirectory::MergeResult result;
+    try {
+        result = m_presence.merge(payload, QDateTime::currentMSecsSinceEpoch());
+    } catch (const std::exception &error) {
+        qCWarning(chatServerCore) << "Некорректный каталог присутствия:" << error.what();
+        return;
+    }
+
+    for (const QString &name : std::as_const(result.evicted)) {
+        if (auto *client = findClientByName(name)) {
+            qCInfo(chatServerCore) << "Повторный вход" << name << "на другом узле, сессия закрыта";
+            client->sendMessage(ChatMessage{QStringLiteral("SERVER"), tr("Вход под этим логином выполнен на другом сервере")});
+            client->disconnectFromServer();
+        }
+    }
+    if (result.changed) {
+        broadcastUserList();
+    }
+}
+
+void ChatServer::refreshPresence()
+{
+    // Сосед сообщает только о разрыве прямой связи; об узлах за ним говорит
+    // лишь то, что их записи перестали приходить
+    m_cluster.relay(ClusterEvent::Directory, m_presence.encodeLocal());
+    if (!m_presence.expire(QDateTime::currentMSecsSinceEpoch(), kPresenceExpiryMs).isEmpty()) {
+        broadcastUserList();
+    }
+}
+
+void ChatServer::handleClusterCommand(const QByteArray &payload)
+{
+    const auto command = QJsonDocument::fromJson(payload).array();
+    if (command.size() != 2 || command.at(1).toString().isEmpty()) {
+        qCWarning(chatServerCore) << "Некорректная команда от узла кластера";
+        return;
+    }
+    const auto action = command.at(0).toString();
+    const auto targetName = command.at(1).toString();
+
+    // Список банов один на весь кластер, отключает же только узел, где сидит пользователь
+    if (action == QStringLiteral("unban")) {
+        setBanned(targetName, false);
+        return;
+    }
+    if (action == QStringLiteral("ban")) {
+        setBanned(targetName, true);
+        disconnectByAdmin(findClientByName(targetName), tr("Вы заблокированы администратором"));
+        return;
+    }
+    if (action == QStringLiteral("kick")) {
+        disconnectByAdmin(findClientByName(targetName), tr("Вас отключил администратор"));
+    }
+}
+
+void ChatServer::setBanned(const QString &name, bool banned)
+{
+    if (banned) {
+        m_bannedUsers.insert(name);
+    } else {
+        m_bannedUsers.remove(name);
+    }
+    m_replicaFeed.publishBans(m_bannedUsers);
+}
+
+void ChatServer::onReplicaReset()
+{
+    for (const auto &room : m_rooms) {
+        room->history().clear();
+    }
+}
+
+void ChatServer::onReplicatedMessage(const QString &room, ChatMessage &&message, const QByteArray &frame)
+{
+    if (ChatRoom::normalizedName(room) != room) {
+        qCWarning(chatServerCore) << "Запись репликации для недопустимой комнаты" << room;
+        return;
+    }
+    // Резерв держит историю и лог готовыми к приёму клиентов; кадр хранится как есть
+    ChatRoom *target = findOrCreateRemoteRoom(room);
+    if (target == nullptr) {
+        return;
+    }
+    saveMessageToLog(*target, message);
+    addMessageToHistory(*target, message, frame);
+}
+
+void ChatServer::onReplicatedBans(const QStringList &bans)
+{
+    m_bannedUsers = QSet<QString>(bans.cbegin(), bans.cend());
+}
+
+void ChatServer::onPromoted()
+{
+    // Порт может ещё держать умирающий основной процесс — пробуем, пока не освободится
+    if (!listen(QHostAddress::Any, m_port)) {
+        qCWarning(chatServerCore) << "Порт" << m_port << "пока занят:" << errorString();
+        QTimer::singleShot(kTakeOverRetryMs, this, &ChatServer::onPromoted);
+        return;
+    }
+    qCInfo(chatServerCore) << "Резервный сервер принимает клиентов, комнат:" << m_rooms.size();
+    if (!startServices()) {
+        close();
+    }
+}
+
+void ChatServer::disconnectByAdmin(ClientConnection *target, const QString &reason)
+{
+    if (target == nullptr) {
+        return;
+    }
+    target->sendMessage(ChatMessage{QStringLiteral("SERVER"), reason});
+    target->disconnectFromServer();
+}
+
+void ChatServer::broadcastMessage(const ChatRoom &room, const ChatMessage &message, const QByteArray &frame)
+{
+    // Получатели группируются по акторам исполнителя: одна задача на шард, а не на соединение
+    OutboundExecutor::Fanout fanout(m_outbound, message, frame);
+    const QBitArray *blockers = m_blocks.blockersOf(message.sender());
+    if (blockers == nullptr) {
+        for (ClientConnection *client : room.members()) {
+            if (client != nullptr) {
+                fanout.add(client);
+            }
+        }
+    } else {
+        // Отправителя кто-то заблокировал: такие получатели отсеиваются проверкой бита
+        for (ClientConnection *client : room.members()) {
+            if (client != nullptr && !BlockLists::isInMask(*blockers, client->userId())) {
+                fanout.add(client);
+            }
+        }
+    }
+    fanout.dispatch();
+}
+
+void ChatServer::handleTyping(const ControlMessage &message, ClientConnection *sender)
+{
+    Q_UNUSED(message)
+    ChatRoom *room = sender->isAuthenticated() ? roomOf(sender) : nullptr;
+    if (room == nullptr) {
+        return;
+    }
+    room->markTyping(sender->userName(), QDateTime::currentMSecsSinceEpoch());
+    scheduleTyping(*room);
+}
+
+void ChatServer::scheduleTyping(ChatRoom &room)
+{
+    if (room.hasTyping() == false && room.typingChanged() == false) {
+        return;
+    }
+    m_typingRooms.insert(&room);
+    if (m_typingTimer.isActive() == false) {
+        m_typingTimer.start();
+    }
+}
+
+void ChatServer::flushTyping()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = m_typingRooms.begin(); it != m_typingRooms.end();) {
+        ChatRoom *room = *it;
+        room->expireTyping(now, kTypingTimeoutMs);
+
+        // Один кадр на комнату за такт, сколько бы сигналов ни пришло
+        if (room->takeTypingChanged()) {
+            const QByteArray frame = ControlMessage::typing(room->typingUsers()).encodeFrame();
+            for (ClientConnection *client : room->members()) {
+                if (client != nullptr && client->usesControlFrames()
+                    && client->pendingBytes() < kTypingBackpressureBytes) {
+                    client->sendFrame(frame);
+                }
+            }
+        }
+
+        if (room->hasTyping()) {
+            ++it;
+        } else {
+            it = m_typingRooms.erase(it);
+        }
+    }
+    if (m_typingRooms.isEmpty()) {
+        m_typingTimer.stop();
+    }
 }
 
-bool ChatServer::start(quint16 port)
+void ChatServer::handleReact(const ControlMessage &message, ClientConnection *sender)
 {
-    if (!listen(QHostAddress::Any, port)) {
-        const auto errorMessage = tr("Не удалось запустить сервер: %1").arg(errorString());
-        emit serverError(errorMessage);
-        qCCritical(chatServerCore) << errorMessage;
-        return false;
+    ChatRoom *room = sender->isAuthenticated() ? roomOf(sender) : nullptr;
+    if (room == nullptr) {
+        return;
+    }
+    const QString reaction = message.reaction();
+    if (reaction.isEmpty() || reaction.size() > kMaxReactionLength
+        || std::any_of(reaction.cbegin(), reaction.cend(), [](QChar ch) { return ch.isSpace(); })
+        || TextSanitizer::containsUnsafe(reaction)) {
+        return;
     }
 
-    qCInfo(chatServerCore) << "Сервер запущен на порту" << serverPort();
-    return true;
+    // Реакции живут, пока сообщение есть в истории комнаты
+    const quint64 seq = room->findMessage(message.author(), message.messageTimestampMs());
+    if (seq == 0 || room->toggleReaction(seq, reaction, sender->userName()) == false) {
+        return;
+    }
+    m_reactionRooms.insert(room);
+    if (m_reactionTimer.isActive() == false) {
+        m_reactionTimer.start();
+    }
 }
 
-void ChatServer::stop()
+void ChatServer::flushReactions()
 {
-    // Закрываем сервер
-    close();
-    
-    // Удаляем всех клиентов
-    for (ClientConnection *client : m_clients) {
-        if (client) {
-            client->deleteLater();
+    const QSet<ChatRoom *> rooms = std::exchange(m_reactionRooms, {});
+    for (ChatRoom *room : rooms) {
+        const QList<ControlMessage> deltas = room->takeReactionDeltas();
+        if (deltas.isEmpty()) {
+            continue;
+        }
+        // Кадры комнаты склеиваются и уходят каждому подписчику одной записью
+        QByteArray frames;
+        for (const ControlMessage &delta : deltas) {
+            frames += delta.encodeFrame();
+        }
+        for (ClientConnection *client : room->members()) {
+            if (client != nullptr && client->usesControlFrames()) {
+                client->sendFrame(frames);
+            }
         }
     }
-    
-    // Очищаем списки
-    m_clients.clear();
-    m_clientsByName.clear();
-    
-    qCInfo(chatServerCore) << "Сервер остановлен";
 }
 
-void ChatServer::incomingConnection(qintptr socketDescriptor)
+void ChatServer::handleDirect(const ControlMessage &message, ClientConnection *sender)
 {
-    // Создаем новый сокет для клиента
-    QTcpSocket *socket = new QTcpSocket(this);
-    
-    // Устанавливаем дескриптор сокета
-    bool ok = socket->setSocketDescriptor(socketDescriptor);
-    if (ok == false) {
-        qCWarning(chatServerCore) << "Не удалось принять подключение:" << socket->errorString();
-        socket->deleteLater();
+    if (sender->isAuthenticated() == false) {
         return;
     }
 
-    // Создаем объект соединения с клиентом
-    ClientConnection *connection = new ClientConnection(socket, this);
-    
-    // Подключаем сигналы
-    connect(connection, &ClientConnection::messageReceived, this, [this, connection](const ChatMessage &message) {
-        onMessageReceived(message, connection);
-    });
-    connect(connection, &ClientConnection::connectionClosed, this, &ChatServer::onConnectionClosed);
+    // Поле отправителя в кадре клиента не используется: отправитель — сама сессия
+    QString text = message.text();
+    if (TextSanitizer::containsUnsafe(text)) {
+        text = TextSanitizer::stripUnsafe(text);
+    }
+    if (QStringView(text).trimmed().isEmpty()) {
+        return;
+    }
+    sendDirectMessage(sender, message.recipient().trimmed(), text);
+}
 
-    // Добавляем в список клиентов
-    m_clients.push_back(connection);
+bool ChatServer::handleDirectCommand(const ChatMessage &message, ClientConnection *sender)
+{
+    const auto text = QStringView(message.text()).trimmed();
+    const auto command = QStringLiteral("/msg");
+    if (!text.startsWith(command, Qt::CaseInsensitive)
+        || (text.size() > command.size() && !text.at(command.size()).isSpace())) {
+        return false;
+    }
 
-    qCInfo(chatServerCore) << "Новый клиент:" << socket->peerAddress().toString();
+    // Текст после имени получателя передаётся как есть, с внутренними пробелами
+    const auto arguments = text.sliced(command.size()).trimmed();
+    const auto nameEnd = std::find_if(arguments.begin(), arguments.end(), [](QChar c) { return c.isSpace(); });
+    const auto recipient = arguments.first(nameEnd - arguments.begin());
+    const auto body = arguments.sliced(recipient.size()).trimmed();
+    if (recipient.isEmpty() || body.isEmpty()) {
+        sender->sendMessage(ChatMessage{QStringLiteral("SERVER"), tr("Формат: /msg <пользователь> <текст>")});
+        return true;
+    }
+    sendDirectMessage(sender, recipient.toString(), body.toString());
+    return true;
 }
 
-void ChatServer::onMessageReceived(const ChatMessage &message, ClientConnection *sender)
+void ChatServer::sendDirectMessage(ClientConnection *sender, const QString &recipientName, const QString &text)
 {
-    // Проверяем, что отправитель существует
-    if (sender == nullptr) {
-        qCWarning(chatServerCore) << "Получено сообщение, но отправитель неизвестен";
+    const ControlMessage direct =
+        ControlMessage::direct(sender->userName(), recipientName, text, QDateTime::currentDateTimeUtc());
+
+    // Заблокированный отправитель видит своё сообщение, но получателю оно не доставляется
+    if (m_blocks.blocks(recipientName, sender->userName())) {
+        sender->sendControl(direct);
         return;
     }
 
-    // Получаем имя пользователя из сообщения
-    QString messageSender = message.sender();
-    QString requestedName = messageSender.trimmed();
-    
-    // Если пользователь еще не авторизован, обрабатываем авторизацию
-    if (sender->isAuthenticated() == false) {
-        if (requestedName.isEmpty()) {
-            sender->sendMessage(ChatMessage{"SERVER", tr("AUTH_FAIL: Логин не может быть пустым")});
-            sender->disconnectFromServer();
-            return;
+    // Один поиск по индексу имён вместо рассылки всей комнате
+    ClientConnection *recipient = m_clientsByName.value(recipientName);
+    if (recipient != nullptr && recipient->isAuthenticated()) {
+        qCDebug(chatServerMessages) << "Личное сообщение от" << sender->userName() << "для" << recipientName;
+        recipient->sendControl(direct);
+        if (recipient != sender) {
+            sender->sendControl(direct);
         }
+        return;
+    }
+
+    if (m_presence.containsRemote(recipientName)) {
+        sender->sendMessage(ChatMessage{
+            QStringLiteral("SERVER"),
+            tr("Пользователь %1 подключён к другому узлу, личные сообщения туда не передаются").arg(recipientName)
+        });
+        return;
+    }
+    if (m_userStore.contains(recipientName) == false) {
+        sender->sendMessage(ChatMessage{QStringLiteral("SERVER"), tr("Пользователь %1 не найден").arg(recipientName)});
+        return;
+    }
+
+    // Получатель не в сети: кадр ложится в его ящик в том виде, в котором уйдёт при входе
+    if (m_mailboxes.append(recipientName, direct.encodeFrame()) == false) {
+        sender->sendMessage(ChatMessage{
+            QStringLiteral("SERVER"),
+            tr("Почтовый ящик %1 переполнен, сообщение не сохранено").arg(recipientName)
+        });
+        return;
+    }
+    qCDebug(chatServerMessages) << "Личное сообщение от" << sender->userName() << "в ящик" << recipientName;
+    sender->sendControl(direct);
+    sender->sendMessage(ChatMessage{
+        QStringLiteral("SERVER"),
+        tr("%1 не в сети, сообщение будет доставлено при входе").arg(recipientName)
+    });
+}
 
-        if (m_clientsByName.contains(requestedName)) {
-            sender->sendMessage(ChatMessage{"SERVER", tr("AUTH_FAIL: Пользователь уже подключён")});
-            sender->disconnectFromServer();
+void ChatServer::deliverMailbox(ClientConnection *client)
+{
+    const QString user = client->userName();
+    m_mailboxes.drain(user, [this, user, client = QPointer<ClientConnection>(client)](QByteArray frames) {
+        // Сессия закрылась, пока ящик читался: кадры дождутся следующего входа
+        if (client == nullptr || client->isAuthenticated() == false || client->userName() != user) {
+            m_mailboxes.restore(user, frames);
             return;
         }
 
-        if (m_bannedUsers.contains(requestedName)) {
-            sender->sendMessage(ChatMessage{"SERVER", tr("AUTH_FAIL: Пользователь заблокирован")});
-            sender->disconnectFromServer();
+        const auto count = frames.count('\n');
+        client->sendMessage(ChatMessage{
+            QStringLiteral("SERVER"),
+            tr("Личных сообщений, пока вас не было: %1").arg(count)
+        });
+        if (client->usesControlFrames()) {
+            // Ящик уже состоит из готовых кадров Direct: одна запись на весь пакет
+            client->sendFrame(frames);
             return;
         }
-
-        QString errorMessage;
-        UserStore::AuthResult authResult;
-        
-        // Проверяем, существует ли пользователь
-        bool userExists = m_userStore.contains(requestedName);
-
-        if (userExists) {
-            // Пытаемся авторизовать существующего пользователя
-            QString password = message.text();
-            authResult = m_userStore.authenticate(requestedName, password, errorMessage);
-        } else if (m_allowRegistration) {
-            // Регистрируем нового пользователя
-            QString password = message.text();
-            authResult = m_userStore.registerUser(requestedName, password, errorMessage);
-        } else {
-            // Пользователь не найден и регистрация запрещена
-            authResult = UserStore::AuthResult::UserNotFound;
-            errorMessage = tr("Пользователь не найден. Обратитесь к администратору для регистрации");
-        }
-
-        switch (authResult) {
-        case UserStore::AuthResult::SuccessExisting:
-        case UserStore::AuthResult::RegisteredNew:
-            sender->setUserName(requestedName);
-            sender->setAuthenticated(true);
-            m_clientsByName.insert(requestedName, sender);
-            sender->sendMessage(ChatMessage{"SERVER", QStringLiteral("AUTH_OK")});
-            if (authResult == UserStore::AuthResult::RegisteredNew) {
-                sender->sendMessage(ChatMessage{"SERVER", tr("Создан новый аккаунт и выполнен вход")});
-            } else {
-                sender->sendMessage(ChatMessage{"SERVER", tr("Вход выполнен")});
+        qsizetype start = 0;
+        qsizetype end = -1;
+        while ((end = frames.indexOf('\n', start)) != -1) {
+            try {
+                client->sendControl(ControlMessage::decode(frames.sliced(start, end - start)));
+            } catch (const std::exception &error) {
+                qCWarning(chatServerCore) << "Повреждённая запись почтового ящика:" << error.what();
             }
-            qCInfo(chatServerCore) << "Пользователь авторизован:" << requestedName;
-            
-            // Отправляем историю сообщений новому пользователю
-            sendMessageHistory(sender);
-            
-            // Отправляем список пользователей новому пользователю
-            sendUserList(sender);
-            
-            broadcastSystemMessage(tr("%1 вошёл в чат").arg(requestedName));
-            
-            // Отправляем обновленный список пользователей всем (включая нового пользователя)
-            broadcastUserList();
-            break;
-        case UserStore::AuthResult::WrongPassword:
-        case UserStore::AuthResult::InvalidCredentials:
-        case UserStore::AuthResult::StorageError:
-        case UserStore::AuthResult::UserNotFound:
-            sender->sendMessage(ChatMessage{
-                QStringLiteral("SERVER"),
-                QStringLiteral("AUTH_FAIL: %1").arg(errorMessage)
-            });
-            sender->disconnectFromServer();
-            break;
+            start = end + 1;
         }
-        return;
+    });
+}
+
+bool ChatServer::handleBlockCommand(const ChatMessage &message, ClientConnection *sender)
+{
+    const auto text = QStringView(message.text()).trimmed();
+    if (!text.startsWith(QLatin1Char('/'))) {
+        return false;
     }
 
-    if (sender->userName() != requestedName) {
-        sender->sendMessage(ChatMessage{"SERVER", tr("Нельзя менять имя пользователя во время сессии")});
-        return;
+    const auto parts = text.split(QLatin1Char(' '), Qt::SkipEmptyParts);
+    const auto command = parts.first().toString().toLower();
+    const QString &user = sender->userName();
+
+    if (command == QStringLiteral("/blocks")) {
+        const QStringList blocked = m_blocks.blockedBy(user);
+        sender->sendMessage(ChatMessage{
+            QStringLiteral("SERVER"),
+            blocked.isEmpty() ? tr("Вы никого не блокировали")
+                              : tr("Заблокированы: %1").arg(blocked.join(QStringLiteral(", ")))
+        });
+        return true;
     }
 
-    // Получаем текст сообщения
-    QString messageText = message.text();
-    QString trimmedText = messageText.trimmed();
-    if (trimmedText.isEmpty()) {
-        return;
+    if (command != QStringLiteral("/block") && command != QStringLiteral("/unblock")) {
+        return false;
+    }
+    if (parts.size() != 2) {
+        sender->sendMessage(ChatMessage{QStringLiteral("SERVER"), tr("Формат: %1 <пользователь>").arg(command)});
+        return true;
     }
 
-    // Проверяем, является ли отправитель администратором
-    QString senderName = sender->userName();
-    bool isAdmin = (QString::compare(senderName, kAdminUser, Qt::CaseInsensitive) == 0);
-    if (isAdmin) {
-        ChatMessage adminMessage(senderName, trimmedText, message.timestamp());
-        bool handled = handleAdminCommand(adminMessage, sender);
-        if (handled) {
-            return;
-        }
+    const QString target = parts.at(1).toString();
+    if (command == QStringLiteral("/unblock")) {
+        const bool changed = m_blocks.unblock(user, target);
+        sender->sendMessage(ChatMessage{
+            QStringLiteral("SERVER"),
+            changed ? tr("%1 разблокирован").arg(target) : tr("%1 не был заблокирован").arg(target)
+        });
+        return true;
     }
 
-    qCInfo(chatServerCore) << "Сообщение от" << message.sender() << ':' << message.text();
-    
-    // Сохраняем сообщение в историю и лог
-    ChatMessage chatMessage(message.sender(), message.text(), message.timestamp());
-    addMessageToHistory(chatMessage);
-    saveMessageToLog(chatMessage);
-    
-    // Отправляем всем клиентам
-    for (ClientConnection *client : m_clients) {
-        if (client != nullptr) {
-            client->sendMessage(chatMessage);
-        }
+    if (target == user || m_userStore.contains(target) == false) {
+        sender->sendMessage(ChatMessage{QStringLiteral("SERVER"), tr("Пользователь %1 не найден").arg(target)});
+        return true;
+    }
+    if (m_blocks.block(user, target) == false) {
+        sender->sendMessage(ChatMessage{
+            QStringLiteral("SERVER"),
+            m_blocks.blocks(user, target)
+                ? tr("%1 уже заблокирован").arg(target)
+                : tr("Нельзя заблокировать больше %1 пользователей").arg(BlockLists::kMaxBlockedPerUser)
+        });
+        return true;
     }
+    sender->sendMessage(ChatMessage{
+        QStringLiteral("SERVER"),
+        tr("%1 заблокирован: его сообщения и личные сообщения до вас не дойдут").arg(target)
+    });
+    return true;
 }
 
-void ChatServer::onConnectionClosed(ClientConnection *connection)
+bool ChatServer::handleRoomCommand(const ChatMessage &message, ClientConnection *sender)
 {
-    // Удаляем клиента из списка
-    std::vector<ClientConnection *>::iterator it = m_clients.begin();
-    while (it != m_clients.end()) {
-        if (*it == connection) {
-            it = m_clients.erase(it);
-        } else {
-            ++it;
+    const auto text = QStringView(message.text()).trimmed();
+    if (!text.startsWith(QLatin1Char('/'))) {
+        return false;
+    }
+
+    const auto parts = text.split(QLatin1Char(' '), Qt::SkipEmptyParts);
+    const auto command = parts.first().toString().toLower();
+    ChatRoom *current = roomOf(sender);
+    if (current == nullptr) {
+        return false;
+    }
+
+    if (command == QStringLiteral("/join")) {
+        const QString name = parts.size() == 2 ? ChatRoom::normalizedName(parts.at(1)) : QString();
+        if (name.isEmpty()) {
+            sender->sendMessage(ChatMessage{
+                QStringLiteral("SERVER"),
+                tr("Укажите комнату: до %1 букв, цифр, '_' или '-'").arg(ChatRoom::kMaxNameLength)
+            });
+            return true;
+        }
+        if (name == current->name()) {
+            sender->sendMessage(ChatMessage{QStringLiteral("SERVER"), tr("Вы уже в комнате %1").arg(name)});
+            return true;
+        }
+        if (!m_roomsByName.contains(name) && qsizetype(m_rooms.size()) >= m_maxRooms) {
+            sender->sendMessage(ChatMessage{QStringLiteral("SERVER"), tr("Достигнут лимит количества комнат")});
+            return true;
         }
+        ChatRoom &room = findOrCreateRoom(name);
+        joinRoom(sender, room);
+        broadcastSystemMessage(room, tr("%1 зашёл в комнату").arg(sender->userName()));
+        return true;
     }
-    
-    // Если у клиента было имя, удаляем его из списка имен
-    if (connection != nullptr && connection->hasUserName()) {
-        QString name = connection->userName();
-        m_clientsByName.remove(name);
-        QString message = tr("%1 покинул чат").arg(name);
-        broadcastSystemMessage(message);
-        
-        // Отправляем обновленный список пользователей всем остальным
-        broadcastUserList();
+
+    if (command == QStringLiteral("/leave")) {
+        if (current == &defaultRoom()) {
+            sender->sendMessage(ChatMessage{
+                QStringLiteral("SERVER"),
+                tr("Вы и так в комнате %1").arg(ChatRoom::kDefaultName)
+            });
+            return true;
+        }
+        joinRoom(sender, defaultRoom());
+        broadcastSystemMessage(defaultRoom(), tr("%1 зашёл в комнату").arg(sender->userName()));
+        return true;
     }
-    qCInfo(chatServerCore) << "Клиент отключился";
-}
 
-void ChatServer::broadcastSystemMessage(const QString &text)
-{
-    // Создаем системное сообщение
-    ChatMessage systemMessage("SERVER", text);
-    addMessageToHistory(systemMessage);
-    saveMessageToLog(systemMessage);
-    
-    // Отправляем всем клиентам
-    for (ClientConnection *client : m_clients) {
-        if (client != nullptr) {
-            client->sendMessage(systemMessage);
+    if (command == QStringLiteral("/rooms")) {
+        // Счётчики — подписчики этого узла
+        QStringList rooms;
+        rooms.reserve(qsizetype(m_rooms.size()));
+        for (const auto &room : m_rooms) {
+            rooms.append(QStringLiteral("%1 (%2)").arg(room->name()).arg(qsizetype(room->members().size())));
         }
+        sender->sendMessage(ChatMessage{QStringLiteral("SERVER"), tr("Комнаты: %1").arg(rooms.join(QStringLiteral(", ")))});
+        return true;
     }
+
+    return false;
 }
 
 bool ChatServer::handleAdminCommand(const ChatMessage &message, ClientConnection *sender)
@@ -294,7 +1304,8 @@ bool ChatServer::handleAdminCommand(const ChatMessage &message, ClientConnection
         return false;
     }
 
-    const auto text = message.text().trimmed();
+    // Обычный текст отсекается без выделения памяти
+    const auto text = QStringView(message.text()).trimmed();
     if (!text.startsWith(QLatin1Char('/'))) {
         return false;
     }
@@ -304,7 +1315,7 @@ bool ChatServer::handleAdminCommand(const ChatMessage &message, ClientConnection
         return false;
     }
 
-    const auto command = parts.first().toLower();
+    const auto command = parts.first().toString().toLower();
     const auto requireTarget = [&](const QString &action) -> std::optional<QString> {
         if (parts.size() < 2) {
             sender->sendMessage(ChatMessage{
@@ -328,7 +1339,7 @@ bool ChatServer::handleAdminCommand(const ChatMessage &message, ClientConnection
             });
             return std::nullopt;
         }
-        return target;
+        return target.toString();
     };
 
     if (command == QStringLiteral("/kick")) {
@@ -337,12 +1348,13 @@ bool ChatServer::handleAdminCommand(const ChatMessage &message, ClientConnection
             return true;
         }
         const auto targetName = targetOpt.value();
-        if (auto *target = findClientByName(targetName)) {
-            target->sendMessage(ChatMessage{
-                QStringLiteral("SERVER"),
-                tr("Вас отключил администратор")
-            });
-            target->disconnectFromServer();
+        auto *target = findClientByName(targetName);
+        if (target != nullptr || m_presence.containsRemote(targetName)) {
+            // Пользователь на другом узле отключается там же
+            disconnectByAdmin(target, tr("Вас отключил администратор"));
+            if (m_presence.containsRemote(targetName)) {
+                m_cluster.relay(ClusterEvent::Command, encodeAdminCommand(QStringLiteral("kick"), targetName));
+            }
             sender->sendMessage(ChatMessage{
                 QStringLiteral("SERVER"),
                 tr("Пользователь %1 отключён").arg(targetName)
@@ -369,14 +1381,9 @@ bool ChatServer::handleAdminCommand(const ChatMessage &message, ClientConnection
             });
             return true;
         }
-        m_bannedUsers.insert(targetName);
-        if (auto *target = findClientByName(targetName)) {
-            target->sendMessage(ChatMessage{
-                QStringLiteral("SERVER"),
-                tr("Вы заблокированы администратором")
-            });
-            target->disconnectFromServer();
-        }
+        setBanned(targetName, true);
+        disconnectByAdmin(findClientByName(targetName), tr("Вы заблокированы администратором"));
+        m_cluster.relay(ClusterEvent::Command, encodeAdminCommand(QStringLiteral("ban"), targetName));
         sender->sendMessage(ChatMessage{
             QStringLiteral("SERVER"),
             tr("Пользователь %1 заблокирован").arg(targetName)
@@ -397,7 +1404,8 @@ bool ChatServer::handleAdminCommand(const ChatMessage &message, ClientConnection
             });
             return true;
         }
-        m_bannedUsers.remove(targetName);
+        setBanned(targetName, false);
+        m_cluster.relay(ClusterEvent::Command, encodeAdminCommand(QStringLiteral("unban"), targetName));
         sender->sendMessage(ChatMessage{
             QStringLiteral("SERVER"),
             tr("Пользователь %1 разблокирован").arg(targetName)
@@ -422,112 +1430,299 @@ ClientConnection *ChatServer::findClientByName(const QString &name) const
     return nullptr;
 }
 
-void ChatServer::saveMessageToLog(const ChatMessage &message)
+void ChatServer::saveMessageToLog(const ChatRoom &room, const ChatMessage &message)
 {
-    // Открываем файл лога для записи
-    QFile logFile(m_logFilePath);
-    bool opened = logFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
-    if (opened == false) {
-        qCWarning(chatServerCore) << "Не удалось открыть файл лога для записи:" << m_logFilePath;
+    // Файл лога открыт на всё время сессии
+    if (m_logFile.isOpen() == false) {
         return;
     }
     
-    // Записываем сообщение в лог
-    QTextStream stream(&logFile);
+    // Строка собирается в переиспользуемом буфере, поэтому запись не выделяет память
+    const QDateTime localTime = message.timestamp().toLocalTime();
+    const QDate date = localTime.date();
+    const QTime time = localTime.time();
+    const QString &roomName = room.name();
+    const QString &sender = message.sender();
+    const QString &text = message.text();
     
-    QDateTime timestamp = message.timestamp();
-    QDateTime localTime = timestamp.toLocalTime();
-    QString timeString = localTime.toString("yyyy-MM-dd hh:mm:ss");
-    QString sender = message.sender();
-    QString text = message.text();
+    char prefix[48];
+    int prefixLength = std::snprintf(prefix, sizeof(prefix), "[%04d-%02d-%02d %02d:%02d:%02d] ",
+                                     date.year(), date.month(), date.day(),
+                                     time.hour(), time.minute(), time.second());
+    prefixLength = qBound(0, prefixLength, int(sizeof(prefix)) - 1);
     
-    stream << "[" << timeString << "] <" << sender << "> " << text << "\n";
+    // Строка лога: [время] #комната <отправитель> текст
+    const qsizetype capacity =
+        prefixLength + m_logEncoder.requiredSpace(roomName.size() + sender.size() + text.size()) + 6;
+    m_logLine.resize(capacity);
+    char *out = m_logLine.data();
+    std::memcpy(out, prefix, size_t(prefixLength));
+    out += prefixLength;
+    *out++ = '#';
+    out = m_logEncoder.appendToBuffer(out, roomName);
+    *out++ = ' ';
+    *out++ = '<';
+    out = m_logEncoder.appendToBuffer(out, sender);
+    *out++ = '>';
+    *out++ = ' ';
+    out = m_logEncoder.appendToBuffer(out, text);
+    *out++ = '\n';
+    m_logLine.truncate(out - m_logLine.constData());
     
-    logFile.close();
+    if (m_logFile.write(m_logLine) == -1) {
+        qCWarning(chatServerCore) << "Не удалось записать в файл лога:" << m_logFile.errorString();
+    }
+}
+
+void ChatServer::addMessageToHistory(ChatRoom &room, const ChatMessage &message, const QByteArray &frame)
+{
+    // История сама следит за лимитами по объёму и количеству сообщений;
+    // кадр разделяется с уже выполненной рассылкой без копирования
+    MessageHistory &history = room.history();
+    history.append(message, frame);
+    m_replicaFeed.publish(room.name());
 }
 
-void ChatServer::addMessageToHistory(const ChatMessage &message)
+void ChatServer::sendMessageHistory(ClientConnection *client, ChatRoom &room)
 {
-    m_messageHistory.push_back(message);
+    // Проверяем, что клиент существует и есть история
+    const MessageHistory &history = room.history();
+    if (client == nullptr || history.isEmpty()) {
+        return;
+    }
     
-    // Ограничиваем размер истории
-    if (m_messageHistory.size() > kMaxHistorySize) {
-        m_messageHistory.pop_front();
+    qsizetype historySize = history.size();
+    qCInfo(chatServerCore) << "Отправка истории комнаты" << room.name() << "из" << historySize
+                           << "сообщений пользователю" << client->userName();
+    
+    // Маркеры начала и конца кэшируются и пересобираются только при смене
+    // комнаты или размера истории или раз в секунду, чтобы время в них оставалось актуальным
+    const qint64 nowSecs = QDateTime::currentSecsSinceEpoch();
+    if (m_historyStartFrame.room != &room || m_historyStartFrame.key != historySize
+        || m_historyStartFrame.builtAtSecs != nowSecs) {
+        ChatMessage startMsg("SERVER",
+                             tr("--- История комнаты %1 (%2 сообщений) ---").arg(room.name()).arg(historySize));
+        m_historyStartFrame = CachedFrame{ClientConnection::encodeFrame(startMsg), &room, historySize, nowSecs};
     }
+    
+    // Сама история уходит порциями по мере освобождения буфера сокета:
+    // на медленном канале в памяти сервера лежит не больше одной порции
+    client->sendFrame(m_historyStartFrame.frame);
+    m_historyReplays.insert(client, HistoryReplay{&room, history.firstSeq(), history.endSeq()});
+    client->setDrainNotification(true);
+    continueHistoryReplay(client);
 }
 
-void ChatServer::sendMessageHistory(ClientConnection *client)
+void ChatServer::onConnectionDrained(ClientConnection *connection)
 {
-    // Проверяем, что клиент существует и есть история
-    if (client == nullptr || m_messageHistory.empty()) {
+    continueHistoryReplay(connection);
+}
+
+void ChatServer::continueHistoryReplay(ClientConnection *client)
+{
+    auto it = m_historyReplays.find(client);
+    if (it == m_historyReplays.end()) {
+        client->setDrainNotification(false);
+        return;
+    }
+    
+    // flush() на пути sendfile может синхронно вызвать этот же метод — вложенный вызов пропускаем
+    if (it->writing) {
         return;
     }
+    it->writing = true;
     
-    int historySize = m_messageHistory.size();
-    qCInfo(chatServerCore) << "Отправка истории из" << historySize << "сообщений пользователю" << client->userName();
+    // Сообщения, вытесненные из истории за время отправки, пропускаем
+    MessageHistory &history = it->room->history();
+    quint64 nextSeq = std::max(it->nextSeq, history.firstSeq());
+    const quint64 endSeq = it->endSeq;
     
-    // Отправляем системное сообщение о начале истории
-    QString startMessage = tr("--- История сообщений (%1 сообщений) ---").arg(historySize);
-    ChatMessage startMsg("SERVER", startMessage);
-    client->sendMessage(startMsg);
+    // Живые сообщения пишутся в сокет сразу, история — только пока буфер ниже порога
+    while (nextSeq < endSeq && client->pendingBytes() < kReplayLowWatermark) {
+        nextSeq = sendHistoryChunk(client, history, nextSeq, endSeq, kReplayChunkBytes);
+        if (m_historyReplays.contains(client) == false) {
+            // Соединение закрылось во время записи
+            return;
+        }
+    }
     
-    // Отправляем все сообщения из истории
-    for (const ChatMessage &msg : m_messageHistory) {
-        client->sendMessage(msg);
+    it = m_historyReplays.find(client);
+    it->writing = false;
+    it->nextSeq = nextSeq;
+    if (nextSeq < endSeq) {
+        return;
     }
     
-    // Отправляем системное сообщение о конце истории
-    QString endMessage = tr("--- Конец истории ---");
-    ChatMessage endMsg("SERVER", endMessage);
-    client->sendMessage(endMsg);
+    const qint64 nowSecs = QDateTime::currentSecsSinceEpoch();
+    if (m_historyEndFrame.builtAtSecs != nowSecs) {
+        ChatMessage endMsg("SERVER", tr("--- Конец истории ---"));
+        m_historyEndFrame = CachedFrame{ClientConnection::encodeFrame(endMsg), nullptr, 0, nowSecs};
+    }
+    client->sendFrame(m_historyEndFrame.frame);
+    // Счётчики реакций — после истории, когда сообщения, к которым они относятся, у клиента уже есть
+    if (client->usesControlFrames()) {
+        for (const ControlMessage &reactions : it->room->reactionSnapshot()) {
+            client->sendControl(reactions);
+        }
+    }
+    m_historyReplays.erase(it);
+    client->setDrainNotification(false);
 }
 
-void ChatServer::sendUserList(ClientConnection *client)
+quint64 ChatServer::sendHistoryChunk(ClientConnection *client, MessageHistory &history, quint64 fromSeq,
+                                     quint64 endSeq, qint64 maxBytes)
 {
-    // Проверяем, что клиент существует
-    if (client == nullptr) {
-        return;
+    // В участках сегментов и общих пакетах есть все сообщения, поэтому клиенту,
+    // который кого-то заблокировал, история собирается отдельно
+    if (m_blocks.blockedCount(client->userName()) > 0) {
+        return sendFilteredHistory(client, history, fromSeq, endSeq, maxBytes);
     }
+    if (client->capabilities().has(SessionCapabilities::HistoryBatch)) {
+        return sendHistoryBatch(client, history, fromSeq, endSeq);
+    }
+    
+    // Участок сегмента на диске уходит в сокет напрямую, без копирования через память процесса
+    const MessageHistory::DiskRange range = history.diskRange(fromSeq, endSeq, maxBytes);
+    qint64 sent = client->sendFileRange(range.fileDescriptor, range.offset, range.length);
+    
+    // Всё, что не удалось передать напрямую, дописываем обычной записью из кадров в памяти
+    for (quint64 seq = fromSeq; seq < range.endSeq; ++seq) {
+        const QByteArray &frame = history.entry(seq).frame;
+        if (sent >= frame.size()) {
+            sent -= frame.size();
+            continue;
+        }
+        client->sendFrame(sent > 0 ? frame.sliced(sent) : frame);
+        sent = 0;
+    }
+    return range.endSeq;
+}
+
+quint64 ChatServer::sendHistoryBatch(ClientConnection *client, MessageHistory &history, quint64 fromSeq, quint64 endSeq)
+{
+    // Пакеты выровнены по блокам истории: полный блок кодируется один раз
+    // и дальше отдаётся всем входящим клиентам из кэша
+    const quint64 block = fromSeq / MessageHistory::kBatchSize;
+    const quint64 blockStart = block * MessageHistory::kBatchSize;
+    const quint64 blockEnd = blockStart + MessageHistory::kBatchSize;
+    const quint64 chunkEnd = std::min(blockEnd, endSeq);
+    const bool wholeBlock = (fromSeq == blockStart && chunkEnd == blockEnd);
     
-    // Собираем список пользователей
-    QStringList userList;
-    QHash<QString, ClientConnection *>::iterator it = m_clientsByName.begin();
-    while (it != m_clientsByName.end()) {
-        ClientConnection *conn = it.value();
-        if (conn != nullptr && conn->isAuthenticated()) {
-            QString userName = it.key();
-            userList.append(userName);
+    // Пакет больше предела клиента уходит отдельными кадрами
+    const quint32 maxFrameSize = client->capabilities().maxFrameSize();
+    const auto fits = [maxFrameSize](const QByteArray &frame) {
+        return maxFrameSize == 0 || frame.size() <= qsizetype(maxFrameSize);
+    };
+    
+    const QByteArray *cached = wholeBlock ? history.cachedBatch(block) : nullptr;
+    QByteArray batch;
+    if (cached != nullptr) {
+        batch = *cached;
+    } else {
+        batch = ClientConnection::encodeBatchFrame(history.messages(fromSeq, chunkEnd));
+        if (wholeBlock) {
+            // Кэш разделяет данные с локальной копией (неявное разделение Qt)
+            history.cacheBatch(block, batch);
         }
-        ++it;
     }
     
-    // Формируем строку со списком пользователей
-    QString userListStr = "USER_LIST:" + userList.join(",");
-    ChatMessage msg("SERVER", userListStr);
-    client->sendMessage(msg);
+    if (fits(batch)) {
+        client->sendFrame(batch);
+    } else {
+        for (quint64 seq = fromSeq; seq < chunkEnd; ++seq) {
+            client->sendFrame(history.entry(seq).frame);
+        }
+    }
+    return chunkEnd;
 }
 
-void ChatServer::broadcastUserList()
+quint64 ChatServer::sendFilteredHistory(ClientConnection *client, MessageHistory &history, quint64 fromSeq,
+                                        quint64 endSeq, qint64 maxBytes)
 {
-    // Собираем список всех авторизованных пользователей
-    QStringList userList;
-    for (auto it = m_clientsByName.begin(); it != m_clientsByName.end(); ++it) {
-        ClientConnection *conn = it.value();
-        if (conn != nullptr && conn->isAuthenticated()) {
-            QString userName = it.key();
-            userList.append(userName);
+    const SenderTable &senders = history.senders();
+    const quint32 userId = client->userId();
+    const auto hidden = [&](const MessageHistory::Entry &entry) {
+        const QBitArray *blockers = m_blocks.blockersOf(senders.name(entry.message.senderId()));
+        return blockers != nullptr && BlockLists::isInMask(*blockers, userId);
+    };
+    
+    if (client->capabilities().has(SessionCapabilities::HistoryBatch)) {
+        // Границы те же, что у общих пакетов, но пакет только для этого клиента и в кэш не попадает
+        const quint64 blockEnd = (fromSeq / MessageHistory::kBatchSize + 1) * MessageHistory::kBatchSize;
+        const quint64 chunkEnd = std::min(blockEnd, endSeq);
+        QList<ChatMessage> messages;
+        for (quint64 seq = fromSeq; seq < chunkEnd; ++seq) {
+            const MessageHistory::Entry &entry = history.entry(seq);
+            if (!hidden(entry)) {
+                messages.append(entry.message.toChatMessage(senders));
+            }
+        }
+        if (messages.isEmpty()) {
+            return chunkEnd;
+        }
+        
+        const QByteArray batch = ClientConnection::encodeBatchFrame(messages);
+        const quint32 maxFrameSize = client->capabilities().maxFrameSize();
+        if (maxFrameSize == 0 || batch.size() <= qsizetype(maxFrameSize)) {
+            client->sendFrame(batch);
+            return chunkEnd;
+        }
+        for (quint64 seq = fromSeq; seq < chunkEnd; ++seq) {
+            const MessageHistory::Entry &entry = history.entry(seq);
+            if (!hidden(entry)) {
+                client->sendFrame(entry.frame);
+            }
+        }
+        return chunkEnd;
+    }
+    
+    // Пропущенные записи тоже идут в счёт порции, чтобы один вызов не обходил всю историю
+    quint64 seq = fromSeq;
+    qint64 scanned = 0;
+    while (seq < endSeq && scanned < maxBytes) {
+        const MessageHistory::Entry &entry = history.entry(seq++);
+        scanned += entry.frame.size();
+        if (!hidden(entry)) {
+            client->sendFrame(entry.frame);
         }
     }
+    return seq;
+}
+
+void ChatServer::sendUserList(ClientConnection *client)
+{
+    // Проверяем, что клиент существует
+    if (client == nullptr) {
+        return;
+    }
     
-    // Формируем сообщение со списком пользователей
-    QString userListStr = "USER_LIST:" + userList.join(",");
-    ChatMessage systemMessage("SERVER", userListStr);
+    client->sendControl(ControlMessage::userList(userList()));
+}
+
+void ChatServer::broadcastUserList()
+{
+    // Кадр кодируется один раз; текстовая форма — только если есть старые клиенты
+    const ControlMessage control = ControlMessage::userList(userList());
+    const QByteArray frame = control.encodeFrame();
+    QByteArray legacyFrame;
     
     // Отправляем всем авторизованным клиентам
     for (ClientConnection *client : m_clients) {
-        if (client != nullptr && client->isAuthenticated()) {
-            client->sendMessage(systemMessage);
+        if (client == nullptr || client->isAuthenticated() == false) {
+            continue;
         }
+        if (client->usesControlFrames()) {
+            client->sendFrame(frame);
+            continue;
+        }
+        if (legacyFrame.isEmpty()) {
+            legacyFrame = ClientConnection::encodeFrame(ChatMessage{QStringLiteral("SERVER"), control.legacyText()});
+        }
+        client->sendFrame(legacyFrame);
     }
 }
 
+QStringList ChatServer::userList() const
+{
+    return m_presence.users();
+}
@@ -1,26 +1,50 @@
 #pragma once
 
 #include "UserStore.h"
+#include "BlockLists.h"
 #include "ChatMessage.h"
+#include "ChatRoom.h"
+#include "ClusterRelay.h"
+#include "ControlMessage.h"
+#include "IClusterSink.h"
+#include "IMessageSink.h"
+#include "IReplicaSink.h"
+#include "MailboxStore.h"
+#include "MessageHistory.h"
+#include "OutboundExecutor.h"
+#include "PresenceDirectory.h"
+#include "ReplicaFeed.h"
+#include "SessionCapabilities.h"
+#include "StandbyReplica.h"
 
 #include <QTcpServer>
+#include <QTimer>
+#include <QByteArray>
+#include <QFile>
 #include <QHash>
 #include <QSet>
 #include <QString>
+#include <QStringList>
+#include <QStringEncoder>
+#include <array>
+#include <memory>
 #include <vector>
-#include <deque>
 
 class ClientConnection;
 
-class ChatServer final : public QTcpServer {
+class ChatServer final : public QTcpServer, private IMessageSink, private IClusterSink, private IReplicaSink {
   Q_OBJECT
 
 public:
   explicit ChatServer(QObject *parent = nullptr);
 
+  // С KUKARACHA_STANDBY_OF сервер стартует резервным и слушает порт только после повышения.
   bool start(quint16 port);
   void stop();
 
+  // Текущий объём истории в байтах (для мониторинга).
+  [[nodiscard]] qsizetype historyBytes() const;
+
 signals:
   void serverError(const QString &message);
 
@@ -28,23 +52,144 @@ protected:
   void incomingConnection(qintptr socketDescriptor) override;
 
 private:
-  void onMessageReceived(const ChatMessage &message, ClientConnection *sender);
+  using ControlHandler = void (ChatServer::*)(const ControlMessage &message, ClientConnection *sender);
+  // Обработчики управляющих кадров по ControlKind; nullptr — вид не ожидается от клиента.
+  static const std::array<ControlHandler, std::size_t(ControlKind::Count)> kControlHandlers;
+
+  void onMessageReceived(ChatMessage &&message, ClientConnection *sender) override;
+  void onControlReceived(ControlMessage &&message, ClientConnection *sender) override;
+  void handleHello(const ControlMessage &message, ClientConnection *sender);
+  void handleLogin(const ControlMessage &message, ClientConnection *sender);
+  void handleDirect(const ControlMessage &message, ClientConnection *sender);
+  void handleTyping(const ControlMessage &message, ClientConnection *sender);
+  // Отметка о наборе текста уходит подписчикам комнаты на ближайшем такте, а не сразу.
+  void scheduleTyping(ChatRoom &room);
+  void flushTyping();
+  void handleReact(const ControlMessage &message, ClientConnection *sender);
+  // Счётчики реакций уходят подписчикам одним кадром на сообщение за интервал.
+  void flushReactions();
+  void handleAuthentication(const QString &requestedName, const QString &password, ClientConnection *sender);
   void onConnectionClosed(ClientConnection *connection);
-  void broadcastSystemMessage(const QString &text);
+  void broadcastSystemMessage(ChatRoom &room, const QString &text);
+  // Рассылка подписчикам одной комнаты.
+  void broadcastMessage(const ChatRoom &room, const ChatMessage &message, const QByteArray &frame);
+  bool handleRoomCommand(const ChatMessage &message, ClientConnection *sender);
+  // /msg <пользователь> <текст> — то же, что кадр Direct, для клиентов без управляющих кадров.
+  bool handleDirectCommand(const ChatMessage &message, ClientConnection *sender);
+  // /block, /unblock и /blocks.
+  bool handleBlockCommand(const ChatMessage &message, ClientConnection *sender);
+  // Личное сообщение: получателю и копия отправителю, мимо истории, лога и кластера.
+  void sendDirectMessage(ClientConnection *sender, const QString &recipientName, const QString &text);
+  // Личные сообщения, пришедшие, пока пользователь был не в сети, одним пакетом.
+  void deliverMailbox(ClientConnection *client);
   bool handleAdminCommand(const ChatMessage &message, ClientConnection *sender);
   ClientConnection *findClientByName(const QString &name) const;
-  void saveMessageToLog(const ChatMessage &message);
-  void sendMessageHistory(ClientConnection *client);
-  void addMessageToHistory(const ChatMessage &message);
+  void saveMessageToLog(const ChatRoom &room, const ChatMessage &message);
+  void sendMessageHistory(ClientConnection *client, ChatRoom &room);
+  void onConnectionDrained(ClientConnection *connection) override;
+  void continueHistoryReplay(ClientConnection *client);
+  quint64 sendHistoryChunk(ClientConnection *client, MessageHistory &history, quint64 fromSeq, quint64 endSeq,
+                           qint64 maxBytes);
+  quint64 sendHistoryBatch(ClientConnection *client, MessageHistory &history, quint64 fromSeq, quint64 endSeq);
+  // История без сообщений тех, кого клиент заблокировал: кадрами из памяти, без sendfile и кэша пакетов.
+  quint64 sendFilteredHistory(ClientConnection *client, MessageHistory &history, quint64 fromSeq, quint64 endSeq,
+                              qint64 maxBytes);
+  void addMessageToHistory(ChatRoom &room, const ChatMessage &message, const QByteArray &frame);
   void sendUserList(ClientConnection *client);
   void broadcastUserList();
+  // Пользователи всех узлов кластера
+  [[nodiscard]] QStringList userList() const;
+
+  // Комнаты живут до остановки сервера, поэтому указатели на них не протухают.
+  void loadRooms();
+  [[nodiscard]] ChatRoom &defaultRoom() const;
+  // Имя должно быть уже нормализовано (ChatRoom::normalizedName).
+  ChatRoom &findOrCreateRoom(const QString &name);
+  // Комната для сообщения с другого узла или основного сервера: новая заводится только
+  // в пределах лимита комнат, иначе nullptr и сообщение отбрасывается.
+  ChatRoom *findOrCreateRemoteRoom(const QString &name);
+  // Комната клиента или nullptr, если он ещё не вошёл.
+  [[nodiscard]] ChatRoom *roomOf(ClientConnection *client) const;
+  void joinRoom(ClientConnection *client, ChatRoom &room);
+  void leaveRoom(ClientConnection *client);
+
+  void onRelayedMessage(const QString &room, ChatMessage &&message, const QByteArray &frame) override;
+  void onClusterEvent(ClusterEvent kind, const QString &origin, const QByteArray &payload) override;
+  void onNodeJoined(const QString &nodeId) override;
+  void onNodeLost(const QString &nodeId) override;
+  void mergePresence(const QByteArray &payload);
+  // Повтор своей записи каталога и потеря записей, которые давно не приходили.
+  void refreshPresence();
+  void handleClusterCommand(const QByteArray &payload);
+  void setBanned(const QString &name, bool banned);
+
+  bool startServices();
+  void onReplicaReset() override;
+  void onReplicatedMessage(const QString &room, ChatMessage &&message, const QByteArray &frame) override;
+  void onReplicatedBans(const QStringList &bans) override;
+  void onPromoted() override;
+  void disconnectByAdmin(ClientConnection *target, const QString &reason);
 
   std::vector<ClientConnection *> m_clients;
+  // Замеры кучи на подключение (см. incomingConnection)
+  qint64 m_idleHeapBytes = 0;
+  qint64 m_idleHeapSamples = 0;
+  bool m_idleHeapWarned = false;
   QHash<QString, ClientConnection *> m_clientsByName;
   UserStore m_userStore;
+  MailboxStore m_mailboxes;
+  BlockLists m_blocks;
   bool m_allowRegistration = false;
   QSet<QString> m_bannedUsers;
-  std::deque<ChatMessage> m_messageHistory;
-  static constexpr size_t kMaxHistorySize = 1000;
+  qsizetype m_historyMaxBytes;
+  qsizetype m_historyMaxMessages;
+  int m_maxRooms;
+  // Предупреждение об отброшенных сообщениях для комнат сверх лимита пишется один раз
+  bool m_remoteRoomLimitWarned = false;
+  // Первая комната — комната по умолчанию, она есть всегда
+  std::vector<std::unique_ptr<ChatRoom>> m_rooms;
+  QHash<QString, ChatRoom *> m_roomsByName;
+  // Комната авторизованного клиента и его место в списке её подписчиков
+  struct Membership {
+    ChatRoom *room = nullptr;
+    qsizetype slot = -1;
+  };
+  QHash<ClientConnection *, Membership> m_memberships;
+  bool m_batchHistory = true;
+  SessionCapabilities m_capabilities;
+  ClusterRelay m_cluster;
+  PresenceDirectory m_presence;
+  ReplicaFeed m_replicaFeed;
+  StandbyReplica m_standby;
+  OutboundExecutor m_outbound;
+  // Комнаты, где кто-то печатает или список ещё не разослан; таймер идёт только пока они есть
+  QSet<ChatRoom *> m_typingRooms;
+  QTimer m_typingTimer;
+  // Комнаты с неразосланными изменениями реакций
+  QSet<ChatRoom *> m_reactionRooms;
+  QTimer m_reactionTimer;
+  QTimer m_presenceTimer;
+  quint16 m_port = 0;
+
+  struct CachedFrame {
+    QByteArray frame;
+    const ChatRoom *room = nullptr;
+    qsizetype key = -1;
+    qint64 builtAtSecs = 0;
+  };
+  CachedFrame m_historyStartFrame;
+  CachedFrame m_historyEndFrame;
+
+  // Курсор отправки истории клиенту: [nextSeq, endSeq) ещё не отправлены.
+  struct HistoryReplay {
+    ChatRoom *room = nullptr;
+    quint64 nextSeq = 0;
+    quint64 endSeq = 0;
+    bool writing = false;
+  };
+  QHash<ClientConnection *, HistoryReplay> m_historyReplays;
   QString m_logFilePath;
+  QFile m_logFile;
+  QByteArray m_logLine;
+  QStringEncoder m_logEncoder{QStringEncoder::Utf8};
 };
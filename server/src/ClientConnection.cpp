@@ -1,42 +1,286 @@
 #include "ClientConnection.h"
 
 #include "ChatMessage.h"
+#include "ControlMessage.h"
+#include "FrameType.h"
+#include "HeaderCompression.h"
+#include "JsonCodec.h"
+#include "JsonMessageSerializer.h"
+#include "OutboundExecutor.h"
+#include "SessionEncoder.h"
+#include "SlabPool.h"
+#include "StreamCompression.h"
+#include "TextSanitizer.h"
 
-#include <QHostAddress>
 #include <QLoggingCategory>
 #include <utility>
 
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <sys/sendfile.h>
+#endif
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define KUKARACHA_HAVE_MALLINFO2 1
+#endif
+
 Q_LOGGING_CATEGORY(chatServer, "kukaracha.server")
 
-ClientConnection::ClientConnection(QTcpSocket *socket, QObject *parent)
+static_assert(sizeof(ClientConnection) <= ClientConnection::kIdleFootprintBudget,
+              "ClientConnection exceeds the idle connection memory budget");
+
+namespace {
+// Сериализатор не хранит состояния, поэтому один экземпляр обслуживает все соединения.
+const JsonMessageSerializer kSerializer;
+
+SlabPool<ClientConnection> &connectionPool()
+{
+    static SlabPool<ClientConnection> pool;
+    return pool;
+}
+
+int g_compressionLevel = 0;
+quint32 g_nextOrdinal = 0;
+OutboundExecutor *g_outboundExecutor = nullptr;
+} // namespace
+
+ClientConnection::ClientConnection(IMessageSink *sink, QObject *parent)
     : QObject(parent)
-    , m_socket(socket)
+    , m_sink(sink)
+    , m_ordinal(g_nextOrdinal++)
+{
+    Q_ASSERT(m_sink);
+
+    connect(&m_socket, &QTcpSocket::readyRead, this, &ClientConnection::handleReadyRead);
+    connect(&m_socket, &QTcpSocket::disconnected, this, &ClientConnection::handleDisconnected);
+}
+
+ClientConnection::~ClientConnection()
+{
+    // Сокет — член класса и разрушается последним; его abort() испустил бы disconnected
+    // в уже разобранный объект, поэтому отвязываемся и закрываем его заранее
+    m_socket.disconnect(this);
+    m_socket.abort();
+}
+
+void *ClientConnection::operator new(std::size_t size)
+{
+    Q_ASSERT(size == sizeof(ClientConnection));
+    Q_UNUSED(size)
+    return connectionPool().allocate();
+}
+
+void ClientConnection::operator delete(void *pointer) noexcept
+{
+    connectionPool().deallocate(pointer);
+}
+
+std::size_t ClientConnection::pooledConnections()
+{
+    return connectionPool().slotsInUse();
+}
+
+std::size_t ClientConnection::pooledBytes()
+{
+    return connectionPool().bytesReserved();
+}
+
+qint64 ClientConnection::heapBytesInUse()
+{
+#if defined(KUKARACHA_HAVE_MALLINFO2)
+    const struct mallinfo2 info = mallinfo2();
+    return qint64(info.uordblks + info.hblkhd);
+#else
+    return -1;
+#endif
+}
+
+void ClientConnection::setCompressionLevel(int level)
+{
+    g_compressionLevel = qBound(0, level, 9);
+}
+
+int ClientConnection::compressionLevel()
+{
+    return g_compressionLevel;
+}
+
+void ClientConnection::setOutboundExecutor(OutboundExecutor *executor)
 {
-    Q_ASSERT(m_socket);
+    g_outboundExecutor = executor;
+}
+
+bool ClientConnection::setSocketDescriptor(qintptr socketDescriptor)
+{
+    return m_socket.setSocketDescriptor(socketDescriptor);
+}
+
+QHostAddress ClientConnection::peerAddress() const
+{
+    return m_socket.peerAddress();
+}
+
+QString ClientConnection::errorString() const
+{
+    return m_socket.errorString();
+}
 
-    connect(m_socket, &QTcpSocket::readyRead, this, &ClientConnection::handleReadyRead);
-    connect(m_socket, &QTcpSocket::disconnected, this, &ClientConnection::handleDisconnected);
+QByteArray ClientConnection::encodeFrame(const ChatMessage &message)
+{
+    auto frame = JsonCodec<ChatMessage>::encode(message);
+    frame.append('\n');
+    return frame;
+}
+
+QByteArray ClientConnection::encodeBatchFrame(const QList<ChatMessage> &messages)
+{
+    QByteArray frame(1, static_cast<char>(FrameType::HistoryBatch));
+    frame.append(kSerializer.serializeBatch(messages));
+    frame.append('\n');
+    return frame;
 }
 
 void ClientConnection::sendMessage(const ChatMessage &message)
 {
-    const auto payload = m_serializer.serialize(message);
-    auto framedPayload = payload;
-    framedPayload.append('\n');
-    const auto bytesWritten = m_socket->write(framedPayload);
+    sendChatMessage(message, encodeFrame(message),
+                    hasHeaderCompression() ? HeaderEncoder::encodeText(message.text()) : QByteArray());
+}
+
+void ClientConnection::sendFrame(const QByteArray &frame)
+{
+    if (m_session == nullptr) {
+        writeToSocket(frame);
+    } else if (g_outboundExecutor && g_outboundExecutor->isParallel()) {
+        g_outboundExecutor->sendFrame(this, frame);
+    } else {
+        writeToSocket(m_session->encodeFrame(frame));
+    }
+}
+
+void ClientConnection::sendControl(const ControlMessage &message)
+{
+    if (usesControlFrames()) {
+        sendFrame(message.encodeFrame());
+    } else {
+        sendMessage(ChatMessage{QStringLiteral("SERVER"), message.legacyText()});
+    }
+}
+
+void ClientConnection::sendChatMessage(const ChatMessage &message, const QByteArray &frame,
+                                       const QByteArray &encodedText)
+{
+    if (m_session == nullptr) {
+        writeToSocket(frame);
+    } else if (g_outboundExecutor && g_outboundExecutor->isParallel()) {
+        g_outboundExecutor->sendChatMessage(this, message, frame, encodedText);
+    } else {
+        writeToSocket(m_session->encodeChatMessage(message, frame, encodedText));
+    }
+}
+
+void ClientConnection::writeToSocket(const QByteArray &bytes)
+{
+    const auto bytesWritten = m_socket.write(bytes);
     if (bytesWritten == -1) {
-        qCWarning(chatServer) << "Failed to write to client" << m_socket->peerAddress() << m_socket->errorString();
+        qCWarning(chatServer) << "Failed to write to client" << m_socket.peerAddress() << m_socket.errorString();
+    }
+}
+
+void ClientConnection::completeOutbound(const QByteArray &bytes, qint64 accounted)
+{
+    m_session->finishOutbound(accounted);
+    const bool drained = m_session->bytesInFlight() == 0;
+
+    // Сокет уже закрыт, соединение ждало только последних кадров
+    if (m_session->isClosed()) {
+        if (drained) {
+            deleteLater();
+        }
+        return;
+    }
+
+    writeToSocket(bytes);
+    if (drained && m_session->isDisconnectRequested()) {
+        disconnectFromServer();
+    }
+}
+
+qint64 ClientConnection::sendFileRange(int fileDescriptor, qint64 offset, qint64 length)
+{
+#if defined(Q_OS_LINUX)
+    if (fileDescriptor < 0 || length <= 0 || isCompressed() || (m_session && m_session->bytesInFlight() > 0)
+        || m_socket.state() != QAbstractSocket::ConnectedState) {
+        return 0;
+    }
+
+    // Писать мимо Qt можно только при пустом буфере сокета, иначе нарушится порядок кадров
+    if (m_socket.bytesToWrite() > 0) {
+        m_socket.flush();
+        if (m_socket.bytesToWrite() > 0) {
+            return 0;
+        }
+    }
+
+    const int socketDescriptor = int(m_socket.socketDescriptor());
+    off_t position = off_t(offset);
+    qint64 sent = 0;
+    while (sent < length) {
+        const auto result = ::sendfile(socketDescriptor, fileDescriptor, &position, size_t(length - sent));
+        if (result > 0) {
+            sent += result;
+            continue;
+        }
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        // EAGAIN: буфер ядра заполнен, остаток уйдёт обычной записью через Qt
+        break;
     }
+    return sent;
+#else
+    Q_UNUSED(fileDescriptor)
+    Q_UNUSED(offset)
+    Q_UNUSED(length)
+    return 0;
+#endif
 }
 
 void ClientConnection::disconnectFromServer()
 {
-    if (!m_socket) {
+    // Кадры в рабочем потоке уйдут первыми, отключение — после последнего из них
+    if (m_session && m_session->bytesInFlight() > 0) {
+        m_session->requestDisconnect();
         return;
     }
+    if (m_socket.state() != QAbstractSocket::UnconnectedState) {
+        m_socket.disconnectFromHost();
+    }
+}
+
+qint64 ClientConnection::pendingBytes() const
+{
+    return m_socket.bytesToWrite() + (m_session ? m_session->bytesInFlight() : 0);
+}
+
+bool ClientConnection::isCompressed() const
+{
+    return m_session && m_session->isCompressed();
+}
+
+bool ClientConnection::hasHeaderCompression() const
+{
+    return m_session && m_session->hasHeaderCompression();
+}
 
-    if (m_socket->state() != QAbstractSocket::UnconnectedState) {
-        m_socket->disconnectFromHost();
+void ClientConnection::setDrainNotification(bool enabled)
+{
+    // Подписка держится только пока она нужна, простаивающее соединение её не хранит
+    if (enabled) {
+        connect(&m_socket, &QTcpSocket::bytesWritten, this, &ClientConnection::handleBytesWritten,
+                Qt::UniqueConnection);
+    } else {
+        disconnect(&m_socket, &QTcpSocket::bytesWritten, this, &ClientConnection::handleBytesWritten);
     }
 }
 
@@ -55,6 +299,16 @@ void ClientConnection::setUserName(QString userName)
     m_userName = std::move(userName);
 }
 
+quint32 ClientConnection::userId() const
+{
+    return m_userId;
+}
+
+void ClientConnection::setUserId(quint32 userId)
+{
+    m_userId = userId;
+}
+
 bool ClientConnection::isAuthenticated() const
 {
     return m_authenticated;
@@ -65,32 +319,160 @@ void ClientConnection::setAuthenticated(bool authenticated)
     m_authenticated = authenticated;
 }
 
+bool ClientConnection::usesControlFrames() const
+{
+    return !m_capabilities.isLegacy();
+}
+
+const SessionCapabilities &ClientConnection::capabilities() const
+{
+    return m_capabilities;
+}
+
+bool ClientConnection::hasHandshake() const
+{
+    return !m_capabilities.isLegacy();
+}
+
+void ClientConnection::startSession(SessionCapabilities negotiated)
+{
+    Q_ASSERT(!negotiated.isLegacy());
+
+    std::unique_ptr<StreamCompression> compression;
+    if (negotiated.compression() == SessionCapabilities::Compression::Deflate) {
+        compression = std::make_unique<StreamCompression>(g_compressionLevel);
+        if (compression->isValid() == false) {
+            compression.reset();
+            negotiated.setCompression(SessionCapabilities::Compression::None);
+        }
+    }
+    const bool headerCompression = negotiated.has(SessionCapabilities::HeaderCompression);
+
+    // WELCOME уходит несжатым, всё после него — уже в согласованном виде
+    writeToSocket(negotiated.toWelcome(quint32(kMaxInboundFrameSize)).encodeFrame());
+    if (compression || headerCompression) {
+        m_session = std::make_unique<SessionEncoder>(std::move(compression), headerCompression);
+    }
+    m_capabilities = negotiated;
+}
+
 void ClientConnection::handleReadyRead()
 {
-    m_buffer.append(m_socket->readAll());
+    consumeBytes(m_socket.readAll());
+}
+
+void ClientConnection::consumeBytes(QByteArray data)
+{
+    if (!isCompressed()) {
+        splitFrames(std::move(data));
+        return;
+    }
+
+    // Распаковка идёт шагами по kInflateStep байт, и каждый шаг сразу делится на кадры:
+    // предел кадра применяется к хвосту без перевода строки, а не ко всей порции из сокета,
+    // и пара килобайт от анонима не раздувается в память целиком
+    qsizetype offset = 0;
+    while (true) {
+        QByteArray inflated;
+        const auto result = m_session->inflateStep(data, offset, inflated, kInflateStep);
+        if (result == StreamCompression::InflateResult::Error) {
+            qCWarning(chatServer) << "Corrupted compressed stream from client" << m_socket.peerAddress();
+            m_buffer.clear();
+            m_socket.abort();
+            return;
+        }
+        if (!inflated.isEmpty() && !splitFrames(std::move(inflated))) {
+            return;
+        }
+        if (result == StreamCompression::InflateResult::Finished) {
+            return;
+        }
+    }
+}
+
+bool ClientConnection::splitFrames(QByteArray data)
+{
+    // Буфер заполняется только хвостом неполного кадра, поэтому у простаивающего
+    // соединения он пуст и не держит памяти.
+    if (!m_buffer.isEmpty()) {
+        m_buffer.append(data);
+        data = std::exchange(m_buffer, QByteArray());
+    }
 
-    int newlineIndex = -1;
-    while ((newlineIndex = m_buffer.indexOf('\n')) != -1) {
-        const auto payload = m_buffer.left(newlineIndex);
-        m_buffer.remove(0, newlineIndex + 1);
-        processPayload(payload);
+    qsizetype start = 0;
+    qsizetype newlineIndex = -1;
+    while ((newlineIndex = data.indexOf('\n', start)) != -1) {
+        const bool wasCompressed = isCompressed();
+        processPayload(QByteArray::fromRawData(data.constData() + start, newlineIndex - start));
+        start = newlineIndex + 1;
+
+        // Сжатие включилось посреди порции: остаток уже идёт сжатым потоком
+        if (!wasCompressed && isCompressed()) {
+            if (start < data.size()) {
+                consumeBytes(data.sliced(start));
+            }
+            return false;
+        }
+    }
+
+    if (start == 0) {
+        m_buffer = std::move(data);
+    } else if (start < data.size()) {
+        m_buffer = data.sliced(start);
+    }
+
+    // Кадр без конца дальше предела не копим: клиент нарушает протокол
+    if (m_buffer.size() > kMaxInboundFrameSize) {
+        qCWarning(chatServer) << "Frame from client exceeds" << kMaxInboundFrameSize << "bytes" << m_socket.peerAddress();
+        m_buffer.clear();
+        m_socket.abort();
+        return false;
     }
+    return true;
 }
 
 void ClientConnection::handleDisconnected()
 {
     emit connectionClosed(this);
-    m_socket->deleteLater();
+    // Пока исполнитель кодирует кадры соединения, оно живо: удалится с последним из них
+    if (m_session && m_session->bytesInFlight() > 0) {
+        m_session->markClosed();
+        return;
+    }
     deleteLater();
 }
 
+void ClientConnection::handleBytesWritten()
+{
+    m_sink->onConnectionDrained(this);
+}
+
 void ClientConnection::processPayload(const QByteArray &payload)
 {
+    // Кадр с битым UTF-8 отбрасываем целиком, до разбора JSON
+    if (!TextSanitizer::isValidUtf8(payload)) {
+        qCWarning(chatServer) << "Invalid UTF-8 in frame from client" << m_socket.peerAddress();
+        return;
+    }
+
+    if (hasFrameType(payload, FrameType::Control)) {
+        ControlMessage control;
+        try {
+            control = ControlMessage::decode(payload);
+        } catch (const std::exception &error) {
+            qCWarning(chatServer) << "Failed to parse control frame from client" << error.what();
+            return;
+        }
+        m_sink->onControlReceived(std::move(control), this);
+        return;
+    }
+
+    ChatMessage message;
     try {
-        const auto message = m_serializer.deserialize(payload);
-        emit messageReceived(message);
+        message = JsonCodec<ChatMessage>::decode(payload);
     } catch (const std::exception &error) {
         qCWarning(chatServer) << "Failed to parse message from client" << error.what();
+        return;
     }
+    m_sink->onMessageReceived(std::move(message), this);
 }
-
@@ -1,45 +1,131 @@
 #pragma once
 
 #include "ChatMessage.h"
-#include "JsonMessageSerializer.h"
+#include "IMessageSink.h"
+#include "SessionCapabilities.h"
 
+#include <QHostAddress>
+#include <QList>
 #include <QObject>
 #include <QTcpSocket>
 #include <QString>
+#include <cstddef>
 #include <memory>
 
 class ChatMessage;
+class ControlMessage;
+class OutboundExecutor;
+class SessionEncoder;
 
 class ClientConnection final : public QObject {
     Q_OBJECT
 
 public:
-    explicit ClientConnection(QTcpSocket *socket, QObject *parent = nullptr);
+    // Предельный размер самого объекта (слот пула), проверяется static_assert в ClientConnection.cpp.
+    static constexpr std::size_t kIdleFootprintBudget = 128;
+    // Предельный расход кучи на простаивающее соединение вместе с приватными данными
+    // сокета; сервер измеряет его при каждом подключении и предупреждает о превышении.
+    static constexpr qint64 kIdleHeapBudget = 8 * 1024;
+    // Самый длинный кадр, который сервер принимает от клиента; сообщается в WELCOME.
+    static constexpr qsizetype kMaxInboundFrameSize = 256 * 1024;
+    // Сколько байт распаковывается за один шаг перед делением на кадры
+    static constexpr qsizetype kInflateStep = 16 * 1024;
+
+    explicit ClientConnection(IMessageSink *sink, QObject *parent = nullptr);
+    ~ClientConnection() override;
+
+    static void *operator new(std::size_t size);
+    static void operator delete(void *pointer) noexcept;
+    [[nodiscard]] static std::size_t pooledConnections();
+    [[nodiscard]] static std::size_t pooledBytes();
+    // Байты кучи, занятые процессом; -1 — аллокатор не сообщает.
+    [[nodiscard]] static qint64 heapBytesInUse();
+
+    // Уровень сжатия, который сервер применяет, если клиент согласовал deflate:
+    // 0 — сжатие выключено, 1 — меньше нагрузка на CPU, 9 — меньше трафик.
+    static void setCompressionLevel(int level);
+    [[nodiscard]] static int compressionLevel();
+    // Исполнитель, которому соединения с рукопожатием отдают кодирование кадров;
+    // nullptr или исполнитель без потоков — кодирование на месте.
+    static void setOutboundExecutor(OutboundExecutor *executor);
+
+    [[nodiscard]] bool setSocketDescriptor(qintptr socketDescriptor);
+    [[nodiscard]] QHostAddress peerAddress() const;
+    [[nodiscard]] QString errorString() const;
+
+    // Кадр — сериализованное сообщение с завершающим переводом строки.
+    [[nodiscard]] static QByteArray encodeFrame(const ChatMessage &message);
+    // Кадр-пакет с несколькими сообщениями истории (FrameType::HistoryBatch).
+    [[nodiscard]] static QByteArray encodeBatchFrame(const QList<ChatMessage> &messages);
 
     void sendMessage(const ChatMessage &message);
+    // Управляющий кадр, либо его текстовая форма от "SERVER" для клиентов без рукопожатия.
+    void sendControl(const ControlMessage &message);
+    void sendFrame(const QByteArray &frame);
+    // Сообщение чата при рассылке: со сжатыми заголовками, если они согласованы,
+    // иначе готовый кадр frame. encodedText — HeaderEncoder::encodeText(message.text()).
+    void sendChatMessage(const ChatMessage &message, const QByteArray &frame, const QByteArray &encodedText);
+    // Передаёт участок файла прямо в сокет (sendfile), минуя буфер Qt.
+    // Возвращает число переданных байт; остаток вызывающий дописывает через sendFrame.
+    // На сжатом соединении всегда возвращает 0: байты файла нужно пропустить через компрессор.
+    // Пока кадры кодируются в рабочем потоке, тоже 0: файл не должен обогнать их в сокете.
+    [[nodiscard]] qint64 sendFileRange(int fileDescriptor, qint64 offset, qint64 length);
     void disconnectFromServer();
 
+    // Сколько байт ещё ждёт отправки: в буфере сокета и у кодировщика в рабочем потоке.
+    [[nodiscard]] qint64 pendingBytes() const;
+    [[nodiscard]] bool isCompressed() const;
+    [[nodiscard]] bool hasHeaderCompression() const;
+
+    // Результат рукопожатия; legacy(), пока клиент его не прислал.
+    [[nodiscard]] const SessionCapabilities &capabilities() const;
+    [[nodiscard]] bool hasHandshake() const;
+    // Отправляет WELCOME (ещё без сжатия) и переводит соединение на согласованные параметры.
+    void startSession(SessionCapabilities negotiated);
+    // Включает вызов IMessageSink::onConnectionDrained после каждой записи в сеть.
+    void setDrainNotification(bool enabled);
+
     [[nodiscard]] bool hasUserName() const;
     [[nodiscard]] const QString &userName() const;
     void setUserName(QString userName);
+    // Номер пользователя в списках блокировки, выдаётся при входе; рассылка проверяет по нему бит маски.
+    [[nodiscard]] quint32 userId() const;
+    void setUserId(quint32 userId);
     [[nodiscard]] bool isAuthenticated() const;
     void setAuthenticated(bool authenticated);
+    // Клиент прошёл рукопожатие, значит понимает управляющие кадры.
+    [[nodiscard]] bool usesControlFrames() const;
 
 signals:
-    void messageReceived(const ChatMessage &message);
     void connectionClosed(ClientConnection *connection);
 
 private slots:
     void handleReadyRead();
     void handleDisconnected();
+    void handleBytesWritten();
 
 private:
+    friend class OutboundExecutor;
+
+    void consumeBytes(QByteArray data);
+    // Делит распакованные байты на кадры; false — соединение прервано или порция
+    // досталась сжатому потоку, дальше читать её не нужно.
+    bool splitFrames(QByteArray data);
     void processPayload(const QByteArray &payload);
+    void writeToSocket(const QByteArray &bytes);
+    // Главный поток: запись кадра, закодированного исполнителем.
+    void completeOutbound(const QByteArray &bytes, qint64 accounted);
 
-    QTcpSocket *m_socket;
-    JsonMessageSerializer m_serializer;
+    IMessageSink *m_sink;
+    QTcpSocket m_socket;
     QByteArray m_buffer;
+    // Создаётся только после согласования сжатия или сжатых заголовков, остальные соединения его не держат
+    std::unique_ptr<SessionEncoder> m_session;
     QString m_userName;
+    SessionCapabilities m_capabilities;
+    // Порядковый номер подключения: по нему соединение закреплено за шардом OutboundExecutor
+    quint32 m_ordinal;
+    // До входа — номер, которого нет ни в одной маске (BlockLists::kNoId)
+    quint32 m_userId = 0xffffffffu;
     bool m_authenticated = false;
 };
-
@@ -0,0 +1,328 @@
+#include "ClusterRelay.h"
+
+#include "ChatMessage.h"
+#include "IClusterSink.h"
+#include "JsonCodec.h"
+#include "PeerLink.h"
+
+#include <QDateTime>
+#include <QLoggingCategory>
+#include <QTcpSocket>
+#include <optional>
+#include <utility>
+
+Q_DECLARE_LOGGING_CATEGORY(chatCluster)
+
+namespace {
+constexpr char kHelloKind = 'N';
+
+struct RelayEvent {
+    char kind = 0;
+    QString origin;
+    quint64 incarnation = 0;
+    quint64 seq = 0;
+    QByteArray payload;
+};
+
+// <вид> <узел> <запуск> <номер> <данные>
+std::optional<RelayEvent> parseEvent(const QByteArray &line)
+{
+    if (line.size() < 2 || line.at(1) != ' ') {
+        return std::nullopt;
+    }
+
+    qsizetype position = 2;
+    const auto nextToken = [&]() -> QByteArray {
+        const auto space = line.indexOf(' ', position);
+        if (space <= position) {
+            return {};
+        }
+        const auto token = line.sliced(position, space - position);
+        position = space + 1;
+        return token;
+    };
+
+    RelayEvent event;
+    event.kind = line.at(0);
+    const auto origin = nextToken();
+    bool incarnationOk = false;
+    bool seqOk = false;
+    event.incarnation = nextToken().toULongLong(&incarnationOk);
+    event.seq = nextToken().toULongLong(&seqOk);
+    if (origin.isEmpty() || !incarnationOk || !seqOk || event.seq == 0) {
+        return std::nullopt;
+    }
+    event.origin = QString::fromUtf8(origin);
+    event.payload = line.sliced(position);
+    return event;
+}
+} // namespace
+
+ClusterRelay::ClusterRelay(IClusterSink *sink, QObject *parent)
+    : QObject(parent)
+    , m_sink(sink)
+{
+    Q_ASSERT(m_sink);
+    connect(&m_listener, &QTcpServer::newConnection, this, &ClusterRelay::acceptPeer);
+}
+
+ClusterRelay::~ClusterRelay()
+{
+    stop();
+}
+
+bool ClusterRelay::start(Config config)
+{
+    stop();
+    m_config = std::move(config);
+    m_nodeIdUtf8 = m_config.nodeId.toUtf8();
+    // Номера событий начинаются заново, запуск отличает их от номеров прошлого процесса
+    m_incarnation = quint64(QDateTime::currentMSecsSinceEpoch());
+    m_nextSeq = 1;
+
+    if (m_config.listenPort != 0 && !m_listener.listen(QHostAddress::Any, m_config.listenPort)) {
+        return false;
+    }
+
+    for (const Peer &peer : std::as_const(m_config.peers)) {
+        auto *link = new PeerLink(peer.host, peer.port, this);
+        addLink(link);
+        link->open();
+    }
+    m_enabled = true;
+
+    qCInfo(chatCluster) << "Узел кластера" << m_config.nodeId << "порт связей" << m_config.listenPort
+                        << "соседей в списке:" << m_config.peers.size();
+    return true;
+}
+
+void ClusterRelay::stop()
+{
+    m_listener.close();
+    for (PeerLink *link : std::as_const(m_links)) {
+        // Остановка не должна выглядеть для сервера как потеря соседей
+        disconnect(link, nullptr, this, nullptr);
+        link->close();
+        link->deleteLater();
+    }
+    m_links.clear();
+    m_origins.clear();
+    m_enabled = false;
+}
+
+bool ClusterRelay::isEnabled() const
+{
+    return m_enabled;
+}
+
+const QString &ClusterRelay::nodeId() const
+{
+    return m_config.nodeId;
+}
+
+QString ClusterRelay::errorString() const
+{
+    return m_listener.errorString();
+}
+
+void ClusterRelay::relayMessage(const QString &room, const QByteArray &frame)
+{
+    if (m_links.isEmpty()) {
+        return;
+    }
+    // Данные события: <комната> <кадр>; имя комнаты не содержит пробелов
+    QByteArray payload = room.toUtf8();
+    payload.reserve(payload.size() + frame.size() + 1);
+    payload.append(' ').append(frame);
+    broadcast(encodeEvent(char(ClusterEvent::Message), payload), nullptr);
+}
+
+void ClusterRelay::relay(ClusterEvent kind, const QByteArray &payload)
+{
+    Q_ASSERT(kind != ClusterEvent::Message);
+    if (m_links.isEmpty()) {
+        return;
+    }
+    QByteArray line = encodeEvent(char(kind), payload);
+    line.append('\n');
+    broadcast(line, nullptr);
+}
+
+void ClusterRelay::acceptPeer()
+{
+    while (m_listener.hasPendingConnections()) {
+        auto *link = new PeerLink(m_listener.nextPendingConnection(), this);
+        addLink(link);
+        sendHello(link);
+    }
+}
+
+void ClusterRelay::addLink(PeerLink *link)
+{
+    connect(link, &PeerLink::connected, this, &ClusterRelay::sendHello);
+    connect(link, &PeerLink::lineReceived, this, &ClusterRelay::handleLine);
+    connect(link, &PeerLink::disconnected, this, &ClusterRelay::handleLinkDown);
+    m_links.append(link);
+}
+
+void ClusterRelay::sendHello(PeerLink *link)
+{
+    QByteArray hello;
+    hello.append(kHelloKind).append(' ').append(m_nodeIdUtf8);
+    if (!m_config.secret.isEmpty()) {
+        hello.append(' ').append(m_config.secret);
+    }
+    hello.append('\n');
+    link->sendLine(hello);
+}
+
+void ClusterRelay::handleLine(PeerLink *link, const QByteArray &line)
+{
+    if (line.startsWith(kHelloKind)) {
+        handleHello(link, line);
+        return;
+    }
+    // До представления сосед ничего не может прислать
+    if (!link->isEstablished()) {
+        qCWarning(chatCluster) << "Событие до представления от" << link->address();
+        link->close();
+        return;
+    }
+
+    std::optional<RelayEvent> event = parseEvent(line);
+    if (!event) {
+        qCWarning(chatCluster) << "Некорректная строка от узла" << link->nodeId();
+        return;
+    }
+    // Собственные события, вернувшиеся по кругу, и повторы с других связей отбрасываем
+    if (event->origin == m_config.nodeId || !acceptSequence(event->origin, event->incarnation, event->seq)) {
+        return;
+    }
+
+    // Дальше событие идёт волной: каждый сосед получает его не больше одного раза
+    QByteArray forwarded = line;
+    forwarded.append('\n');
+    broadcast(forwarded, link);
+
+    switch (ClusterEvent(event->kind)) {
+    case ClusterEvent::Message: {
+        const auto roomEnd = event->payload.indexOf(' ');
+        if (roomEnd <= 0) {
+            qCWarning(chatCluster) << "Сообщение без комнаты от узла" << event->origin;
+            return;
+        }
+        const QString room = QString::fromUtf8(event->payload.first(roomEnd));
+        QByteArray frame = event->payload.sliced(roomEnd + 1);
+        ChatMessage message;
+        try {
+            message = JsonCodec<ChatMessage>::decode(frame);
+        } catch (const std::exception &error) {
+            qCWarning(chatCluster) << "Не удалось разобрать сообщение от узла" << event->origin << error.what();
+            return;
+        }
+        frame.append('\n');
+        m_sink->onRelayedMessage(room, std::move(message), frame);
+        return;
+    }
+    case ClusterEvent::Directory:
+    case ClusterEvent::Command:
+        m_sink->onClusterEvent(ClusterEvent(event->kind), event->origin, event->payload);
+        return;
+    }
+
+    // Неизвестные виды только пересылаем: их понимают более новые узлы
+    qCDebug(chatCluster) << "Неизвестный вид события" << event->kind << "от узла" << event->origin;
+}
+
+void ClusterRelay::handleHello(PeerLink *link, const QByteArray &line)
+{
+    if (link->isEstablished()) {
+        return;
+    }
+
+    // N <узел> [секрет]
+    const auto rest = line.sliced(qMin<qsizetype>(2, line.size()));
+    const auto space = rest.indexOf(' ');
+    const auto nodeId = QString::fromUtf8(space < 0 ? rest : rest.first(space));
+    const auto secret = space < 0 ? QByteArray() : rest.sliced(space + 1);
+
+    if (secret != m_config.secret) {
+        qCWarning(chatCluster) << "Неверный секрет кластера от" << link->address();
+        link->close();
+        return;
+    }
+    if (nodeId.isEmpty() || nodeId == m_config.nodeId) {
+        // Адрес самого себя в списке соседей или безымянный узел
+        link->close();
+        return;
+    }
+
+    link->setNodeId(nodeId);
+    qCInfo(chatCluster) << "Связь с узлом" << nodeId << "установлена:" << link->address();
+
+    m_sink->onNodeJoined(nodeId);
+}
+
+void ClusterRelay::handleLinkDown(PeerLink *link)
+{
+    const QString nodeId = link->nodeId();
+    if (!link->isOutgoing()) {
+        m_links.removeOne(link);
+        link->deleteLater();
+    }
+    if (nodeId.isEmpty()) {
+        return;
+    }
+
+    qCWarning(chatCluster) << "Связь с узлом" << nodeId << "потеряна";
+    for (const PeerLink *other : std::as_const(m_links)) {
+        if (other != link && other->nodeId() == nodeId) {
+            return;
+        }
+    }
+    m_sink->onNodeLost(nodeId);
+}
+
+void ClusterRelay::broadcast(const QByteArray &line, const PeerLink *except)
+{
+    for (PeerLink *link : std::as_const(m_links)) {
+        if (link != except && link->isEstablished()) {
+            link->sendLine(line);
+        }
+    }
+}
+
+QByteArray ClusterRelay::encodeEvent(char kind, const QByteArray &payload)
+{
+    QByteArray line;
+    line.reserve(m_nodeIdUtf8.size() + payload.size() + 48);
+    line.append(kind).append(' ').append(m_nodeIdUtf8).append(' ');
+    line.append(QByteArray::number(m_incarnation)).append(' ');
+    line.append(QByteArray::number(m_nextSeq++)).append(' ');
+    line.append(payload);
+    return line;
+}
+
+bool ClusterRelay::acceptSequence(const QString &origin, quint64 incarnation, quint64 seq)
+{
+    OriginState &state = m_origins[origin];
+    if (incarnation < state.incarnation) {
+        return false;
+    }
+    if (incarnation > state.incarnation) {
+        // Узел перезапустился (или впервые слышим о нём): отсчёт с первого увиденного номера
+        state = OriginState{};
+        state.incarnation = incarnation;
+        state.contiguous = seq - 1;
+    }
+
+    if (seq <= state.contiguous || !state.ahead.insert(seq).second) {
+        return false;
+    }
+    while (!state.ahead.empty()
+           && (*state.ahead.begin() == state.contiguous + 1 || state.ahead.size() > kDedupWindow)) {
+        state.contiguous = *state.ahead.begin();
+        state.ahead.erase(state.ahead.begin());
+    }
+    return true;
+}
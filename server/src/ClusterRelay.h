@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QTcpServer>
+#include <cstddef>
+#include <set>
+
+class IClusterSink;
+class PeerLink;
+
+// Узел кластера: связи с соседями по статическому списку и ретрансляция
+// событий между ними. Каждое событие помечается именем узла-источника,
+// его запуском (incarnation) и порядковым номером. По этой метке узел
+// отбрасывает повторы, поэтому события можно рассылать волной по всем
+// связям без петель. Клиентам своего узла события раздаёт IClusterSink.
+//
+// Строки протокола между узлами:
+//   N <узел> [секрет]                       — представление после подключения
+//   <вид> <узел> <запуск> <номер> <данные>  — событие
+// Вид события — ClusterEvent.
+enum class ClusterEvent : char {
+    Message = 'M',   // комната и клиентский кадр сообщения чата
+    Directory = 'D', // записи каталога присутствия (PresenceDirectory)
+    Command = 'C',   // команда администратора для других узлов
+};
+
+class ClusterRelay final : public QObject {
+    Q_OBJECT
+
+public:
+    struct Peer {
+        QString host;
+        quint16 port = 0;
+    };
+
+    struct Config {
+        QString nodeId;
+        quint16 listenPort = 0;
+        QList<Peer> peers;
+        QByteArray secret;
+    };
+
+    // Сколько номеров с пропусками помнится от одного источника; при переполнении
+    // пропуски считаются потерянными (событие ушло, пока связь была разорвана).
+    static constexpr std::size_t kDedupWindow = 4096;
+
+    explicit ClusterRelay(IClusterSink *sink, QObject *parent = nullptr);
+    ~ClusterRelay() override;
+
+    // Имя узла не должно содержать пробелов. Возвращает false, если не удалось
+    // открыть порт для соседей.
+    bool start(Config config);
+    void stop();
+
+    [[nodiscard]] bool isEnabled() const;
+    [[nodiscard]] const QString &nodeId() const;
+    [[nodiscard]] QString errorString() const;
+
+    // Сообщение чата этого узла в комнате room; frame — клиентский кадр с '\n' в конце.
+    void relayMessage(const QString &room, const QByteArray &frame);
+    // Событие другого вида; payload без завершающего '\n' и без переводов строки внутри.
+    void relay(ClusterEvent kind, const QByteArray &payload);
+
+private:
+    // Что уже получено от одного запуска узла-источника
+    struct OriginState {
+        quint64 incarnation = 0;
+        quint64 contiguous = 0;
+        std::set<quint64> ahead;
+    };
+
+    void acceptPeer();
+    void addLink(PeerLink *link);
+    void sendHello(PeerLink *link);
+    void handleLine(PeerLink *link, const QByteArray &line);
+    void handleHello(PeerLink *link, const QByteArray &line);
+    void handleLinkDown(PeerLink *link);
+    void broadcast(const QByteArray &line, const PeerLink *except);
+    [[nodiscard]] QByteArray encodeEvent(char kind, const QByteArray &payload);
+    [[nodiscard]] bool acceptSequence(const QString &origin, quint64 incarnation, quint64 seq);
+
+    IClusterSink *m_sink;
+    QTcpServer m_listener;
+    QList<PeerLink *> m_links;
+    QHash<QString, OriginState> m_origins;
+    Config m_config;
+    QByteArray m_nodeIdUtf8;
+    quint64 m_incarnation = 0;
+    quint64 m_nextSeq = 1;
+    bool m_enabled = false;
+};
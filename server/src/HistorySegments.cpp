@@ -0,0 +1,190 @@
+#include "HistorySegments.h"
+
+#include <QDir>
+#include <QLoggingCategory>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace {
+Q_LOGGING_CATEGORY(chatHistorySegments, "kukaracha.server.history.disk")
+
+const QString kSegmentPrefix = QStringLiteral("segment_");
+const QString kSegmentSuffix = QStringLiteral(".seg");
+constexpr QIODevice::OpenMode kSegmentMode = QIODevice::ReadWrite | QIODevice::Append | QIODevice::Unbuffered;
+} // namespace
+
+HistorySegments::HistorySegments(QString directory)
+    : m_directory(std::move(directory))
+{
+}
+
+bool HistorySegments::open()
+{
+    QDir dir;
+    if (!dir.mkpath(m_directory)) {
+        qCWarning(chatHistorySegments) << "Не удалось создать каталог истории:" << m_directory;
+        return false;
+    }
+
+    const QDir historyDir(m_directory);
+    const auto names = historyDir.entryList({kSegmentPrefix + QLatin1Char('*') + kSegmentSuffix}, QDir::Files);
+    std::vector<qint64> ids;
+    for (const auto &name : names) {
+        bool ok = false;
+        const auto id = name.mid(kSegmentPrefix.size(), name.size() - kSegmentPrefix.size() - kSegmentSuffix.size())
+                            .toLongLong(&ok);
+        if (ok) {
+            ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    for (const auto id : ids) {
+        auto file = std::make_unique<QFile>(segmentPath(id));
+        // Пустые сегменты прежних запусков не хранят записей, но занимали бы место в очереди сегментов
+        if (file->size() == 0 && id != ids.back()) {
+            file->remove();
+            continue;
+        }
+        if (!file->open(kSegmentMode)) {
+            qCWarning(chatHistorySegments) << "Не удалось открыть сегмент истории:" << file->fileName() << file->errorString();
+            continue;
+        }
+        m_segments.push_back(Segment{id, std::move(file)});
+        m_nextSegmentId = id + 1;
+    }
+
+    // Перезапуск не заводит новый сегмент, пока в последнем есть место
+    m_open = reopenTail() || startSegment();
+    return m_open;
+}
+
+bool HistorySegments::isOpen() const
+{
+    return m_open;
+}
+
+void HistorySegments::load(const std::function<void(const QByteArray &frame, Location location)> &visitor) const
+{
+    for (const auto &segment : m_segments) {
+        QFile reader(segment.file->fileName());
+        if (!reader.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        const auto data = reader.readAll();
+        qsizetype start = 0;
+        qsizetype newlineIndex = -1;
+        while ((newlineIndex = data.indexOf('\n', start)) != -1) {
+            visitor(data.sliced(start, newlineIndex + 1 - start), Location{segment.id, start});
+            start = newlineIndex + 1;
+        }
+    }
+}
+
+HistorySegments::Location HistorySegments::append(const QByteArray &frame)
+{
+    if (!m_open) {
+        return {};
+    }
+
+    if (m_segments.back().file->size() >= kSegmentBytes && !startSegment()) {
+        m_open = false;
+        return {};
+    }
+
+    auto &segment = m_segments.back();
+    const Location location{segment.id, segment.file->size()};
+    if (segment.file->write(frame) != frame.size()) {
+        qCWarning(chatHistorySegments) << "Не удалось записать сегмент истории:" << segment.file->errorString();
+        return {};
+    }
+    return location;
+}
+
+void HistorySegments::releaseBefore(qint64 segment)
+{
+    // Активный (последний) сегмент не удаляется никогда
+    while (m_segments.size() > 1 && m_segments.front().id < segment) {
+        auto &front = m_segments.front();
+        front.file->close();
+        if (!front.file->remove()) {
+            qCWarning(chatHistorySegments) << "Не удалось удалить сегмент истории:" << front.file->fileName();
+        }
+        m_segments.pop_front();
+    }
+}
+
+void HistorySegments::clear()
+{
+    for (auto &segment : m_segments) {
+        segment.file->close();
+        if (!segment.file->remove()) {
+            qCWarning(chatHistorySegments) << "Не удалось удалить сегмент истории:" << segment.file->fileName();
+        }
+    }
+    m_segments.clear();
+    if (m_open) {
+        m_open = startSegment();
+    }
+}
+
+int HistorySegments::fileDescriptor(qint64 segment) const
+{
+    const auto *found = findSegment(segment);
+    return found != nullptr ? found->file->handle() : -1;
+}
+
+QString HistorySegments::segmentPath(qint64 id) const
+{
+    return m_directory + QLatin1Char('/') + kSegmentPrefix
+        + QStringLiteral("%1").arg(id, 12, 10, QLatin1Char('0')) + kSegmentSuffix;
+}
+
+bool HistorySegments::startSegment()
+{
+    auto file = std::make_unique<QFile>(segmentPath(m_nextSegmentId));
+    if (!file->open(kSegmentMode)) {
+        qCWarning(chatHistorySegments) << "Не удалось создать сегмент истории:" << file->fileName() << file->errorString();
+        return false;
+    }
+    m_segments.push_back(Segment{m_nextSegmentId, std::move(file)});
+    ++m_nextSegmentId;
+    return true;
+}
+
+bool HistorySegments::reopenTail()
+{
+    if (m_segments.empty() || m_segments.back().file->size() >= kSegmentBytes) {
+        return false;
+    }
+
+    // Прежний процесс мог оборваться на середине кадра: хвост после последнего перевода строки отрезаем
+    QFile &file = *m_segments.back().file;
+    QFile reader(file.fileName());
+    if (!reader.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const qsizetype complete = reader.readAll().lastIndexOf('\n') + 1;
+    reader.close();
+    if (complete != file.size() && !file.resize(complete)) {
+        qCWarning(chatHistorySegments) << "Не удалось обрезать сегмент истории:" << file.fileName() << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+const HistorySegments::Segment *HistorySegments::findSegment(qint64 id) const
+{
+    if (m_segments.empty() || id < m_segments.front().id) {
+        return nullptr;
+    }
+    // Идентификаторы идут подряд, кроме пропусков после неудачного открытия — ищем бинарно
+    const auto it = std::lower_bound(m_segments.begin(), m_segments.end(), id,
+                                     [](const Segment &segment, qint64 value) { return segment.id < value; });
+    if (it == m_segments.end() || it->id != id) {
+        return nullptr;
+    }
+    return &*it;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+// Хранилище истории на диске. Кадры пишутся в сегменты ровно в том виде,
+// в котором уходят в сокет, поэтому диапазон истории можно передать клиенту
+// напрямую из файла (sendfile) без разбора и повторного кодирования.
+class HistorySegments {
+public:
+    struct Location {
+        qint64 segment = -1;
+        qint64 offset = 0;
+    };
+
+    explicit HistorySegments(QString directory);
+
+    // Открывает каталог и существующие сегменты; при неудаче история живёт только в памяти.
+    bool open();
+    [[nodiscard]] bool isOpen() const;
+
+    // Перебирает сохранённые кадры в порядке записи (используется при запуске сервера).
+    // Посетитель не должен менять набор сегментов (releaseBefore, clear) до конца перебора.
+    void load(const std::function<void(const QByteArray &frame, Location location)> &visitor) const;
+
+    [[nodiscard]] Location append(const QByteArray &frame);
+
+    // Удаляет сегменты, предшествующие указанному: их записи вытеснены из истории.
+    void releaseBefore(qint64 segment);
+    // Удаляет все сегменты и начинает запись с чистого.
+    void clear();
+
+    [[nodiscard]] int fileDescriptor(qint64 segment) const;
+
+private:
+    struct Segment {
+        qint64 id = 0;
+        std::unique_ptr<QFile> file;
+    };
+
+    [[nodiscard]] QString segmentPath(qint64 id) const;
+    bool startSegment();
+    // Продолжает запись в последний сегмент, если в нём есть место; оборванный кадр в конце отрезается.
+    bool reopenTail();
+    const Segment *findSegment(qint64 id) const;
+
+    static constexpr qint64 kSegmentBytes = 1024 * 1024;
+
+    QString m_directory;
+    std::deque<Segment> m_segments;
+    qint64 m_nextSegmentId = 0;
+    bool m_open = false;
+};
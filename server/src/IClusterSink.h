@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+class ChatMessage;
+enum class ClusterEvent : char;
+
+// Получатель событий, пришедших от других узлов кластера. Каждое событие
+// доставляется ровно один раз, повторы и петли отсекает ClusterRelay.
+class IClusterSink {
+public:
+    virtual ~IClusterSink() = default;
+
+    // Сообщение, принятое другим узлом в комнате room; frame — готовый клиентский кадр.
+    virtual void onRelayedMessage(const QString &room, ChatMessage &&message, const QByteArray &frame) = 0;
+    // Событие другого вида от узла origin.
+    virtual void onClusterEvent(ClusterEvent kind, const QString &origin, const QByteArray &payload) = 0;
+    // Установлена связь с соседом: ему нужно состояние этого узла.
+    virtual void onNodeJoined(const QString &nodeId) = 0;
+    // Связь с узлом потеряна, его пользователи больше не в сети.
+    virtual void onNodeLost(const QString &nodeId) = 0;
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+class ChatMessage;
+class ClientConnection;
+class ControlMessage;
+
+// Получатель входящих сообщений от соединений. Вызывается напрямую, без
+// метаобъектной системы Qt: сообщение передаётся по значению и перемещается.
+class IMessageSink {
+public:
+    virtual ~IMessageSink() = default;
+
+    virtual void onMessageReceived(ChatMessage &&message, ClientConnection *connection) = 0;
+    virtual void onControlReceived(ControlMessage &&message, ClientConnection *connection) = 0;
+    // Сокет соединения отдал часть буфера в сеть (только при включённом уведомлении).
+    virtual void onConnectionDrained(ClientConnection *connection) = 0;
+};
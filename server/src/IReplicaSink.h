@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+class ChatMessage;
+
+// Получатель потока репликации на резервном сервере (StandbyReplica).
+class IReplicaSink {
+public:
+    virtual ~IReplicaSink() = default;
+
+    // Основной сервер сменился или перезапустился: историю нужно принять заново.
+    virtual void onReplicaReset() = 0;
+    // Очередная запись истории комнаты room основного сервера; frame — готовый клиентский кадр.
+    virtual void onReplicatedMessage(const QString &room, ChatMessage &&message, const QByteArray &frame) = 0;
+    // Полный бан-лист основного сервера.
+    virtual void onReplicatedBans(const QStringList &bans) = 0;
+    // Основной сервер недоступен дольше допустимого: резерв принимает клиентов сам.
+    virtual void onPromoted() = 0;
+};
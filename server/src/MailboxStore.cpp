@@ -0,0 +1,134 @@
+#include "MailboxStore.h"
+
+#include "Actor.h"
+#include "WorkStealingPool.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QMetaObject>
+#include <utility>
+
+Q_LOGGING_CATEGORY(chatMailbox, "kukaracha.server.mailbox")
+
+namespace {
+const QString kBoxSuffix = QStringLiteral(".box");
+} // namespace
+
+MailboxStore::MailboxStore(QString directory, qint64 maxBytesPerBox, QObject *parent)
+    : QObject(parent)
+    , m_directory(std::move(directory))
+    , m_maxBytesPerBox(maxBytesPerBox)
+{
+    m_thread = std::make_unique<WorkStealingPool>(1);
+    m_io = std::make_unique<Actor>(m_thread.get());
+}
+
+MailboxStore::~MailboxStore()
+{
+    // Недописанные кадры попадают на диск до выхода
+    m_thread.reset();
+}
+
+bool MailboxStore::open()
+{
+    if (QDir().mkpath(m_directory) == false) {
+        qCWarning(chatMailbox) << "Не удалось создать каталог почтовых ящиков:" << m_directory;
+        return false;
+    }
+
+    // Файлы есть только у непустых ящиков, так что обход не зависит от числа пользователей
+    const auto entries = QDir(m_directory).entryInfoList({QStringLiteral("*") + kBoxSuffix}, QDir::Files);
+    for (const QFileInfo &entry : entries) {
+        if (entry.size() > 0) {
+            m_sizes.insert(entry.completeBaseName(), entry.size());
+        }
+    }
+    m_open = true;
+    return true;
+}
+
+qint64 MailboxStore::maxBytesPerBox() const
+{
+    return m_maxBytesPerBox;
+}
+
+bool MailboxStore::append(const QString &user, const QByteArray &frame)
+{
+    if (m_open == false) {
+        return false;
+    }
+
+    const QString key = boxKey(user);
+    const qint64 size = m_sizes.value(key);
+    if (size + frame.size() > m_maxBytesPerBox) {
+        return false;
+    }
+    m_sizes.insert(key, size + frame.size());
+    write(key, frame);
+    return true;
+}
+
+bool MailboxStore::hasMail(const QString &user) const
+{
+    return m_sizes.contains(boxKey(user));
+}
+
+void MailboxStore::drain(const QString &user, DrainHandler handler)
+{
+    const QString key = boxKey(user);
+    if (m_sizes.remove(key) == 0) {
+        return;
+    }
+
+    // Чтение встаёт в очередь после всех дописываний этого ящика
+    m_io->post([this, path = boxPath(key), handler = std::move(handler)]() {
+        QFile file(path);
+        QByteArray frames;
+        if (file.open(QIODevice::ReadOnly)) {
+            frames = file.readAll();
+            file.close();
+            file.remove();
+        } else {
+            qCWarning(chatMailbox) << "Не удалось прочитать почтовый ящик:" << path << file.errorString();
+        }
+        if (frames.isEmpty()) {
+            return;
+        }
+        QMetaObject::invokeMethod(this, [handler, frames = std::move(frames)]() { handler(frames); },
+                                  Qt::QueuedConnection);
+    });
+}
+
+void MailboxStore::restore(const QString &user, const QByteArray &frames)
+{
+    if (m_open == false || frames.isEmpty()) {
+        return;
+    }
+    const QString key = boxKey(user);
+    m_sizes[key] += frames.size();
+    write(key, frames);
+}
+
+QString MailboxStore::boxKey(const QString &user)
+{
+    // Логин может быть любой длины и с любыми печатными символами, в имени файла — его хэш
+    return QString::fromLatin1(QCryptographicHash::hash(user.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+QString MailboxStore::boxPath(const QString &key) const
+{
+    return m_directory + QLatin1Char('/') + key + kBoxSuffix;
+}
+
+void MailboxStore::write(const QString &key, const QByteArray &frames)
+{
+    m_io->post([path = boxPath(key), frames]() {
+        QFile file(path);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Append) == false || file.write(frames) != frames.size()) {
+            qCWarning(chatMailbox) << "Не удалось записать в почтовый ящик:" << path << file.errorString();
+        }
+    });
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QString>
+
+#include <functional>
+#include <memory>
+
+class Actor;
+class WorkStealingPool;
+
+// Почтовые ящики личных сообщений для пользователей не в сети. У каждого
+// пользователя свой файл, в который кадры Direct дописываются в том виде,
+// в котором уйдут в сокет; при входе файл забирается целиком и удаляется.
+// Файловые операции выполняет отдельный поток-актор по порядку, главный поток
+// только ставит их в очередь и ведёт размеры непустых ящиков для лимита.
+// Стоимость доставки зависит от размера ящика, но не от числа пользователей.
+class MailboxStore final : public QObject {
+    Q_OBJECT
+
+public:
+    using DrainHandler = std::function<void(QByteArray frames)>;
+
+    MailboxStore(QString directory, qint64 maxBytesPerBox, QObject *parent = nullptr);
+    ~MailboxStore() override;
+
+    // Создаёт каталог и собирает размеры ящиков прошлых запусков.
+    bool open();
+    [[nodiscard]] qint64 maxBytesPerBox() const;
+
+    // false — ящик переполнен, кадр не сохранён.
+    [[nodiscard]] bool append(const QString &user, const QByteArray &frame);
+    [[nodiscard]] bool hasMail(const QString &user) const;
+    // Забирает ящик; handler вызывается в главном потоке с кадрами в порядке записи.
+    // Пустой ящик не читается с диска, handler не вызывается.
+    void drain(const QString &user, DrainHandler handler);
+    // Возвращает в ящик недоставленные кадры, не проверяя лимит.
+    void restore(const QString &user, const QByteArray &frames);
+
+private:
+    [[nodiscard]] static QString boxKey(const QString &user);
+    [[nodiscard]] QString boxPath(const QString &key) const;
+    void write(const QString &key, const QByteArray &frames);
+
+    QString m_directory;
+    qint64 m_maxBytesPerBox;
+    // Размеры только непустых ящиков, по ключу boxKey
+    QHash<QString, qint64> m_sizes;
+    bool m_open = false;
+    // Поток объявлен после актора и останавливается первым, дописав очередь
+    std::unique_ptr<Actor> m_io;
+    std::unique_ptr<WorkStealingPool> m_thread;
+};
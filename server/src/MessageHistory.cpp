@@ -0,0 +1,267 @@
+#include "MessageHistory.h"
+
+#include "ChatMessage.h"
+#include "IMessageSerializer.h"
+
+#include <QLoggingCategory>
+
+#include <exception>
+#include <limits>
+#include <utility>
+
+namespace {
+Q_LOGGING_CATEGORY(chatHistory, "kukaracha.server.history")
+} // namespace
+
+MessageHistory::MessageHistory(qsizetype maxBytes, qsizetype maxMessages, QString segmentDirectory)
+    : m_segments(std::move(segmentDirectory))
+    , m_maxBytes(maxBytes)
+    , m_maxMessages(maxMessages)
+{
+}
+
+bool MessageHistory::openSegments(const IMessageSerializer &serializer)
+{
+    if (!m_segments.open()) {
+        return false;
+    }
+
+    m_loadingSegments = true;
+    m_segments.load([&](const QByteArray &frame, HistorySegments::Location location) {
+        try {
+            const auto message = serializer.deserialize(frame.chopped(1));
+            appendEntry(message, frame, location);
+        } catch (const std::exception &error) {
+            qCWarning(chatHistory) << "Пропущен повреждённый кадр истории:" << error.what();
+        }
+    });
+    m_loadingSegments = false;
+    releaseEvictedSegments();
+    qCInfo(chatHistory) << "Восстановлено сообщений истории:" << size();
+    return true;
+}
+
+void MessageHistory::append(const ChatMessage &message, QByteArray frame)
+{
+    const auto location = m_segments.append(frame);
+    appendEntry(message, std::move(frame), location);
+}
+
+void MessageHistory::clear()
+{
+    m_entries.clear();
+    m_batchCache.clear();
+    m_senders.clear();
+    m_senderRefs.clear();
+    m_bySenderTime.clear();
+    m_bytesUsed = 0;
+    m_segments.clear();
+}
+
+bool MessageHistory::isEmpty() const
+{
+    return m_entries.empty();
+}
+
+qsizetype MessageHistory::size() const
+{
+    return qsizetype(m_entries.size());
+}
+
+qsizetype MessageHistory::bytesUsed() const
+{
+    return m_bytesUsed;
+}
+
+qsizetype MessageHistory::maxBytes() const
+{
+    return m_maxBytes;
+}
+
+qsizetype MessageHistory::maxMessages() const
+{
+    return m_maxMessages;
+}
+
+quint64 MessageHistory::firstSeq() const
+{
+    return m_entries.empty() ? m_nextSeq : m_entries.front().seq;
+}
+
+quint64 MessageHistory::endSeq() const
+{
+    return m_nextSeq;
+}
+
+const MessageHistory::Entry &MessageHistory::entry(quint64 seq) const
+{
+    Q_ASSERT(seq >= firstSeq() && seq < endSeq());
+    return m_entries[seq - m_entries.front().seq];
+}
+
+MessageHistory::DiskRange MessageHistory::diskRange(quint64 fromSeq, quint64 endSeq, qint64 maxBytes) const
+{
+    DiskRange range;
+    range.endSeq = fromSeq;
+    if (fromSeq >= endSeq) {
+        return range;
+    }
+
+    const auto &first = entry(fromSeq);
+    range.endSeq = fromSeq + 1;
+    const int fileDescriptor = first.location.segment >= 0 ? m_segments.fileDescriptor(first.location.segment) : -1;
+    if (fileDescriptor < 0) {
+        // Записи нет на диске: порция набирается из кадров в памяти
+        qint64 length = first.frame.size();
+        while (range.endSeq < endSeq && length < maxBytes) {
+            length += entry(range.endSeq).frame.size();
+            ++range.endSeq;
+        }
+        return range;
+    }
+    range.fileDescriptor = fileDescriptor;
+
+    // Кадры одного сегмента лежат на диске подряд — расширяем участок, пока это так
+    range.offset = first.location.offset;
+    range.length = first.frame.size();
+    while (range.endSeq < endSeq && range.length < maxBytes) {
+        const auto &next = entry(range.endSeq);
+        if (next.location.segment != first.location.segment || next.location.offset != range.offset + range.length) {
+            break;
+        }
+        range.length += next.frame.size();
+        ++range.endSeq;
+    }
+    return range;
+}
+
+QList<ChatMessage> MessageHistory::messages(quint64 fromSeq, quint64 endSeq) const
+{
+    QList<ChatMessage> result;
+    result.reserve(qsizetype(endSeq > fromSeq ? endSeq - fromSeq : 0));
+    for (quint64 seq = fromSeq; seq < endSeq; ++seq) {
+        result.append(entry(seq).message.toChatMessage(m_senders));
+    }
+    return result;
+}
+
+quint64 MessageHistory::findMessage(const QString &sender, qint64 timestampMs) const
+{
+    const quint32 id = m_senders.idOf(sender);
+    return id == SenderTable::kNoId ? 0 : m_bySenderTime.value({id, timestampMs}, 0);
+}
+
+qint64 MessageHistory::freeTimestampMs(const QString &sender, qint64 timestampMs) const
+{
+    const quint32 id = m_senders.idOf(sender);
+    if (id == SenderTable::kNoId) {
+        return timestampMs;
+    }
+    while (m_bySenderTime.contains({id, timestampMs})) {
+        ++timestampMs;
+    }
+    return timestampMs;
+}
+
+const QByteArray *MessageHistory::cachedBatch(quint64 block) const
+{
+    const auto it = m_batchCache.constFind(block);
+    return it != m_batchCache.constEnd() ? &it.value() : nullptr;
+}
+
+bool MessageHistory::cacheBatch(quint64 block, QByteArray frame)
+{
+    if (frame.capacity() > m_maxBytes - m_bytesUsed || m_batchCache.contains(block)) {
+        return false;
+    }
+    m_bytesUsed += frame.capacity();
+    m_batchCache.insert(block, std::move(frame));
+    return true;
+}
+
+const std::deque<MessageHistory::Entry> &MessageHistory::entries() const
+{
+    return m_entries;
+}
+
+const SenderTable &MessageHistory::senders() const
+{
+    return m_senders;
+}
+
+void MessageHistory::appendEntry(const ChatMessage &message, QByteArray frame, HistorySegments::Location location)
+{
+    m_entries.push_back(Entry{CompactMessage(message, m_senders), std::move(frame), m_nextSeq++, location});
+    const CompactMessage &compact = m_entries.back().message;
+    retainSender(compact.senderId());
+    m_bySenderTime.insert({compact.senderId(), compact.timestampMs()}, m_entries.back().seq);
+    m_bytesUsed += footprint(m_entries.back());
+    evictOverflow();
+}
+
+void MessageHistory::retainSender(quint32 id)
+{
+    if (id >= m_senderRefs.size()) {
+        m_senderRefs.resize(std::size_t(id) + 1, 0);
+    }
+    if (m_senderRefs[id]++ == 0) {
+        m_bytesUsed += SenderTable::footprint(m_senders.name(id));
+    }
+}
+
+void MessageHistory::releaseSender(quint32 id)
+{
+    Q_ASSERT(id < m_senderRefs.size() && m_senderRefs[id] > 0);
+    if (--m_senderRefs[id] == 0) {
+        m_bytesUsed -= SenderTable::footprint(m_senders.name(id));
+        m_senders.release(id);
+    }
+}
+
+qsizetype MessageHistory::footprint(const Entry &entry)
+{
+    return qsizetype(sizeof(Entry)) - qsizetype(sizeof(CompactMessage)) + entry.message.footprint()
+        + entry.frame.capacity() + kIndexEntryBytes;
+}
+
+void MessageHistory::evictOverflow()
+{
+    // Каждое сообщение вытесняется не более одного раза, поэтому в среднем O(1) на добавление.
+    // Сообщение, которое одно превышает бюджет, тоже вытесняется: лимит строгий.
+    bool evicted = false;
+    while (!m_entries.empty() && (m_bytesUsed > m_maxBytes || size() > m_maxMessages)) {
+        const auto &front = m_entries.front();
+        // Блок теряет первую запись — его закэшированный пакет больше не полон
+        if (front.seq % kBatchSize == 0) {
+            const auto cached = m_batchCache.constFind(front.seq / kBatchSize);
+            if (cached != m_batchCache.constEnd()) {
+                m_bytesUsed -= cached.value().capacity();
+                m_batchCache.erase(cached);
+            }
+        }
+        m_bytesUsed -= footprint(front);
+        // Ключ мог перейти к более новой записи с тем же отправителем и временем
+        const auto indexed = m_bySenderTime.constFind({front.message.senderId(), front.message.timestampMs()});
+        if (indexed != m_bySenderTime.constEnd() && indexed.value() == front.seq) {
+            m_bySenderTime.erase(indexed);
+        }
+        releaseSender(front.message.senderId());
+        m_entries.pop_front();
+        evicted = true;
+    }
+
+    // Во время загрузки сегменты перебираются и удалять их нельзя: это сделает openSegments после
+    if (evicted && !m_loadingSegments) {
+        releaseEvictedSegments();
+    }
+}
+
+void MessageHistory::releaseEvictedSegments()
+{
+    // Сегменты, все записи которых вытеснены, больше не нужны и на диске
+    const auto firstSegment = m_entries.empty() ? std::numeric_limits<qint64>::max()
+                                                : m_entries.front().location.segment;
+    if (firstSegment >= 0) {
+        m_segments.releaseBefore(firstSegment);
+    }
+}
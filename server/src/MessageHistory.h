@@ -0,0 +1,111 @@
+#pragma once
+
+#include "CompactMessage.h"
+#include "HistorySegments.h"
+#include "SenderTable.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QtGlobal>
+#include <deque>
+#include <utility>
+#include <vector>
+
+class ChatMessage;
+class IMessageSerializer;
+
+// История сообщений с ограничением по суммарному объёму и по количеству.
+// Занятый объём учитывается инкрементально вместе с именами отправителей,
+// вытеснение идёт с начала очереди.
+// Вместе с записью хранится уже закодированный кадр, поэтому повторная
+// отправка истории не требует сериализации. Кадры дублируются в сегменты
+// на диске, откуда диапазон истории можно отдать в сокет без копирования.
+class MessageHistory {
+public:
+    // Кадр и сжатая запись хранятся вместе намеренно: кадр уходит при повторной отправке
+    // и репликации как есть, а из записи без разбора JSON берутся отправитель, время и
+    // текст для пакетов истории и реакций. В объём истории входят оба.
+    struct Entry {
+        CompactMessage message;
+        QByteArray frame;
+        quint64 seq = 0;
+        HistorySegments::Location location;
+    };
+
+    // Непрерывный участок сегмента, покрывающий записи [firstSeq, endSeq).
+    struct DiskRange {
+        int fileDescriptor = -1;
+        qint64 offset = 0;
+        qint64 length = 0;
+        quint64 endSeq = 0;
+    };
+
+    // Пакеты истории выравниваются по блокам из kBatchSize последовательных записей.
+    static constexpr quint64 kBatchSize = 64;
+    // Доля записи в индексе по отправителю и времени: ключ и номер записи.
+    static constexpr qsizetype kIndexEntryBytes = qsizetype(sizeof(std::pair<quint32, qint64>) + sizeof(quint64));
+
+    MessageHistory(qsizetype maxBytes, qsizetype maxMessages, QString segmentDirectory);
+
+    // Открывает сегменты на диске и восстанавливает из них историю прошлых запусков.
+    bool openSegments(const IMessageSerializer &serializer);
+
+    void append(const ChatMessage &message, QByteArray frame);
+    // Забывает всю историю, в том числе на диске. Номера записей продолжают расти.
+    void clear();
+
+    [[nodiscard]] bool isEmpty() const;
+    [[nodiscard]] qsizetype size() const;
+    [[nodiscard]] qsizetype bytesUsed() const;
+    [[nodiscard]] qsizetype maxBytes() const;
+    [[nodiscard]] qsizetype maxMessages() const;
+
+    [[nodiscard]] quint64 firstSeq() const;
+    [[nodiscard]] quint64 endSeq() const;
+    [[nodiscard]] const Entry &entry(quint64 seq) const;
+    // Участок не длиннее maxBytes (но минимум одна запись).
+    [[nodiscard]] DiskRange diskRange(quint64 fromSeq, quint64 endSeq, qint64 maxBytes) const;
+
+    [[nodiscard]] QList<ChatMessage> messages(quint64 fromSeq, quint64 endSeq) const;
+
+    // Номер записи сообщения sender со временем timestampMs или 0, если его нет. O(1) по индексу;
+    // из сообщений с одинаковыми отправителем и временем находится последнее.
+    [[nodiscard]] quint64 findMessage(const QString &sender, qint64 timestampMs) const;
+    // Ближайшее время не раньше timestampMs, которого нет у сообщений sender в истории.
+    [[nodiscard]] qint64 freeTimestampMs(const QString &sender, qint64 timestampMs) const;
+
+    // Кэш закодированных пакетов для полных блоков; учитывается в объёме истории
+    // и сбрасывается, когда блок начинает вытесняться. Ради кэша сообщения не
+    // вытесняются: пакет, который не помещается в свободный объём, не кэшируется.
+    [[nodiscard]] const QByteArray *cachedBatch(quint64 block) const;
+    bool cacheBatch(quint64 block, QByteArray frame);
+
+    [[nodiscard]] const std::deque<Entry> &entries() const;
+    [[nodiscard]] const SenderTable &senders() const;
+
+private:
+    void appendEntry(const ChatMessage &message, QByteArray frame, HistorySegments::Location location);
+    static qsizetype footprint(const Entry &entry);
+    void evictOverflow();
+    void releaseEvictedSegments();
+    // Имя отправителя освобождается вместе с его последней записью
+    void retainSender(quint32 id);
+    void releaseSender(quint32 id);
+
+    std::deque<Entry> m_entries;
+    SenderTable m_senders;
+    // Число записей на каждый идентификатор отправителя
+    std::vector<quint32> m_senderRefs;
+    // (идентификатор отправителя, время в мс) → номер записи. Идентификатор освобождается
+    // только вместе с последней записью отправителя, поэтому ключи не устаревают.
+    QHash<std::pair<quint32, qint64>, quint64> m_bySenderTime;
+    HistorySegments m_segments;
+    QHash<quint64, QByteArray> m_batchCache;
+    quint64 m_nextSeq = 1;
+    bool m_loadingSegments = false;
+    qsizetype m_bytesUsed = 0;
+    qsizetype m_maxBytes;
+    qsizetype m_maxMessages;
+};
@@ -0,0 +1,160 @@
+#include "OutboundExecutor.h"
+
+#include "Actor.h"
+#include "ClientConnection.h"
+#include "HeaderCompression.h"
+#include "SessionEncoder.h"
+#include "WorkStealingPool.h"
+
+#include <QMetaObject>
+#include <QPointer>
+#include <utility>
+
+namespace {
+// Готовые байты кадра и сколько байт было учтено в пути при постановке
+struct EncodedFrame {
+    QPointer<ClientConnection> connection;
+    QByteArray bytes;
+    qint64 accounted = 0;
+};
+} // namespace
+
+OutboundExecutor::Fanout::Fanout(OutboundExecutor &executor, const ChatMessage &message, const QByteArray &frame)
+    : m_executor(executor)
+    , m_message(message)
+    , m_frame(frame)
+{
+}
+
+void OutboundExecutor::Fanout::add(ClientConnection *connection)
+{
+    // Текст для кадров со сжатыми заголовками кодируется один раз и только
+    // если среди получателей есть такие клиенты
+    if (connection->hasHeaderCompression() && m_encodedText.isEmpty()) {
+        m_encodedText = HeaderEncoder::encodeText(m_message.text());
+    }
+    if (!m_executor.isParallel() || connection->m_session == nullptr) {
+        connection->sendChatMessage(m_message, m_frame, m_encodedText);
+        return;
+    }
+    connection->m_session->beginOutbound(m_frame.size());
+    m_executor.m_fanoutShards[m_executor.shardOf(connection)].push_back(connection);
+}
+
+void OutboundExecutor::Fanout::dispatch()
+{
+    auto &shards = m_executor.m_fanoutShards;
+    for (std::size_t shard = 0; shard < shards.size(); ++shard) {
+        if (shards[shard].empty()) {
+            continue;
+        }
+
+        // Указатели на SessionEncoder берутся здесь: в рабочем потоке соединение не трогаем
+        std::vector<std::pair<SessionEncoder *, EncodedFrame>> batch;
+        batch.reserve(shards[shard].size());
+        for (ClientConnection *connection : shards[shard]) {
+            batch.push_back({connection->m_session.get(), EncodedFrame{connection, {}, m_frame.size()}});
+        }
+        shards[shard].clear();
+
+        OutboundExecutor *executor = &m_executor;
+        m_executor.m_actors[shard]->post([executor, batch = std::move(batch), message = m_message, frame = m_frame,
+                                          encodedText = m_encodedText]() mutable {
+            std::vector<EncodedFrame> encoded;
+            encoded.reserve(batch.size());
+            for (auto &[session, result] : batch) {
+                result.bytes = session->encodeChatMessage(message, frame, encodedText);
+                encoded.push_back(std::move(result));
+            }
+            // Одно событие главного потока на весь шард
+            QMetaObject::invokeMethod(executor, [encoded = std::move(encoded)]() {
+                for (const EncodedFrame &result : encoded) {
+                    if (result.connection) {
+                        result.connection->completeOutbound(result.bytes, result.accounted);
+                    }
+                }
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+OutboundExecutor::OutboundExecutor(QObject *parent)
+    : QObject(parent)
+{
+}
+
+OutboundExecutor::~OutboundExecutor()
+{
+    stop();
+}
+
+void OutboundExecutor::start(int threadCount)
+{
+    stop();
+    if (threadCount <= 0) {
+        return;
+    }
+
+    m_pool = std::make_unique<WorkStealingPool>(threadCount);
+    const int actorCount = threadCount * kActorsPerThread;
+    m_actors.reserve(std::size_t(actorCount));
+    for (int i = 0; i < actorCount; ++i) {
+        m_actors.push_back(std::make_unique<Actor>(m_pool.get()));
+    }
+    m_fanoutShards.resize(m_actors.size());
+}
+
+void OutboundExecutor::stop()
+{
+    // Деструктор пула выполняет оставшиеся задачи и дожидается потоков, только потом уходят акторы
+    m_pool.reset();
+    m_actors.clear();
+    m_fanoutShards.clear();
+}
+
+bool OutboundExecutor::isParallel() const
+{
+    return m_pool != nullptr;
+}
+
+int OutboundExecutor::threadCount() const
+{
+    return m_pool ? m_pool->threadCount() : 0;
+}
+
+void OutboundExecutor::sendFrame(ClientConnection *connection, const QByteArray &frame)
+{
+    post(connection, frame.size(), [frame](SessionEncoder &session) { return session.encodeFrame(frame); });
+}
+
+void OutboundExecutor::sendChatMessage(ClientConnection *connection, const ChatMessage &message,
+                                       const QByteArray &frame, const QByteArray &encodedText)
+{
+    post(connection, frame.size(), [message, frame, encodedText](SessionEncoder &session) {
+        return session.encodeChatMessage(message, frame, encodedText);
+    });
+}
+
+void OutboundExecutor::post(ClientConnection *connection, qint64 accounted,
+                            std::function<QByteArray(SessionEncoder &)> encode)
+{
+    SessionEncoder *session = connection->m_session.get();
+    Q_ASSERT(session);
+    session->beginOutbound(accounted);
+
+    m_actors[shardOf(connection)]->post([this, session, result = EncodedFrame{connection, {}, accounted},
+                                         encode = std::move(encode)]() mutable {
+        result.bytes = encode(*session);
+        QMetaObject::invokeMethod(this, [result = std::move(result)]() {
+            if (result.connection) {
+                result.connection->completeOutbound(result.bytes, result.accounted);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+std::size_t OutboundExecutor::shardOf(const ClientConnection *connection) const
+{
+    // Номера выдаются подряд при подключении, поэтому соединения ложатся на шарды по кругу
+    return std::size_t(connection->m_ordinal) % m_actors.size();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ChatMessage.h"
+
+#include <QByteArray>
+#include <QObject>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class Actor;
+class ClientConnection;
+class SessionEncoder;
+class WorkStealingPool;
+
+// Кодирование исходящих кадров (сжатые заголовки и deflate) в рабочих потоках.
+// Сокеты Qt привязаны к потоку, поэтому состояние чата и запись в сеть остаются
+// в главном цикле событий; в пул уходит только CPU-работа над кадрами. Соединения
+// распределены по акторам-шардам: кадры одного соединения кодирует один актор по
+// порядку, а готовые байты возвращаются в главный поток очередью событий — тоже
+// по порядку. Все методы вызываются из главного потока.
+class OutboundExecutor final : public QObject {
+    Q_OBJECT
+
+public:
+    // Акторов больше, чем потоков, чтобы пулу было что перераспределять
+    static constexpr int kActorsPerThread = 4;
+
+    // Сообщение комнаты для многих получателей: одна задача на шард вместо задачи на соединение.
+    // Списки получателей по шардам принадлежат исполнителю и переиспользуются между рассылками,
+    // поэтому одновременно существует не больше одной рассылки и dispatch обязателен.
+    class Fanout {
+    public:
+        Fanout(OutboundExecutor &executor, const ChatMessage &message, const QByteArray &frame);
+        Fanout(const Fanout &) = delete;
+        Fanout &operator=(const Fanout &) = delete;
+
+        void add(ClientConnection *connection);
+        void dispatch();
+
+    private:
+        OutboundExecutor &m_executor;
+        const ChatMessage &m_message;
+        const QByteArray &m_frame;
+        QByteArray m_encodedText;
+    };
+
+    explicit OutboundExecutor(QObject *parent = nullptr);
+    ~OutboundExecutor() override;
+
+    // 0 потоков — кодирование прямо в главном потоке, как без пула.
+    void start(int threadCount);
+    // Дожидается уже отданных кадров; после этого кодирование снова синхронное.
+    void stop();
+    [[nodiscard]] bool isParallel() const;
+    [[nodiscard]] int threadCount() const;
+
+    // Соединение должно иметь SessionEncoder.
+    void sendFrame(ClientConnection *connection, const QByteArray &frame);
+    void sendChatMessage(ClientConnection *connection, const ChatMessage &message, const QByteArray &frame,
+                         const QByteArray &encodedText);
+
+private:
+    // Ставит кодирование кадра в актор соединения; accounted байт считаются в пути до записи.
+    void post(ClientConnection *connection, qint64 accounted, std::function<QByteArray(SessionEncoder &)> encode);
+    [[nodiscard]] std::size_t shardOf(const ClientConnection *connection) const;
+
+    // Пул объявлен после акторов и разрушается первым: его потоки ещё выполняют их задачи
+    std::vector<std::unique_ptr<Actor>> m_actors;
+    std::unique_ptr<WorkStealingPool> m_pool;
+    // Получатели текущей рассылки по шардам; ёмкость сохраняется между сообщениями
+    std::vector<std::vector<ClientConnection *>> m_fanoutShards;
+};
@@ -0,0 +1,152 @@
+#include "PeerLink.h"
+
+#include <QLoggingCategory>
+#include <QTcpSocket>
+#include <algorithm>
+#include <utility>
+
+Q_LOGGING_CATEGORY(chatCluster, "kukaracha.server.cluster")
+
+namespace {
+constexpr int kInitialReconnectDelayMs = 1000;
+constexpr int kMaxReconnectDelayMs = 30000;
+} // namespace
+
+PeerLink::PeerLink(QString host, quint16 port, QObject *parent)
+    : QObject(parent)
+    , m_socket(new QTcpSocket(this))
+    , m_host(std::move(host))
+    , m_reconnectDelayMs(kInitialReconnectDelayMs)
+    , m_port(port)
+    , m_outgoing(true)
+{
+    m_reconnectTimer.setSingleShot(true);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, &PeerLink::open);
+    connect(m_socket, &QTcpSocket::connected, this, [this]() { emit connected(this); });
+    connect(m_socket, &QTcpSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+        // Неудачная попытка подключения не даёт disconnected, пробуем снова отсюда
+        if (m_socket->state() == QAbstractSocket::UnconnectedState) {
+            scheduleReconnect();
+        }
+    });
+    connect(m_socket, &QTcpSocket::readyRead, this, &PeerLink::handleReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, &PeerLink::handleDisconnected);
+    connect(m_socket, &QTcpSocket::bytesWritten, this, [this]() { emit drained(this); });
+}
+
+PeerLink::PeerLink(QTcpSocket *socket, QObject *parent)
+    : QObject(parent)
+    , m_socket(socket)
+    , m_reconnectDelayMs(kInitialReconnectDelayMs)
+    , m_outgoing(false)
+{
+    m_socket->setParent(this);
+    connect(m_socket, &QTcpSocket::readyRead, this, &PeerLink::handleReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, &PeerLink::handleDisconnected);
+    connect(m_socket, &QTcpSocket::bytesWritten, this, [this]() { emit drained(this); });
+}
+
+bool PeerLink::isOutgoing() const
+{
+    return m_outgoing;
+}
+
+bool PeerLink::isEstablished() const
+{
+    return !m_nodeId.isEmpty();
+}
+
+const QString &PeerLink::nodeId() const
+{
+    return m_nodeId;
+}
+
+void PeerLink::setNodeId(QString nodeId)
+{
+    m_nodeId = std::move(nodeId);
+    m_reconnectDelayMs = kInitialReconnectDelayMs;
+}
+
+QString PeerLink::address() const
+{
+    if (m_outgoing) {
+        return QStringLiteral("%1:%2").arg(m_host).arg(m_port);
+    }
+    return QStringLiteral("%1:%2").arg(m_socket->peerAddress().toString()).arg(m_socket->peerPort());
+}
+
+void PeerLink::open()
+{
+    if (!m_outgoing || m_closing || m_socket->state() != QAbstractSocket::UnconnectedState) {
+        return;
+    }
+    m_socket->connectToHost(m_host, m_port);
+}
+
+void PeerLink::close()
+{
+    m_closing = true;
+    m_reconnectTimer.stop();
+    if (m_socket->state() != QAbstractSocket::UnconnectedState) {
+        m_socket->abort();
+    }
+}
+
+void PeerLink::sendLine(const QByteArray &line)
+{
+    if (m_socket->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+    if (m_socket->bytesToWrite() > kMaxBacklog) {
+        qCWarning(chatCluster) << "Узел" << m_nodeId << "не успевает читать, связь разорвана";
+        m_socket->abort();
+        return;
+    }
+    m_socket->write(line);
+}
+
+qint64 PeerLink::pendingBytes() const
+{
+    return m_socket->bytesToWrite();
+}
+
+void PeerLink::handleReadyRead()
+{
+    m_buffer.append(m_socket->readAll());
+
+    qsizetype start = 0;
+    qsizetype newlineIndex = -1;
+    while ((newlineIndex = m_buffer.indexOf('\n', start)) != -1) {
+        emit lineReceived(this, m_buffer.sliced(start, newlineIndex - start));
+        start = newlineIndex + 1;
+        // Обработчик мог закрыть связь: остаток буфера уже не нужен
+        if (m_socket->state() != QAbstractSocket::ConnectedState) {
+            m_buffer.clear();
+            return;
+        }
+    }
+    m_buffer.remove(0, start);
+
+    if (m_buffer.size() > kMaxLineSize) {
+        qCWarning(chatCluster) << "Слишком длинная строка от узла" << address();
+        m_buffer.clear();
+        m_socket->abort();
+    }
+}
+
+void PeerLink::handleDisconnected()
+{
+    m_buffer.clear();
+    emit disconnected(this);
+    m_nodeId.clear();
+    scheduleReconnect();
+}
+
+void PeerLink::scheduleReconnect()
+{
+    if (!m_outgoing || m_closing || m_reconnectTimer.isActive()) {
+        return;
+    }
+    m_reconnectTimer.start(m_reconnectDelayMs);
+    m_reconnectDelayMs = std::min(m_reconnectDelayMs * 2, kMaxReconnectDelayMs);
+}
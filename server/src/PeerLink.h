@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+class QTcpSocket;
+
+// Связь с соседним узлом кластера: строки, завершённые '\n', в обе стороны.
+// Исходящая связь сама переподключается с нарастающей паузой, входящая
+// живёт до разрыва. Смысл строк разбирает ClusterRelay.
+class PeerLink final : public QObject {
+    Q_OBJECT
+
+public:
+    // Больше этого в буфере сокета не копим: соседа, который не успевает читать, отключаем
+    static constexpr qint64 kMaxBacklog = 8 * 1024 * 1024;
+    static constexpr qsizetype kMaxLineSize = 1024 * 1024;
+
+    // Исходящая связь к host:port.
+    PeerLink(QString host, quint16 port, QObject *parent = nullptr);
+    // Входящая связь на уже принятом сокете; сокет переходит во владение связи.
+    explicit PeerLink(QTcpSocket *socket, QObject *parent = nullptr);
+
+    [[nodiscard]] bool isOutgoing() const;
+    // Сосед представился (прислал своё имя узла).
+    [[nodiscard]] bool isEstablished() const;
+    [[nodiscard]] const QString &nodeId() const;
+    void setNodeId(QString nodeId);
+    [[nodiscard]] QString address() const;
+
+    // Исходящая связь начинает подключаться; для входящей ничего не делает.
+    void open();
+    // Разрывает связь и больше не переподключается.
+    void close();
+    void sendLine(const QByteArray &line);
+    // Сколько байт ещё ждёт отправки в буфере сокета.
+    [[nodiscard]] qint64 pendingBytes() const;
+
+signals:
+    void connected(PeerLink *link);
+    void lineReceived(PeerLink *link, const QByteArray &line);
+    void disconnected(PeerLink *link);
+    // Сокет отдал часть буфера в сеть.
+    void drained(PeerLink *link);
+
+private:
+    void handleReadyRead();
+    void handleDisconnected();
+    void scheduleReconnect();
+
+    QTcpSocket *m_socket;
+    QTimer m_reconnectTimer;
+    QString m_host;
+    QString m_nodeId;
+    QByteArray m_buffer;
+    int m_reconnectDelayMs;
+    quint16 m_port = 0;
+    bool m_outgoing;
+    bool m_closing = false;
+};
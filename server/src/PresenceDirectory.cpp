@@ -0,0 +1,209 @@
+#include "PresenceDirectory.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+namespace {
+const QString kNodeKey = QStringLiteral("node");
+const QString kIncarnationKey = QStringLiteral("incarnation");
+const QString kVersionKey = QStringLiteral("version");
+const QString kUsersKey = QStringLiteral("users");
+} // namespace
+
+void PresenceDirectory::reset(QString localNode, quint64 incarnation)
+{
+    m_localNode = std::move(localNode);
+    m_local = Entry{};
+    m_local.incarnation = incarnation;
+    m_remote.clear();
+    m_owners.clear();
+}
+
+void PresenceDirectory::addLocal(const QString &user, qint64 sinceMs)
+{
+    if (m_local.users.contains(user)) {
+        return;
+    }
+    m_local.users.insert(user, sinceMs);
+    ++m_local.version;
+    ++m_owners[user];
+}
+
+void PresenceDirectory::removeLocal(const QString &user)
+{
+    if (m_local.users.remove(user) == 0) {
+        return;
+    }
+    ++m_local.version;
+    auto it = m_owners.find(user);
+    if (--it.value() == 0) {
+        m_owners.erase(it);
+    }
+}
+
+bool PresenceDirectory::contains(const QString &user) const
+{
+    return m_owners.contains(user);
+}
+
+bool PresenceDirectory::containsRemote(const QString &user) const
+{
+    return m_owners.value(user) > (m_local.users.contains(user) ? 1 : 0);
+}
+
+QStringList PresenceDirectory::users() const
+{
+    return m_owners.keys();
+}
+
+QByteArray PresenceDirectory::encodeLocal() const
+{
+    QJsonArray entries;
+    appendEntry(entries, m_localNode, m_local);
+    return QJsonDocument(entries).toJson(QJsonDocument::Compact);
+}
+
+QByteArray PresenceDirectory::encodeAll() const
+{
+    // Записи других узлов тоже передаются: так состояние доходит и через посредника
+    QJsonArray entries;
+    appendEntry(entries, m_localNode, m_local);
+    for (auto it = m_remote.cbegin(); it != m_remote.cend(); ++it) {
+        if (!it->lost) {
+            appendEntry(entries, it.key(), it.value());
+        }
+    }
+    return QJsonDocument(entries).toJson(QJsonDocument::Compact);
+}
+
+PresenceDirectory::MergeResult PresenceDirectory::merge(const QByteArray &payload, qint64 nowMs)
+{
+    const auto document = QJsonDocument::fromJson(payload);
+    if (!document.isArray()) {
+        throw std::runtime_error("Invalid presence payload: not a JSON array");
+    }
+
+    MergeResult result;
+    const auto entries = document.array();
+    for (const auto &value : entries) {
+        const auto object = value.toObject();
+        const auto node = object.value(kNodeKey).toString();
+        const auto users = object.value(kUsersKey);
+        if (node.isEmpty() || !users.isObject()) {
+            throw std::runtime_error("Invalid presence payload: malformed entry");
+        }
+        // Свою запись пишет только этот узел
+        if (node == m_localNode) {
+            continue;
+        }
+
+        Entry entry;
+        entry.incarnation = quint64(object.value(kIncarnationKey).toDouble());
+        entry.version = quint64(object.value(kVersionKey).toDouble());
+        entry.refreshedMs = nowMs;
+        auto it = m_remote.find(node);
+        if (it != m_remote.end()) {
+            const auto incoming = std::tie(entry.incarnation, entry.version);
+            const auto stored = std::tie(it->incarnation, it->version);
+            if (incoming < stored) {
+                continue;
+            }
+            // Повтор той же записи только продлевает её; потерянную — воскрешает:
+            // узел снова доступен, пусть и через посредника
+            if (incoming == stored && !it->lost) {
+                it->refreshedMs = nowMs;
+                continue;
+            }
+        }
+
+        const auto userObject = users.toObject();
+        for (auto user = userObject.begin(); user != userObject.end(); ++user) {
+            entry.users.insert(user.key(), qint64(user.value().toDouble()));
+        }
+
+        if (it == m_remote.end()) {
+            it = m_remote.insert(node, Entry{});
+        } else if (!it->lost) {
+            unindex(*it);
+        }
+        *it = std::move(entry);
+        index(*it);
+        result.changed = true;
+
+        // Один логин на двух узлах: остаётся более ранний вход, при равенстве — узел с меньшим именем.
+        // Оба узла сравнивают одинаково, поэтому сессию закрывает ровно один из них.
+        for (auto user = it->users.cbegin(); user != it->users.cend(); ++user) {
+            const auto local = m_local.users.constFind(user.key());
+            if (local != m_local.users.cend()
+                && std::tie(user.value(), node) < std::tie(local.value(), m_localNode)) {
+                result.evicted.append(user.key());
+            }
+        }
+    }
+    return result;
+}
+
+bool PresenceDirectory::markLost(const QString &nodeId)
+{
+    auto it = m_remote.find(nodeId);
+    if (it == m_remote.end() || it->lost) {
+        return false;
+    }
+    markLost(*it);
+    return true;
+}
+
+QStringList PresenceDirectory::expire(qint64 nowMs, qint64 maxAgeMs)
+{
+    QStringList expired;
+    for (auto it = m_remote.begin(); it != m_remote.end(); ++it) {
+        if (!it->lost && nowMs - it->refreshedMs > maxAgeMs) {
+            markLost(*it);
+            expired.append(it.key());
+        }
+    }
+    return expired;
+}
+
+void PresenceDirectory::markLost(Entry &entry)
+{
+    // Версия остаётся: более старые записи её не воскресят
+    unindex(entry);
+    entry.users.clear();
+    entry.lost = true;
+}
+
+void PresenceDirectory::index(const Entry &entry)
+{
+    for (auto it = entry.users.cbegin(); it != entry.users.cend(); ++it) {
+        ++m_owners[it.key()];
+    }
+}
+
+void PresenceDirectory::unindex(const Entry &entry)
+{
+    for (auto it = entry.users.cbegin(); it != entry.users.cend(); ++it) {
+        auto owner = m_owners.find(it.key());
+        if (owner != m_owners.end() && --owner.value() == 0) {
+            m_owners.erase(owner);
+        }
+    }
+}
+
+void PresenceDirectory::appendEntry(QJsonArray &out, const QString &node, const Entry &entry)
+{
+    QJsonObject users;
+    for (auto it = entry.users.cbegin(); it != entry.users.cend(); ++it) {
+        users.insert(it.key(), double(it.value()));
+    }
+    out.append(QJsonObject{
+        {kNodeKey, node},
+        {kIncarnationKey, double(entry.incarnation)},
+        {kVersionKey, double(entry.version)},
+        {kUsersKey, users},
+    });
+}
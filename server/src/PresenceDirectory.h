@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+class QJsonArray;
+
+// Каталог присутствия всего кластера. Каждый узел пишет только свою запись
+// (пользователи и время их входа) и повышает её версию при каждом изменении;
+// записи других узлов приходят целиком и сливаются по старшинству пары
+// (запуск узла, версия). Такое слияние не зависит от порядка и повторов,
+// поэтому после восстановления связи каталоги узлов сходятся. Пользователь
+// в сети, пока его перечисляет хотя бы одна запись (добавление побеждает).
+// Узлы периодически повторяют свою запись; запись, которую давно никто не
+// подтверждал, считается потерянной — так уходят и узлы, доступные только
+// через посредника. Потерянную запись воскрешает любая не более старая.
+// Запросы обслуживает локальный индекс за O(1), без обращения к соседям.
+class PresenceDirectory {
+public:
+    struct MergeResult {
+        bool changed = false;
+        // Свои пользователи, вошедшие на другом узле раньше: их сессии здесь закрываются
+        QStringList evicted;
+    };
+
+    // Начинает каталог заново от имени узла localNode.
+    void reset(QString localNode, quint64 incarnation);
+
+    void addLocal(const QString &user, qint64 sinceMs);
+    void removeLocal(const QString &user);
+
+    [[nodiscard]] bool contains(const QString &user) const;
+    // Пользователь подключён к какому-то другому узлу.
+    [[nodiscard]] bool containsRemote(const QString &user) const;
+    [[nodiscard]] QStringList users() const;
+
+    // Своя запись или все известные записи: JSON-массив в одну строку.
+    [[nodiscard]] QByteArray encodeLocal() const;
+    [[nodiscard]] QByteArray encodeAll() const;
+    // nowMs — время получения: повтор уже известной записи продлевает её жизнь.
+    // Бросает std::runtime_error, если данные некорректны.
+    MergeResult merge(const QByteArray &payload, qint64 nowMs);
+    // Узел недоступен: его пользователи скрываются, пока запись не придёт снова.
+    bool markLost(const QString &nodeId);
+    // Помечает потерянными записи, не подтверждённые дольше maxAgeMs; возвращает их узлы.
+    QStringList expire(qint64 nowMs, qint64 maxAgeMs);
+
+private:
+    struct Entry {
+        quint64 incarnation = 0;
+        quint64 version = 0;
+        // Имя пользователя → время входа (мс с начала эпохи)
+        QHash<QString, qint64> users;
+        // Когда запись последний раз приходила от соседей
+        qint64 refreshedMs = 0;
+        bool lost = false;
+    };
+
+    void index(const Entry &entry);
+    void unindex(const Entry &entry);
+    void markLost(Entry &entry);
+    static void appendEntry(QJsonArray &out, const QString &node, const Entry &entry);
+
+    QString m_localNode;
+    Entry m_local;
+    QHash<QString, Entry> m_remote;
+    // Сколько записей перечисляют пользователя
+    QHash<QString, int> m_owners;
+};
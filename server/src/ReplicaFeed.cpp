@@ -0,0 +1,191 @@
+#include "ReplicaFeed.h"
+
+#include "MessageHistory.h"
+#include "PeerLink.h"
+
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <QTcpSocket>
+#include <algorithm>
+#include <utility>
+
+namespace {
+Q_LOGGING_CATEGORY(chatReplication, "kukaracha.server.replication")
+} // namespace
+
+ReplicaFeed::ReplicaFeed(QObject *parent)
+    : QObject(parent)
+    // Номера записей истории имеют смысл только внутри одного запуска сервера
+    , m_incarnation(quint64(QDateTime::currentMSecsSinceEpoch()))
+{
+    connect(&m_listener, &QTcpServer::newConnection, this, &ReplicaFeed::acceptStandby);
+}
+
+ReplicaFeed::~ReplicaFeed()
+{
+    stop();
+}
+
+bool ReplicaFeed::start(quint16 port)
+{
+    if (!m_listener.listen(QHostAddress::LocalHost, port)) {
+        return false;
+    }
+    qCInfo(chatReplication) << "Поток репликации на порту" << m_listener.serverPort();
+    return true;
+}
+
+void ReplicaFeed::stop()
+{
+    m_listener.close();
+    for (PeerLink *link : std::as_const(m_links)) {
+        disconnect(link, nullptr, this, nullptr);
+        link->close();
+        link->deleteLater();
+    }
+    m_links.clear();
+    m_cursors.clear();
+}
+
+QString ReplicaFeed::errorString() const
+{
+    return m_listener.errorString();
+}
+
+void ReplicaFeed::addHistory(const QString &room, const MessageHistory &history)
+{
+    m_histories.insert(room, &history);
+    // Резервы, уже идущие за потоком, получают новую комнату с начала
+    for (auto it = m_cursors.begin(); it != m_cursors.end(); ++it) {
+        it->insert(room, history.firstSeq());
+    }
+}
+
+void ReplicaFeed::publish(const QString &room)
+{
+    // Запись может разорвать связь и убрать курсор, поэтому обходим копию списка
+    const auto links = m_cursors.keys();
+    for (PeerLink *link : links) {
+        pumpRoom(link, room);
+    }
+}
+
+void ReplicaFeed::publishBans(const QSet<QString> &bans)
+{
+    m_bansLine = "B ";
+    m_bansLine.append(QJsonDocument(QJsonArray::fromStringList(QStringList(bans.cbegin(), bans.cend())))
+                          .toJson(QJsonDocument::Compact));
+    m_bansLine.append('\n');
+    const auto links = m_cursors.keys();
+    for (PeerLink *link : links) {
+        link->sendLine(m_bansLine);
+    }
+}
+
+void ReplicaFeed::acceptStandby()
+{
+    while (m_listener.hasPendingConnections()) {
+        auto *link = new PeerLink(m_listener.nextPendingConnection(), this);
+        connect(link, &PeerLink::lineReceived, this, &ReplicaFeed::handleLine);
+        connect(link, &PeerLink::disconnected, this, &ReplicaFeed::handleDisconnected);
+        connect(link, &PeerLink::drained, this, &ReplicaFeed::pump);
+        m_links.append(link);
+        qCInfo(chatReplication) << "Подключился резервный сервер" << link->address();
+    }
+}
+
+void ReplicaFeed::handleLine(PeerLink *link, const QByteArray &line)
+{
+    // F <запуск> [<комната>=<номер> ...]
+    const auto parts = line.split(' ');
+    bool incarnationOk = false;
+    const quint64 incarnation = parts.size() >= 2 ? parts.at(1).toULongLong(&incarnationOk) : 0;
+    if (parts.size() < 2 || parts.at(0) != "F" || !incarnationOk) {
+        qCWarning(chatReplication) << "Некорректный запрос от резервного сервера" << link->address();
+        link->close();
+        return;
+    }
+
+    QHash<QString, quint64> received;
+    for (qsizetype i = 2; i < parts.size(); ++i) {
+        const auto equals = parts.at(i).indexOf('=');
+        bool seqOk = false;
+        const quint64 nextSeq = equals > 0 ? parts.at(i).sliced(equals + 1).toULongLong(&seqOk) : 0;
+        if (seqOk) {
+            received.insert(QString::fromUtf8(parts.at(i).first(equals)), nextSeq);
+        }
+    }
+
+    // Резерв этого же запуска продолжает с места остановки, иначе принимает историю заново
+    QHash<QString, quint64> cursors;
+    for (auto it = m_histories.cbegin(); it != m_histories.cend(); ++it) {
+        const MessageHistory &history = *it.value();
+        quint64 fromSeq = history.firstSeq();
+        const auto resumed = received.constFind(it.key());
+        if (incarnation == m_incarnation && resumed != received.cend() && resumed.value() >= fromSeq
+            && resumed.value() <= history.endSeq()) {
+            fromSeq = resumed.value();
+        }
+        cursors.insert(it.key(), fromSeq);
+    }
+
+    QByteArray reply = "R ";
+    reply.append(QByteArray::number(m_incarnation)).append('\n');
+    link->sendLine(reply);
+    if (!m_bansLine.isEmpty()) {
+        link->sendLine(m_bansLine);
+    }
+    m_cursors.insert(link, std::move(cursors));
+    qCInfo(chatReplication) << "Резерв" << link->address() << "получит историю" << m_histories.size() << "комнат";
+    pump(link);
+}
+
+void ReplicaFeed::handleDisconnected(PeerLink *link)
+{
+    qCWarning(chatReplication) << "Резервный сервер отключился" << link->address();
+    m_cursors.remove(link);
+    m_links.removeOne(link);
+    link->deleteLater();
+}
+
+void ReplicaFeed::pump(PeerLink *link)
+{
+    const auto cursors = m_cursors.constFind(link);
+    if (cursors == m_cursors.cend()) {
+        return;
+    }
+    const auto rooms = cursors->keys();
+    for (const QString &room : rooms) {
+        pumpRoom(link, room);
+    }
+}
+
+void ReplicaFeed::pumpRoom(PeerLink *link, const QString &room)
+{
+    const auto cursors = m_cursors.constFind(link);
+    const MessageHistory *history = m_histories.value(room);
+    if (cursors == m_cursors.cend() || history == nullptr) {
+        return;
+    }
+
+    // Записи, вытесненные раньше, чем резерв их получил, пропускаются
+    quint64 seq = std::max(cursors->value(room), history->firstSeq());
+    const quint64 endSeq = history->endSeq();
+    const QByteArray roomUtf8 = room.toUtf8();
+    while (seq < endSeq && link->pendingBytes() < kLowWatermark) {
+        const QByteArray &frame = history->entry(seq).frame;
+        QByteArray line;
+        line.reserve(frame.size() + roomUtf8.size() + 24);
+        line.append("M ").append(roomUtf8).append(' ').append(QByteArray::number(seq)).append(' ').append(frame);
+        link->sendLine(line);
+        ++seq;
+    }
+
+    // Запись могла разорвать связь: курсор обновляется, только если резерв ещё здесь
+    const auto it = m_cursors.find(link);
+    if (it != m_cursors.end()) {
+        it->insert(room, seq);
+    }
+}
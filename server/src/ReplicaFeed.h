@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QTcpServer>
+
+class MessageHistory;
+class PeerLink;
+
+// Поток репликации основного сервера для резервных (StandbyReplica).
+// Резерв подключается к локальному порту и получает историю каждой комнаты
+// с того места, где остановился, а дальше — каждую новую запись и изменения
+// бан-листа. История отдаётся из MessageHistory по курсору и не дальше порога
+// буфера сокета, поэтому отстающий резерв не раздувает память основного сервера.
+//
+// Строки протокола:
+//   F <запуск> [<комната>=<номер> ...] — резерв: последний принятый запуск и следующие номера записей
+//   R <запуск>                         — основной: записи пойдут от этого запуска
+//   M <комната> <номер> <кадр>         — запись истории комнаты
+//   B <JSON-массив логинов>            — бан-лист целиком
+class ReplicaFeed final : public QObject {
+    Q_OBJECT
+
+public:
+    // Ниже этого заполнения буфера сокета дописывается следующая часть истории
+    static constexpr qint64 kLowWatermark = 256 * 1024;
+
+    explicit ReplicaFeed(QObject *parent = nullptr);
+    ~ReplicaFeed() override;
+
+    // Слушает только локальный интерфейс.
+    bool start(quint16 port);
+    void stop();
+    [[nodiscard]] QString errorString() const;
+
+    // История новой комнаты; должна жить дольше потока.
+    void addHistory(const QString &room, const MessageHistory &history);
+    // В историю комнаты добавлены записи: резервы получают их по своим курсорам.
+    void publish(const QString &room);
+    void publishBans(const QSet<QString> &bans);
+
+private:
+    void acceptStandby();
+    void handleLine(PeerLink *link, const QByteArray &line);
+    void handleDisconnected(PeerLink *link);
+    void pump(PeerLink *link);
+    void pumpRoom(PeerLink *link, const QString &room);
+
+    QHash<QString, const MessageHistory *> m_histories;
+    QTcpServer m_listener;
+    QList<PeerLink *> m_links;
+    // Следующий номер записи каждой комнаты для каждого резерва, приславшего F
+    QHash<PeerLink *, QHash<QString, quint64>> m_cursors;
+    QByteArray m_bansLine;
+    quint64 m_incarnation = 0;
+};
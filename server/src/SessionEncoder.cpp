@@ -0,0 +1,86 @@
+#include "SessionEncoder.h"
+
+#include "HeaderCompression.h"
+
+#include <utility>
+
+SessionEncoder::SessionEncoder(std::unique_ptr<StreamCompression> compression, bool headerCompression)
+    : m_compression(std::move(compression))
+    , m_headers(headerCompression ? std::make_unique<HeaderEncoder>() : nullptr)
+{
+}
+
+SessionEncoder::~SessionEncoder() = default;
+
+bool SessionEncoder::isCompressed() const
+{
+    return m_compression != nullptr;
+}
+
+bool SessionEncoder::hasHeaderCompression() const
+{
+    return m_headers != nullptr;
+}
+
+QByteArray SessionEncoder::encodeFrame(const QByteArray &frame)
+{
+    // Каждый кадр сжимается с синхронным сбросом, так что клиент разбирает его сразу
+    return m_compression ? m_compression->compress(frame) : frame;
+}
+
+QByteArray SessionEncoder::encodeChatMessage(const ChatMessage &message, const QByteArray &frame,
+                                             const QByteArray &encodedText)
+{
+    if (m_headers) {
+        const auto compact = m_headers->encode(message, encodedText);
+        if (!compact.isEmpty()) {
+            return encodeFrame(compact);
+        }
+    }
+    return encodeFrame(frame);
+}
+
+StreamCompression::InflateResult SessionEncoder::inflateStep(const QByteArray &input, qsizetype &offset,
+                                                             QByteArray &output, qsizetype maxOutput)
+{
+    // Распаковщик — отдельный поток zlib, с кодированием в акторе он не пересекается
+    if (m_compression == nullptr) {
+        return StreamCompression::InflateResult::Error;
+    }
+    return m_compression->inflateStep(input, offset, output, maxOutput);
+}
+
+void SessionEncoder::beginOutbound(qint64 bytes)
+{
+    m_bytesInFlight += bytes;
+}
+
+void SessionEncoder::finishOutbound(qint64 bytes)
+{
+    m_bytesInFlight -= bytes;
+}
+
+qint64 SessionEncoder::bytesInFlight() const
+{
+    return m_bytesInFlight;
+}
+
+void SessionEncoder::requestDisconnect()
+{
+    m_disconnectRequested = true;
+}
+
+bool SessionEncoder::isDisconnectRequested() const
+{
+    return m_disconnectRequested;
+}
+
+void SessionEncoder::markClosed()
+{
+    m_closed = true;
+}
+
+bool SessionEncoder::isClosed() const
+{
+    return m_closed;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "StreamCompression.h"
+
+#include <QByteArray>
+#include <QtGlobal>
+
+#include <memory>
+
+class ChatMessage;
+class HeaderEncoder;
+
+// Исходящее кодирование соединения после рукопожатия: сжатые заголовки и
+// deflate. Оба кодировщика ведут состояние потока, поэтому кадры одного
+// соединения кодируются строго по одному и в порядке отправки — в рабочем
+// потоке этим занимается актор соединения из OutboundExecutor. Распаковка
+// входящих байт и учёт кадров в пути остаются за главным потоком.
+class SessionEncoder {
+public:
+    SessionEncoder(std::unique_ptr<StreamCompression> compression, bool headerCompression);
+    ~SessionEncoder();
+
+    SessionEncoder(const SessionEncoder &) = delete;
+    SessionEncoder &operator=(const SessionEncoder &) = delete;
+
+    [[nodiscard]] bool isCompressed() const;
+    [[nodiscard]] bool hasHeaderCompression() const;
+
+    // Готовый кадр в том виде, в котором он уходит в сокет.
+    [[nodiscard]] QByteArray encodeFrame(const QByteArray &frame);
+    // Сообщение чата: со сжатыми заголовками, если таблица отправителей позволяет, иначе кадр frame.
+    [[nodiscard]] QByteArray encodeChatMessage(const ChatMessage &message, const QByteArray &frame,
+                                               const QByteArray &encodedText);
+    // Шаг распаковки входящих байт (см. StreamCompression::inflateStep).
+    [[nodiscard]] StreamCompression::InflateResult inflateStep(const QByteArray &input, qsizetype &offset,
+                                                               QByteArray &output, qsizetype maxOutput);
+
+    // Учёт главного потока: байты кадров, отданных актору и ещё не записанных в сокет.
+    void beginOutbound(qint64 bytes);
+    void finishOutbound(qint64 bytes);
+    [[nodiscard]] qint64 bytesInFlight() const;
+    // Отключение или удаление соединения откладывается до записи кадров в пути.
+    void requestDisconnect();
+    [[nodiscard]] bool isDisconnectRequested() const;
+    void markClosed();
+    [[nodiscard]] bool isClosed() const;
+
+private:
+    std::unique_ptr<StreamCompression> m_compression;
+    std::unique_ptr<HeaderEncoder> m_headers;
+    qint64 m_bytesInFlight = 0;
+    bool m_disconnectRequested = false;
+    bool m_closed = false;
+};
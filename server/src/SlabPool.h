@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Пул слотов фиксированного размера под объекты одного типа.
+// Память берётся пачками по SlotsPerSlab слотов, освобождённые слоты
+// попадают в free-list и переиспользуются без обращения к общему аллокатору.
+// Пул не потокобезопасен: все соединения живут в потоке сервера.
+template <typename T, std::size_t SlotsPerSlab = 64>
+class SlabPool {
+public:
+    SlabPool() = default;
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    [[nodiscard]] void *allocate()
+    {
+        if (m_freeList == nullptr) {
+            grow();
+        }
+        Slot *slot = m_freeList;
+        m_freeList = slot->next;
+        ++m_slotsInUse;
+        return slot->storage;
+    }
+
+    void deallocate(void *pointer) noexcept
+    {
+        if (pointer == nullptr) {
+            return;
+        }
+        auto *slot = reinterpret_cast<Slot *>(pointer);
+        slot->next = m_freeList;
+        m_freeList = slot;
+        --m_slotsInUse;
+    }
+
+    [[nodiscard]] std::size_t slotsInUse() const noexcept
+    {
+        return m_slotsInUse;
+    }
+
+    [[nodiscard]] std::size_t bytesReserved() const noexcept
+    {
+        return m_slabs.size() * SlotsPerSlab * sizeof(Slot);
+    }
+
+    [[nodiscard]] static constexpr std::size_t slotSize() noexcept
+    {
+        return sizeof(Slot);
+    }
+
+private:
+    union Slot {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void grow()
+    {
+        auto slab = std::make_unique<Slot[]>(SlotsPerSlab);
+        for (std::size_t i = SlotsPerSlab; i > 0; --i) {
+            slab[i - 1].next = m_freeList;
+            m_freeList = &slab[i - 1];
+        }
+        m_slabs.push_back(std::move(slab));
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> m_slabs;
+    Slot *m_freeList = nullptr;
+    std::size_t m_slotsInUse = 0;
+};
@@ -0,0 +1,145 @@
+#include "StandbyReplica.h"
+
+#include "ChatMessage.h"
+#include "IReplicaSink.h"
+#include "JsonCodec.h"
+#include "PeerLink.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <utility>
+
+namespace {
+Q_LOGGING_CATEGORY(chatStandby, "kukaracha.server.standby")
+} // namespace
+
+StandbyReplica::StandbyReplica(IReplicaSink *sink, QObject *parent)
+    : QObject(parent)
+    , m_sink(sink)
+{
+    Q_ASSERT(m_sink);
+    m_failoverTimer.setSingleShot(true);
+    connect(&m_failoverTimer, &QTimer::timeout, this, &StandbyReplica::promote);
+}
+
+StandbyReplica::~StandbyReplica()
+{
+    stop();
+}
+
+void StandbyReplica::start(QString host, quint16 port, int failoverTimeoutMs)
+{
+    stop();
+    m_failoverTimer.setInterval(failoverTimeoutMs);
+    m_link = new PeerLink(std::move(host), port, this);
+    connect(m_link, &PeerLink::connected, this, &StandbyReplica::sendHello);
+    connect(m_link, &PeerLink::lineReceived, this, [this](PeerLink *, const QByteArray &line) { handleLine(line); });
+    connect(m_link, &PeerLink::disconnected, this, &StandbyReplica::handleDisconnected);
+    m_link->open();
+    qCInfo(chatStandby) << "Резервный режим: следуем за" << m_link->address();
+}
+
+void StandbyReplica::stop()
+{
+    m_failoverTimer.stop();
+    if (m_link != nullptr) {
+        disconnect(m_link, nullptr, this, nullptr);
+        m_link->close();
+        m_link->deleteLater();
+        m_link = nullptr;
+    }
+}
+
+bool StandbyReplica::isActive() const
+{
+    return m_link != nullptr;
+}
+
+void StandbyReplica::sendHello()
+{
+    QByteArray hello = "F ";
+    hello.append(QByteArray::number(m_incarnation));
+    for (auto it = m_nextSeqs.cbegin(); it != m_nextSeqs.cend(); ++it) {
+        hello.append(' ').append(it.key().toUtf8()).append('=').append(QByteArray::number(it.value()));
+    }
+    hello.append('\n');
+    m_link->sendLine(hello);
+}
+
+void StandbyReplica::handleLine(const QByteArray &line)
+{
+    if (line.startsWith("M ")) {
+        // M <комната> <номер> <кадр>
+        const auto roomEnd = line.indexOf(' ', 2);
+        const auto seqEnd = roomEnd > 2 ? line.indexOf(' ', roomEnd + 1) : -1;
+        bool ok = false;
+        const quint64 seq = seqEnd > roomEnd + 1 ? line.sliced(roomEnd + 1, seqEnd - roomEnd - 1).toULongLong(&ok) : 0;
+        if (!ok) {
+            return;
+        }
+        const QString room = QString::fromUtf8(line.sliced(2, roomEnd - 2));
+        quint64 &nextSeq = m_nextSeqs[room];
+        if (seq < nextSeq) {
+            return;
+        }
+        nextSeq = seq + 1;
+        QByteArray frame = line.sliced(seqEnd + 1);
+        ChatMessage message;
+        try {
+            message = JsonCodec<ChatMessage>::decode(frame);
+        } catch (const std::exception &error) {
+            qCWarning(chatStandby) << "Пропущена запись истории" << room << seq << error.what();
+            return;
+        }
+        frame.append('\n');
+        m_sink->onReplicatedMessage(room, std::move(message), frame);
+        return;
+    }
+
+    if (line.startsWith("R ")) {
+        // R <запуск>; записи каждой комнаты пойдут с номера, который резерв ещё не видел
+        bool ok = false;
+        const quint64 incarnation = line.sliced(2).toULongLong(&ok);
+        if (!ok) {
+            qCWarning(chatStandby) << "Некорректный ответ основного сервера";
+            return;
+        }
+        if (incarnation != m_incarnation) {
+            qCInfo(chatStandby) << "Основной сервер перезапущен, история принимается заново";
+            m_nextSeqs.clear();
+            m_sink->onReplicaReset();
+        }
+        m_incarnation = incarnation;
+        m_synced = true;
+        m_failoverTimer.stop();
+        m_link->setNodeId(m_link->address());
+        return;
+    }
+
+    if (line.startsWith("B ")) {
+        const auto document = QJsonDocument::fromJson(line.sliced(2));
+        QStringList bans;
+        for (const auto &value : document.array()) {
+            bans.append(value.toString());
+        }
+        m_sink->onReplicatedBans(bans);
+    }
+}
+
+void StandbyReplica::handleDisconnected()
+{
+    if (!m_synced || m_failoverTimer.isActive()) {
+        return;
+    }
+    qCWarning(chatStandby) << "Связь с основным сервером потеряна, повышение через"
+                           << m_failoverTimer.interval() << "мс";
+    m_failoverTimer.start();
+}
+
+void StandbyReplica::promote()
+{
+    qCWarning(chatStandby) << "Основной сервер не вернулся, резерв становится основным";
+    stop();
+    m_sink->onPromoted();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+class IReplicaSink;
+class PeerLink;
+
+// Резервный сервер: следует за потоком ReplicaFeed основного и держит историю
+// и бан-лист в памяти. Если связь с основным потеряна и не восстановлена за
+// failoverTimeoutMs, вызывает IReplicaSink::onPromoted и больше не следует.
+class StandbyReplica final : public QObject {
+    Q_OBJECT
+
+public:
+    explicit StandbyReplica(IReplicaSink *sink, QObject *parent = nullptr);
+    ~StandbyReplica() override;
+
+    void start(QString host, quint16 port, int failoverTimeoutMs);
+    void stop();
+    [[nodiscard]] bool isActive() const;
+
+private:
+    void sendHello();
+    void handleLine(const QByteArray &line);
+    void handleDisconnected();
+    void promote();
+
+    IReplicaSink *m_sink;
+    PeerLink *m_link = nullptr;
+    QTimer m_failoverTimer;
+    quint64 m_incarnation = 0;
+    // Следующий ожидаемый номер записи по комнатам
+    QHash<QString, quint64> m_nextSeqs;
+    // Основной хотя бы раз ответил: только после этого его пропажа ведёт к повышению
+    bool m_synced = false;
+};
@@ -0,0 +1,381 @@
+#include "TextSanitizer.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define KUKARACHA_TEXT_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+bool isUnsafe(char16_t unit)
+{
+    if (unit < 0x20) {
+        return unit != u'\t' && unit != u'\n';
+    }
+    return (unit >= 0x7f && unit <= 0x9f)
+        || (unit >= 0x202a && unit <= 0x202e)
+        || (unit >= 0x2066 && unit <= 0x2069);
+}
+
+qsizetype firstUnsafeScalar(const char16_t *data, qsizetype from, qsizetype size)
+{
+    for (qsizetype i = from; i < size; ++i) {
+        if (isUnsafe(data[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool validateUtf8Scalar(const unsigned char *data, qsizetype size)
+{
+    qsizetype i = 0;
+    while (i < size) {
+        const unsigned char lead = data[i];
+        if (lead < 0x80) {
+            ++i;
+            continue;
+        }
+
+        qsizetype length = 0;
+        char32_t codePoint = 0;
+        char32_t minimum = 0;
+        if ((lead & 0xe0) == 0xc0) {
+            length = 2;
+            codePoint = lead & 0x1f;
+            minimum = 0x80;
+        } else if ((lead & 0xf0) == 0xe0) {
+            length = 3;
+            codePoint = lead & 0x0f;
+            minimum = 0x800;
+        } else if ((lead & 0xf8) == 0xf0) {
+            length = 4;
+            codePoint = lead & 0x07;
+            minimum = 0x10000;
+        } else {
+            return false;
+        }
+
+        if (size - i < length) {
+            return false;
+        }
+        for (qsizetype k = 1; k < length; ++k) {
+            const unsigned char next = data[i + k];
+            if ((next & 0xc0) != 0x80) {
+                return false;
+            }
+            codePoint = (codePoint << 6) | (next & 0x3f);
+        }
+        if (codePoint < minimum || codePoint > 0x10ffff || (codePoint >= 0xd800 && codePoint <= 0xdfff)) {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+#ifdef KUKARACHA_TEXT_SIMD
+
+// Проверка UTF-8 по таблицам (алгоритм Кайзера–Лемира из simdjson): для
+// каждого байта по старшему и младшему полубайту предыдущего байта и
+// старшему полубайту текущего берутся битовые маски возможных ошибок;
+// пересечение масок ненулевое только у некорректных последовательностей.
+constexpr uint8_t kTooShort = 1 << 0;
+constexpr uint8_t kTooLong = 1 << 1;
+constexpr uint8_t kOverlong3 = 1 << 2;
+constexpr uint8_t kTooLarge = 1 << 3;
+constexpr uint8_t kSurrogate = 1 << 4;
+constexpr uint8_t kOverlong2 = 1 << 5;
+constexpr uint8_t kTooLarge1000 = 1 << 6;
+constexpr uint8_t kOverlong4 = 1 << 6;
+constexpr uint8_t kTwoConts = 1 << 7;
+constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+alignas(16) constexpr uint8_t kByte1High[16] = {
+    kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+    kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+    kTooShort | kOverlong2,
+    kTooShort,
+    kTooShort | kOverlong3 | kSurrogate,
+    kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,
+};
+
+alignas(16) constexpr uint8_t kByte1Low[16] = {
+    kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+    kCarry | kOverlong2,
+    kCarry,
+    kCarry,
+    kCarry | kTooLarge,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+    kCarry | kTooLarge | kTooLarge1000,
+    kCarry | kTooLarge | kTooLarge1000,
+};
+
+alignas(16) constexpr uint8_t kByte2High[16] = {
+    kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+    kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4,
+    kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+    kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+    kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+    kTooShort, kTooShort, kTooShort, kTooShort,
+};
+
+__attribute__((target("ssse3"))) void checkUtf8Block(__m128i input, __m128i &previous, __m128i &error)
+{
+    // Блок только из ASCII проверяем лишь на оборванную в предыдущем блоке последовательность
+    if (_mm_movemask_epi8(input) == 0) {
+        const __m128i incompleteLimit = _mm_setr_epi8(
+            char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff),
+            char(0xff), char(0xff), char(0xff), char(0xff), char(0xff),
+            char(0xf0 - 1), char(0xe0 - 1), char(0xc0 - 1));
+        error = _mm_or_si128(error, _mm_subs_epu8(previous, incompleteLimit));
+        previous = input;
+        return;
+    }
+
+    const __m128i lowNibble = _mm_set1_epi8(0x0f);
+    const __m128i prev1 = _mm_alignr_epi8(input, previous, 15);
+    const __m128i prev1High = _mm_and_si128(_mm_srli_epi16(prev1, 4), lowNibble);
+    const __m128i prev1Low = _mm_and_si128(prev1, lowNibble);
+    const __m128i inputHigh = _mm_and_si128(_mm_srli_epi16(input, 4), lowNibble);
+    const __m128i special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(kByte1High)), prev1High),
+                      _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(kByte1Low)), prev1Low)),
+        _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(kByte2High)), inputHigh));
+
+    // Третий и четвёртый байты обязаны быть продолжениями после 111_____ и 1111____
+    const __m128i prev2 = _mm_alignr_epi8(input, previous, 14);
+    const __m128i prev3 = _mm_alignr_epi8(input, previous, 13);
+    const __m128i isThird = _mm_subs_epu8(prev2, _mm_set1_epi8(char(0xe0 - 0x80)));
+    const __m128i isFourth = _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xf0 - 0x80)));
+    const __m128i must23 = _mm_and_si128(_mm_or_si128(isThird, isFourth), _mm_set1_epi8(char(0x80)));
+
+    error = _mm_or_si128(error, _mm_xor_si128(must23, special));
+    previous = input;
+}
+
+__attribute__((target("ssse3"))) bool isValidUtf8Ssse3(const unsigned char *data, qsizetype size)
+{
+    __m128i previous = _mm_setzero_si128();
+    __m128i error = _mm_setzero_si128();
+
+    qsizetype i = 0;
+    for (; i + 16 <= size; i += 16) {
+        checkUtf8Block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), previous, error);
+    }
+
+    // Хвост дополняется нулями, а нули в конце выявляют оборванную последовательность
+    alignas(16) unsigned char tail[16] = {};
+    std::memcpy(tail, data + i, size_t(size - i));
+    checkUtf8Block(_mm_load_si128(reinterpret_cast<const __m128i *>(tail)), previous, error);
+    checkUtf8Block(_mm_setzero_si128(), previous, error);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+
+__attribute__((target("avx2"))) void checkUtf8Block(__m256i input, __m256i &previous, __m256i &error)
+{
+    if (_mm256_movemask_epi8(input) == 0) {
+        const __m256i incompleteLimit = _mm256_setr_epi8(
+            char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff),
+            char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff),
+            char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff), char(0xff),
+            char(0xff), char(0xff), char(0xff), char(0xff), char(0xff),
+            char(0xf0 - 1), char(0xe0 - 1), char(0xc0 - 1));
+        error = _mm256_or_si256(error, _mm256_subs_epu8(previous, incompleteLimit));
+        previous = input;
+        return;
+    }
+
+    // Сдвиг на N байт через границу 128-битных половин: [старшая половина previous | input]
+    const __m256i joined = _mm256_permute2x128_si256(previous, input, 0x21);
+    const __m256i prev1 = _mm256_alignr_epi8(input, joined, 15);
+    const __m256i prev2 = _mm256_alignr_epi8(input, joined, 14);
+    const __m256i prev3 = _mm256_alignr_epi8(input, joined, 13);
+
+    const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+    const __m256i byte1High = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(kByte1High)));
+    const __m256i byte1Low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(kByte1Low)));
+    const __m256i byte2High = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(kByte2High)));
+    const __m256i prev1High = _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble);
+    const __m256i prev1Low = _mm256_and_si256(prev1, lowNibble);
+    const __m256i inputHigh = _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble);
+    const __m256i special = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(byte1High, prev1High), _mm256_shuffle_epi8(byte1Low, prev1Low)),
+        _mm256_shuffle_epi8(byte2High, inputHigh));
+
+    const __m256i isThird = _mm256_subs_epu8(prev2, _mm256_set1_epi8(char(0xe0 - 0x80)));
+    const __m256i isFourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(char(0xf0 - 0x80)));
+    const __m256i must23 = _mm256_and_si256(_mm256_or_si256(isThird, isFourth), _mm256_set1_epi8(char(0x80)));
+
+    error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+    previous = input;
+}
+
+__attribute__((target("avx2"))) bool isValidUtf8Avx2(const unsigned char *data, qsizetype size)
+{
+    __m256i previous = _mm256_setzero_si256();
+    __m256i error = _mm256_setzero_si256();
+
+    qsizetype i = 0;
+    for (; i + 32 <= size; i += 32) {
+        checkUtf8Block(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)), previous, error);
+    }
+
+    alignas(32) unsigned char tail[32] = {};
+    std::memcpy(tail, data + i, size_t(size - i));
+    checkUtf8Block(_mm256_load_si256(reinterpret_cast<const __m256i *>(tail)), previous, error);
+    checkUtf8Block(_mm256_setzero_si256(), previous, error);
+
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+// Поиск опасных символов UTF-16: попадание в диапазон [first, last] проверяется
+// беззнаково как (x - first) <= (last - first) через насыщающее вычитание.
+__attribute__((target("sse2"))) __m128i inRange(__m128i units, uint16_t first, uint16_t last)
+{
+    const __m128i shifted = _mm_sub_epi16(units, _mm_set1_epi16(short(first)));
+    return _mm_cmpeq_epi16(_mm_subs_epu16(shifted, _mm_set1_epi16(short(last - first))), _mm_setzero_si128());
+}
+
+__attribute__((target("avx2"))) __m256i inRange(__m256i units, uint16_t first, uint16_t last)
+{
+    const __m256i shifted = _mm256_sub_epi16(units, _mm256_set1_epi16(short(first)));
+    return _mm256_cmpeq_epi16(_mm256_subs_epu16(shifted, _mm256_set1_epi16(short(last - first))),
+                              _mm256_setzero_si256());
+}
+
+__attribute__((target("sse2"))) qsizetype firstUnsafeSse2(const char16_t *data, qsizetype size)
+{
+    const __m128i tab = _mm_set1_epi16(short(u'\t'));
+    const __m128i newline = _mm_set1_epi16(short(u'\n'));
+
+    qsizetype i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i allowed = _mm_or_si128(_mm_cmpeq_epi16(units, tab), _mm_cmpeq_epi16(units, newline));
+        const __m128i control = _mm_andnot_si128(allowed, inRange(units, 0x00, 0x1f));
+        const __m128i unsafe = _mm_or_si128(
+            _mm_or_si128(control, inRange(units, 0x7f, 0x9f)),
+            _mm_or_si128(inRange(units, 0x202a, 0x202e), inRange(units, 0x2066, 0x2069)));
+        const int mask = _mm_movemask_epi8(unsafe);
+        if (mask != 0) {
+            return i + __builtin_ctz(unsigned(mask)) / 2;
+        }
+    }
+    return firstUnsafeScalar(data, i, size);
+}
+
+__attribute__((target("avx2"))) qsizetype firstUnsafeAvx2(const char16_t *data, qsizetype size)
+{
+    const __m256i tab = _mm256_set1_epi16(short(u'\t'));
+    const __m256i newline = _mm256_set1_epi16(short(u'\n'));
+
+    qsizetype i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const __m256i allowed = _mm256_or_si256(_mm256_cmpeq_epi16(units, tab), _mm256_cmpeq_epi16(units, newline));
+        const __m256i control = _mm256_andnot_si256(allowed, inRange(units, 0x00, 0x1f));
+        const __m256i unsafe = _mm256_or_si256(
+            _mm256_or_si256(control, inRange(units, 0x7f, 0x9f)),
+            _mm256_or_si256(inRange(units, 0x202a, 0x202e), inRange(units, 0x2066, 0x2069)));
+        const unsigned mask = unsigned(_mm256_movemask_epi8(unsafe));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask) / 2;
+        }
+    }
+    return firstUnsafeScalar(data, i, size);
+}
+
+enum class SimdLevel { Scalar, Ssse3, Avx2 };
+
+SimdLevel simdLevel()
+{
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return SimdLevel::Avx2;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+            return SimdLevel::Ssse3;
+        }
+        return SimdLevel::Scalar;
+    }();
+    return level;
+}
+
+#endif // KUKARACHA_TEXT_SIMD
+
+} // namespace
+
+namespace TextSanitizer {
+
+bool isValidUtf8(QByteArrayView data)
+{
+    const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+#ifdef KUKARACHA_TEXT_SIMD
+    switch (simdLevel()) {
+    case SimdLevel::Avx2:
+        return isValidUtf8Avx2(bytes, data.size());
+    case SimdLevel::Ssse3:
+        return isValidUtf8Ssse3(bytes, data.size());
+    case SimdLevel::Scalar:
+        break;
+    }
+#endif
+    return validateUtf8Scalar(bytes, data.size());
+}
+
+bool isValidUtf8Scalar(QByteArrayView data)
+{
+    return validateUtf8Scalar(reinterpret_cast<const unsigned char *>(data.data()), data.size());
+}
+
+qsizetype firstUnsafe(QStringView text)
+{
+    const auto *units = text.utf16();
+#ifdef KUKARACHA_TEXT_SIMD
+    switch (simdLevel()) {
+    case SimdLevel::Avx2:
+        return firstUnsafeAvx2(units, text.size());
+    case SimdLevel::Ssse3:
+        return firstUnsafeSse2(units, text.size());
+    case SimdLevel::Scalar:
+        break;
+    }
+#endif
+    return firstUnsafeScalar(units, 0, text.size());
+}
+
+QString stripUnsafe(const QString &text)
+{
+    const qsizetype first = firstUnsafe(text);
+    if (first < 0) {
+        return text;
+    }
+
+    // Редкий путь: копируем всё, кроме опасных символов
+    QString result;
+    result.reserve(text.size() - 1);
+    result.append(QStringView(text).first(first));
+    const auto *units = text.utf16();
+    for (qsizetype i = first + 1; i < text.size(); ++i) {
+        if (!isUnsafe(units[i])) {
+            result.append(QChar(units[i]));
+        }
+    }
+    return result;
+}
+
+} // namespace TextSanitizer
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QString>
+#include <QStringView>
+
+// Проверка входящего текста на стороне сервера. Основной путь векторный
+// (AVX2 или SSSE3/SSE2, выбирается по процессору при первом вызове),
+// на других платформах работает скалярная реализация.
+namespace TextSanitizer {
+
+// Корректный ли это UTF-8: без обрывов, лишних продолжений, избыточных
+// кодировок, суррогатов и значений больше U+10FFFF.
+[[nodiscard]] bool isValidUtf8(QByteArrayView data);
+// Побайтовая реализация той же проверки, без векторных инструкций. Эталон для
+// тестов векторного пути и запасной путь на процессорах без SSSE3.
+[[nodiscard]] bool isValidUtf8Scalar(QByteArrayView data);
+
+// Позиция первого опасного символа или -1. Опасные: управляющие C0 (кроме
+// табуляции и перевода строки), DEL и C1, а также символы, меняющие
+// направление текста (U+202A–U+202E, U+2066–U+2069).
+[[nodiscard]] qsizetype firstUnsafe(QStringView text);
+
+[[nodiscard]] inline bool containsUnsafe(QStringView text)
+{
+    return firstUnsafe(text) >= 0;
+}
+
+// Текст без опасных символов. Чистый текст возвращается без копирования.
+[[nodiscard]] QString stripUnsafe(const QString &text);
+
+} // namespace TextSanitizer
@@ -0,0 +1,107 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+// Пул, которому принадлежит текущий поток, и номер его очереди
+thread_local const WorkStealingPool *t_pool = nullptr;
+thread_local std::size_t t_queueIndex = 0;
+} // namespace
+
+WorkStealingPool::WorkStealingPool(int threadCount)
+{
+    const auto count = std::size_t(std::max(threadCount, 1));
+    m_queues.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    m_threads.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        m_threads.emplace_back([this, i]() { run(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wakeUp.notify_all();
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
+
+int WorkStealingPool::threadCount() const
+{
+    return int(m_threads.size());
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    const std::size_t index = t_pool == this ? t_queueIndex
+                                             : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+    // Счётчик растёт до публикации задачи: иначе поток успел бы забрать её и уменьшить
+    // счётчик раньше, size_t ушёл бы через ноль и простаивающие потоки крутились бы вхолостую
+    m_pending.fetch_add(1, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+
+    // Пустая критическая секция: поток, который как раз проверил счётчик и засыпает,
+    // либо увидит новую задачу, либо уже ждёт и получит сигнал
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_wakeUp.notify_one();
+}
+
+void WorkStealingPool::run(std::size_t index)
+{
+    t_pool = this;
+    t_queueIndex = index;
+
+    while (true) {
+        Task task;
+        if (popLocal(index, task) || steal(index, task)) {
+            m_pending.fetch_sub(1, std::memory_order_acq_rel);
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeUp.wait(lock, [this]() { return m_pending.load(std::memory_order_acquire) > 0 || m_stopping; });
+        if (m_stopping && m_pending.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
+
+bool WorkStealingPool::popLocal(std::size_t index, Task &task)
+{
+    Queue &queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(std::size_t thief, Task &task)
+{
+    const std::size_t count = m_queues.size();
+    for (std::size_t offset = 1; offset < count; ++offset) {
+        Queue &victim = *m_queues[(thief + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty()) {
+            continue;
+        }
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
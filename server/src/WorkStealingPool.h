@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с перехватом работы. У каждого потока своя очередь: задачи,
+// поставленные из рабочего потока, попадают в его очередь и берутся с конца
+// (свежие данные ещё в кэше), а простаивающий поток забирает самые старые
+// задачи из чужих очередей. Задачи извне раскладываются по очередям по кругу.
+// Блокировки — только на отдельных очередях, общей очереди нет.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(int threadCount);
+    // Дожидается выполнения всех поставленных задач.
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    [[nodiscard]] int threadCount() const;
+    // Можно вызывать из любого потока, в том числе из задачи.
+    void submit(Task task);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(std::size_t index);
+    bool popLocal(std::size_t index, Task &task);
+    bool steal(std::size_t thief, Task &task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeUp;
+    // Поставлено и ещё не взято в работу
+    std::atomic<std::size_t> m_pending{0};
+    std::atomic<std::size_t> m_nextQueue{0};
+    bool m_stopping = false;
+};
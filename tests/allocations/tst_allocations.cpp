@@ -0,0 +1,147 @@
+#include "ChatMessage.h"
+#include "ClientConnection.h"
+#include "CompactMessage.h"
+#include "JsonCodec.h"
+#include "MessageHistory.h"
+#include "SenderTable.h"
+
+#include <QtTest>
+
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace {
+// Сообщений в замере; история меньше, поэтому в замер попадает и вытеснение
+constexpr int kMessages = 1024;
+constexpr qsizetype kHistoryMessages = 256;
+// Кадр и сжатая запись истории — по одному выделению, плюс редкие блоки очереди истории
+constexpr double kAllocationsPerMessage = 3.0;
+
+std::atomic<bool> g_counting{false};
+std::atomic<qint64> g_allocations{0};
+
+void countAllocation()
+{
+    if (g_counting.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::vector<ChatMessage> sampleMessages()
+{
+    static const QString senders[] = {QStringLiteral("alice"), QStringLiteral("боб"), QStringLiteral("carol")};
+    std::vector<ChatMessage> messages;
+    messages.reserve(kMessages);
+    for (int i = 0; i < kMessages; ++i) {
+        messages.emplace_back(senders[i % 3], QStringLiteral("Обычное сообщение чата номер %1").arg(i));
+    }
+    return messages;
+}
+} // namespace
+
+#if defined(__GLIBC__)
+// Счётчик ставится на malloc, а не на operator new: QByteArray и QString выделяют память
+// через malloc напрямую. Реализация остаётся glibc, поэтому free не подменяется.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) noexcept
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_realloc(pointer, size);
+}
+}
+#endif
+
+// Выделения памяти на пути принятого сообщения: кодирование кадра и запись в историю.
+class AllocationsTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void compactTextMatchesUtf8_data();
+    void compactTextMatchesUtf8();
+    void frameRoundTrips();
+    void acceptedMessageAllocations();
+};
+
+void AllocationsTest::compactTextMatchesUtf8_data()
+{
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("пустой") << QString();
+    QTest::newRow("ascii") << QStringLiteral("hello");
+    QTest::newRow("кириллица") << QStringLiteral("Привет");
+    QTest::newRow("суррогатная пара") << QStringLiteral("smile \U0001F600");
+    QTest::newRow("одиночный суррогат") << (QStringLiteral("a") + QChar(0xd800) + QStringLiteral("b"));
+    QTest::newRow("суррогат в конце") << (QStringLiteral("a") + QChar(0xdbff));
+}
+
+void AllocationsTest::compactTextMatchesUtf8()
+{
+    QFETCH(QString, text);
+
+    SenderTable senders;
+    const CompactMessage compact(ChatMessage(QStringLiteral("alice"), text), senders);
+    QCOMPARE(compact.textUtf8(), text.toUtf8());
+}
+
+void AllocationsTest::frameRoundTrips()
+{
+    const ChatMessage message(QStringLiteral("alice"), QStringLiteral("кавычки \" и \\ и\tтаб\nстрока"),
+                              QDateTime::currentDateTimeUtc());
+    const QByteArray frame = JsonCodec<ChatMessage>::encode(message);
+    QVERIFY(frame.contains(message.timestamp().toString(Qt::ISODateWithMs).toUtf8()));
+
+    const ChatMessage decoded = JsonCodec<ChatMessage>::decode(frame);
+    QCOMPARE(decoded.sender(), message.sender());
+    QCOMPARE(decoded.text(), message.text());
+    QCOMPARE(decoded.timestamp(), message.timestamp());
+}
+
+void AllocationsTest::acceptedMessageAllocations()
+{
+#if !defined(__GLIBC__)
+    QSKIP("Подсчёт выделений реализован только для glibc");
+#endif
+    const std::vector<ChatMessage> messages = sampleMessages();
+    MessageHistory history(std::numeric_limits<qsizetype>::max(), kHistoryMessages, QString());
+
+    // Прогрев: история заполнена, имена отправителей уже в таблице
+    for (const ChatMessage &message : messages) {
+        history.append(message, ClientConnection::encodeFrame(message));
+    }
+
+    g_allocations = 0;
+    g_counting = true;
+    for (const ChatMessage &message : messages) {
+        QByteArray frame = ClientConnection::encodeFrame(message);
+        history.append(message, std::move(frame));
+    }
+    g_counting = false;
+
+    const double perMessage = double(g_allocations.load()) / kMessages;
+    qInfo() << "Выделений на сообщение:" << perMessage;
+    QCOMPARE(history.size(), kHistoryMessages);
+    QVERIFY2(perMessage <= kAllocationsPerMessage, qPrintable(QString::number(perMessage)));
+}
+
+QTEST_GUILESS_MAIN(AllocationsTest)
+
+#include "tst_allocations.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_clusterrelay
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_clusterrelay.cpp
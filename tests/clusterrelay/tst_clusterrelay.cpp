@@ -0,0 +1,246 @@
+#include "ChatMessage.h"
+#include "ChatServer.h"
+#include "JsonCodec.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr int kNodes = 3;
+constexpr int kClientsPerNode = 2;
+constexpr int kMessagesPerClient = 500;
+constexpr int kTotalMessages = kNodes * kClientsPerNode * kMessagesPerClient;
+const QString kPassword = QStringLiteral("secret");
+const QString kLoadPrefix = QStringLiteral("load:");
+const QString kProbePrefix = QStringLiteral("probe:");
+
+// Свободный порт для узла: слушатель закрывается сразу, порт займёт ChatServer
+quint16 freePort()
+{
+    QTcpServer probe;
+    if (!probe.listen(QHostAddress::LocalHost)) {
+        return 0;
+    }
+    return probe.serverPort();
+}
+
+// Клиент без рукопожатия: кадры JSON по строке, вход — первым сообщением
+class TestClient final : public QObject {
+public:
+    explicit TestClient(QString name)
+        : m_name(std::move(name))
+    {
+        connect(&m_socket, &QTcpSocket::readyRead, this, [this]() { readFrames(); });
+    }
+
+    bool login(quint16 port)
+    {
+        m_socket.connectToHost(QHostAddress::LocalHost, port);
+        if (!m_socket.waitForConnected(5000)) {
+            return false;
+        }
+        send(kPassword);
+        return true;
+    }
+
+    void send(const QString &text)
+    {
+        QByteArray frame = JsonCodec<ChatMessage>::encode(ChatMessage(m_name, text));
+        frame.append('\n');
+        m_socket.write(frame);
+    }
+
+    [[nodiscard]] const QString &name() const { return m_name; }
+    [[nodiscard]] bool isAuthenticated() const { return m_authenticated; }
+    // Сколько раз пришло каждое сообщение нагрузки
+    [[nodiscard]] const QHash<QString, int> &received() const { return m_received; }
+    [[nodiscard]] int deliveries() const { return m_deliveries; }
+    [[nodiscard]] bool sawProbeFrom(int node) const { return m_probeNodes.contains(node); }
+
+private:
+    void readFrames()
+    {
+        m_buffer.append(m_socket.readAll());
+        qsizetype start = 0;
+        qsizetype newline = -1;
+        while ((newline = m_buffer.indexOf('\n', start)) != -1) {
+            handleFrame(m_buffer.sliced(start, newline - start));
+            start = newline + 1;
+        }
+        m_buffer.remove(0, start);
+    }
+
+    void handleFrame(const QByteArray &frame)
+    {
+        // Управляющие и служебные кадры клиенту без рукопожатия не приходят, но на всякий случай пропускаем
+        if (!frame.startsWith('{')) {
+            return;
+        }
+        const ChatMessage message = JsonCodec<ChatMessage>::decode(frame);
+        if (message.sender() == QLatin1String("SERVER")) {
+            m_authenticated = m_authenticated || message.text() == QLatin1String("AUTH_OK");
+        } else if (message.text().startsWith(kLoadPrefix)) {
+            ++m_received[message.text()];
+            ++m_deliveries;
+        } else if (message.text().startsWith(kProbePrefix)) {
+            m_probeNodes.insert(QStringView(message.text()).sliced(kProbePrefix.size()).toInt());
+        }
+    }
+
+    QString m_name;
+    QTcpSocket m_socket;
+    QByteArray m_buffer;
+    bool m_authenticated = false;
+    QHash<QString, int> m_received;
+    int m_deliveries = 0;
+    QSet<int> m_probeNodes;
+};
+
+struct Node {
+    std::unique_ptr<QTemporaryDir> directory;
+    std::unique_ptr<ChatServer> server;
+    quint16 clusterPort = 0;
+};
+} // namespace
+
+// Три узла кластера в одном процессе на localhost, каждый со своими клиентами:
+// каждое сообщение доходит до каждого клиента ровно один раз, замеряется
+// суммарная пропускная способность кластера.
+class ClusterRelayTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void exactlyOnceDelivery();
+
+private:
+    std::vector<Node> m_nodes;
+    std::vector<std::unique_ptr<TestClient>> m_clients;
+};
+
+void ClusterRelayTest::initTestCase()
+{
+    qputenv("KUKARACHA_ALLOW_AUTO_REGISTER", "1");
+    qputenv("KUKARACHA_COMPRESSION_LEVEL", "0");
+    qputenv("KUKARACHA_CLUSTER_SECRET", "cluster-test");
+
+    m_nodes.resize(kNodes);
+    for (Node &node : m_nodes) {
+        node.clusterPort = freePort();
+        QVERIFY(node.clusterPort != 0);
+    }
+
+    // Полная сеть: каждый узел подключается ко всем предыдущим
+    for (int i = 0; i < kNodes; ++i) {
+        Node &node = m_nodes[std::size_t(i)];
+        node.directory = std::make_unique<QTemporaryDir>();
+        QVERIFY(node.directory->isValid());
+
+        QStringList peers;
+        for (int j = 0; j < i; ++j) {
+            peers << QStringLiteral("127.0.0.1:%1").arg(m_nodes[std::size_t(j)].clusterPort);
+        }
+        // Окружение читается в конструкторе (история) и в start (кластер)
+        qputenv("KUKARACHA_HISTORY_DIR", node.directory->path().toUtf8());
+        qputenv("KUKARACHA_NODE_ID", QByteArray("node") + QByteArray::number(i));
+        qputenv("KUKARACHA_CLUSTER_PORT", QByteArray::number(node.clusterPort));
+        qputenv("KUKARACHA_CLUSTER_PEERS", peers.join(QLatin1Char(',')).toUtf8());
+        node.server = std::make_unique<ChatServer>();
+        QVERIFY(node.server->start(0));
+    }
+
+    // Имена уникальны в пределах запуска: каталог присутствия общий на весь кластер
+    const QString run = QString::number(QDateTime::currentMSecsSinceEpoch(), 36);
+    for (int i = 0; i < kNodes; ++i) {
+        for (int c = 0; c < kClientsPerNode; ++c) {
+            auto client = std::make_unique<TestClient>(QStringLiteral("n%1c%2_%3").arg(i).arg(c).arg(run));
+            QVERIFY(client->login(m_nodes[std::size_t(i)].server->serverPort()));
+            m_clients.push_back(std::move(client));
+        }
+    }
+    for (const auto &client : m_clients) {
+        QTRY_VERIFY_WITH_TIMEOUT(client->isAuthenticated(), 10000);
+    }
+
+    // Связи между узлами поднимаются асинхронно: ждём, пока пробные сообщения
+    // с каждого узла начнут доходить до всех клиентов
+    const auto allLinked = [this]() {
+        for (const auto &client : m_clients) {
+            for (int node = 0; node < kNodes; ++node) {
+                if (!client->sawProbeFrom(node)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    QElapsedTimer waited;
+    waited.start();
+    while (!allLinked() && waited.elapsed() < 15000) {
+        for (int node = 0; node < kNodes; ++node) {
+            m_clients[std::size_t(node * kClientsPerNode)]->send(kProbePrefix + QString::number(node));
+        }
+        QTest::qWait(200);
+    }
+    QVERIFY2(allLinked(), "Узлы кластера не связались");
+}
+
+void ClusterRelayTest::cleanupTestCase()
+{
+    m_clients.clear();
+    for (Node &node : m_nodes) {
+        if (node.server) {
+            node.server->stop();
+        }
+    }
+    m_nodes.clear();
+}
+
+void ClusterRelayTest::exactlyOnceDelivery()
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int round = 0; round < kMessagesPerClient; ++round) {
+        for (const auto &client : m_clients) {
+            client->send(QStringLiteral("%1%2/%3").arg(kLoadPrefix, client->name()).arg(round));
+        }
+    }
+
+    const int expectedDeliveries = kTotalMessages * int(m_clients.size());
+    const auto delivered = [this]() {
+        int total = 0;
+        for (const auto &client : m_clients) {
+            total += client->deliveries();
+        }
+        return total;
+    };
+    QTRY_VERIFY_WITH_TIMEOUT(delivered() >= expectedDeliveries, 60000);
+    const qint64 elapsedMs = qMax<qint64>(1, timer.elapsed());
+
+    // Повторы пришли бы следом за последним сообщением — даём им время
+    QTest::qWait(500);
+    for (const auto &client : m_clients) {
+        QCOMPARE(client->received().size(), kTotalMessages);
+        for (auto it = client->received().cbegin(); it != client->received().cend(); ++it) {
+            QVERIFY2(it.value() == 1, qPrintable(QStringLiteral("%1 получил %2 %3 раз")
+                                                     .arg(client->name(), it.key()).arg(it.value())));
+        }
+    }
+
+    qInfo() << "Сообщений в секунду по кластеру:" << kTotalMessages * 1000 / elapsedMs << "доставок в секунду:"
+            << qint64(expectedDeliveries) * 1000 / elapsedMs << "за" << elapsedMs << "мс";
+}
+
+QTEST_GUILESS_MAIN(ClusterRelayTest)
+
+#include "tst_clusterrelay.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_handshake
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_handshake.cpp
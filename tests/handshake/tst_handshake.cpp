@@ -0,0 +1,64 @@
+#include "ControlMessage.h"
+#include "SessionCapabilities.h"
+
+#include <QtTest>
+
+#include <stdexcept>
+
+namespace {
+// Кадр рукопожатия с заданными полями, как его прислал бы собеседник
+QByteArray helloFrame(const QStringList &fields)
+{
+    QByteArray frame = ControlMessage::hello(fields).encodeFrame();
+    frame.chop(1);
+    return frame;
+}
+} // namespace
+
+// Совместимость рукопожатия: новые версии дописывают поля HELLO/WELCOME в конец,
+// старая сторона их пропускает, а без обязательных полей кадр отклоняется.
+class HandshakeTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void extraFieldsIgnored();
+    void missingFieldsRejected();
+};
+
+void HandshakeTest::roundTrip()
+{
+    const auto local = SessionCapabilities::local(SessionCapabilities::Compression::Deflate, 65536,
+                                                  SessionCapabilities::HistoryBatch);
+    QByteArray frame = local.toHello().encodeFrame();
+    frame.chop(1);
+    const auto parsed = SessionCapabilities::fromControl(ControlMessage::decode(frame));
+    QCOMPARE(parsed.compression(), SessionCapabilities::Compression::Deflate);
+    QCOMPARE(parsed.maxFrameSize(), 65536u);
+    QVERIFY(parsed.has(SessionCapabilities::HistoryBatch));
+}
+
+void HandshakeTest::extraFieldsIgnored()
+{
+    const auto local = SessionCapabilities::local(SessionCapabilities::Compression::None, 4096, 0);
+    QStringList fields = local.toHello().fields();
+    fields << QStringLiteral("будущее поле") << QStringLiteral("ещё одно");
+
+    const auto message = ControlMessage::decode(helloFrame(fields));
+    QCOMPARE(message.kind(), ControlKind::Hello);
+    const auto parsed = SessionCapabilities::fromControl(message);
+    QCOMPARE(parsed.maxFrameSize(), 4096u);
+    QCOMPARE(parsed.compression(), SessionCapabilities::Compression::None);
+}
+
+void HandshakeTest::missingFieldsRejected()
+{
+    const auto local = SessionCapabilities::local(SessionCapabilities::Compression::None, 4096, 0);
+    QStringList fields = local.toHello().fields();
+    fields.removeLast();
+    QVERIFY_THROWS_EXCEPTION(std::runtime_error, (void)ControlMessage::decode(helloFrame(fields)));
+}
+
+QTEST_GUILESS_MAIN(HandshakeTest)
+
+#include "tst_handshake.moc"
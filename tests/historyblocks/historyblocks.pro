@@ -0,0 +1,6 @@
+TARGET = tst_historyblocks
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_historyblocks.cpp
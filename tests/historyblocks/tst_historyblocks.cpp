@@ -0,0 +1,151 @@
+#include "ChatMessage.h"
+#include "ChatServer.h"
+#include "JsonCodec.h"
+
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+namespace {
+constexpr int kMessagesPerSender = 3;
+const QString kPassword = QStringLiteral("secret");
+const QString kHistoryEnd = QStringLiteral("--- Конец истории ---");
+
+// Клиент без рукопожатия: история приходит ему участками сегментов через sendfile
+class TestClient final : public QObject {
+public:
+    explicit TestClient(QString name)
+        : m_name(std::move(name))
+    {
+        connect(&m_socket, &QTcpSocket::readyRead, this, [this]() { readFrames(); });
+    }
+
+    bool login(quint16 port)
+    {
+        m_socket.connectToHost(QHostAddress::LocalHost, port);
+        if (!m_socket.waitForConnected(5000)) {
+            return false;
+        }
+        send(kPassword);
+        return true;
+    }
+
+    void send(const QString &text)
+    {
+        QByteArray frame = JsonCodec<ChatMessage>::encode(ChatMessage(m_name, text));
+        frame.append('\n');
+        m_socket.write(frame);
+    }
+
+    void close() { m_socket.disconnectFromHost(); }
+
+    // Тексты пользователей до конца истории; пустая история приходит без маркеров
+    [[nodiscard]] const QStringList &history() const { return m_history; }
+    [[nodiscard]] qsizetype received() const { return m_received; }
+    [[nodiscard]] bool isAuthenticated() const { return m_serverTexts.contains(QStringLiteral("AUTH_OK")); }
+    [[nodiscard]] bool historyDone() const { return m_historyDone; }
+    [[nodiscard]] bool sawServerText(const QString &part) const
+    {
+        return std::any_of(m_serverTexts.cbegin(), m_serverTexts.cend(),
+                           [&part](const QString &text) { return text.contains(part); });
+    }
+
+private:
+    void readFrames()
+    {
+        m_buffer.append(m_socket.readAll());
+        qsizetype start = 0;
+        qsizetype newline = -1;
+        while ((newline = m_buffer.indexOf('\n', start)) != -1) {
+            handleFrame(m_buffer.sliced(start, newline - start));
+            start = newline + 1;
+        }
+        m_buffer.remove(0, start);
+    }
+
+    void handleFrame(const QByteArray &frame)
+    {
+        if (!frame.startsWith('{')) {
+            return;
+        }
+        const ChatMessage message = JsonCodec<ChatMessage>::decode(frame);
+        if (message.sender() == QLatin1String("SERVER")) {
+            m_historyDone = m_historyDone || message.text() == kHistoryEnd;
+            m_serverTexts.append(message.text());
+        } else {
+            ++m_received;
+            if (!m_historyDone) {
+                m_history.append(message.text());
+            }
+        }
+    }
+
+    QString m_name;
+    QTcpSocket m_socket;
+    QByteArray m_buffer;
+    QStringList m_history;
+    QStringList m_serverTexts;
+    qsizetype m_received = 0;
+    bool m_historyDone = false;
+};
+} // namespace
+
+// Повтор истории при входе учитывает блокировки так же, как живая рассылка.
+class HistoryBlocksTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void replaySkipsBlockedSenders();
+};
+
+void HistoryBlocksTest::replaySkipsBlockedSenders()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    qputenv("KUKARACHA_ALLOW_AUTO_REGISTER", "1");
+    qputenv("KUKARACHA_COMPRESSION_LEVEL", "0");
+    qputenv("KUKARACHA_HISTORY_DIR", directory.path().toUtf8());
+    ChatServer server;
+    QVERIFY(server.start(0));
+    const quint16 port = server.serverPort();
+
+    // Списки блокировок хранятся рядом с программой: имена уникальны в пределах запуска
+    const QString run = QString::number(QDateTime::currentMSecsSinceEpoch(), 36);
+    const QString aliceName = QStringLiteral("alice_") + run;
+    const QString bobName = QStringLiteral("bob_") + run;
+    auto alice = std::make_unique<TestClient>(aliceName);
+    TestClient bob(bobName);
+    TestClient carol(QStringLiteral("carol_") + run);
+    for (TestClient *client : {alice.get(), &bob, &carol}) {
+        QVERIFY(client->login(port));
+        QTRY_VERIFY_WITH_TIMEOUT(client->isAuthenticated(), 5000);
+    }
+
+    for (int i = 0; i < kMessagesPerSender; ++i) {
+        bob.send(QStringLiteral("hidden:%1").arg(i));
+        carol.send(QStringLiteral("shown:%1").arg(i));
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(alice->received(), qsizetype(2 * kMessagesPerSender), 5000);
+
+    alice->send(QStringLiteral("/block ") + bobName);
+    QTRY_VERIFY_WITH_TIMEOUT(alice->sawServerText(bobName + QStringLiteral(" заблокирован")), 5000);
+    alice->close();
+    QTest::qWait(200);
+
+    TestClient again(aliceName);
+    QVERIFY(again.login(port));
+    QTRY_VERIFY_WITH_TIMEOUT(again.historyDone(), 5000);
+    QStringList expected;
+    for (int i = 0; i < kMessagesPerSender; ++i) {
+        expected << QStringLiteral("shown:%1").arg(i);
+    }
+    QCOMPARE(again.history(), expected);
+}
+
+QTEST_GUILESS_MAIN(HistoryBlocksTest)
+
+#include "tst_historyblocks.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_historystorage
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_historystorage.cpp
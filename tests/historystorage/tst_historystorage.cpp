@@ -0,0 +1,221 @@
+#include "ChatMessage.h"
+#include "ClientConnection.h"
+#include "JsonMessageSerializer.h"
+#include "MessageHistory.h"
+#include "SenderTable.h"
+
+#include <QDir>
+#include <QTemporaryDir>
+#include <QTimeZone>
+#include <QtTest>
+
+#include <limits>
+
+namespace {
+constexpr qsizetype kUnlimited = std::numeric_limits<qsizetype>::max();
+
+// Имена собираются во время выполнения: у литералов нет выделенной ёмкости
+QString senderName(int index)
+{
+    return QString::fromLatin1("user%1").arg(index, 4, 10, QLatin1Char('0'));
+}
+
+void append(MessageHistory &history, const QString &sender, const QString &text)
+{
+    const ChatMessage message(sender, text);
+    history.append(message, ClientConnection::encodeFrame(message));
+}
+
+void appendAt(MessageHistory &history, const QString &sender, qint64 timestampMs)
+{
+    const ChatMessage message(sender, QStringLiteral("x"), QDateTime::fromMSecsSinceEpoch(timestampMs, QTimeZone::UTC));
+    history.append(message, ClientConnection::encodeFrame(message));
+}
+} // namespace
+
+// Объём компактной истории: текст в UTF-8, имя отправителя один раз на таблицу,
+// имена учитываются в бюджете и уходят вместе с последней записью отправителя;
+// индекс по отправителю и времени следует за вытеснением.
+class HistoryStorageTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void entryIsCompact();
+    void senderNameCountedOnce();
+    void evictedSendersReleased();
+    void clearForgetsSenders();
+    void batchCacheWithinBudget();
+    void reloadEvictsAfterLoading();
+    void messageIndex();
+    void messageIndexFollowsEviction();
+};
+
+void HistoryStorageTest::entryIsCompact()
+{
+    constexpr int kMessages = 100;
+    const QString sender = senderName(1);
+    const QString text = QStringLiteral("Сообщение средней длины для замера истории");
+    const qsizetype frameCapacity = ClientConnection::encodeFrame(ChatMessage(sender, text)).capacity();
+
+    MessageHistory history(kUnlimited, kUnlimited, QString());
+    for (int i = 0; i < kMessages; ++i) {
+        append(history, sender, text);
+    }
+
+    const qsizetype perEntry = (history.bytesUsed() - SenderTable::footprint(sender)) / kMessages;
+    const qsizetype limit = qsizetype(sizeof(MessageHistory::Entry)) + frameCapacity + text.toUtf8().size()
+        + MessageHistory::kIndexEntryBytes;
+    qInfo() << "Байт на запись:" << perEntry << "из них кадр" << frameCapacity;
+    QVERIFY2(perEntry <= limit, qPrintable(QStringLiteral("%1 > %2").arg(perEntry).arg(limit)));
+    QCOMPARE(history.senders().size(), 1);
+}
+
+void HistoryStorageTest::senderNameCountedOnce()
+{
+    MessageHistory history(kUnlimited, kUnlimited, QString());
+    const QString text = QStringLiteral("x");
+    const QString first = senderName(1);
+    const QString second = senderName(2);
+
+    append(history, first, text);
+    qsizetype before = history.bytesUsed();
+    append(history, first, text);
+    const qsizetype knownSender = history.bytesUsed() - before;
+
+    before = history.bytesUsed();
+    append(history, second, text);
+    const qsizetype newSender = history.bytesUsed() - before;
+
+    QCOMPARE(newSender - knownSender, SenderTable::footprint(second));
+}
+
+void HistoryStorageTest::evictedSendersReleased()
+{
+    constexpr qsizetype kKept = 4;
+    MessageHistory history(kUnlimited, kKept, QString());
+    for (int i = 0; i < 1000; ++i) {
+        append(history, senderName(i), QStringLiteral("x"));
+    }
+
+    QCOMPARE(history.size(), kKept);
+    QVERIFY(!history.senders().contains(senderName(0)));
+    QVERIFY(history.senders().contains(senderName(999)));
+    // Освобождённые идентификаторы переиспользуются: таблица не растёт с числом отправителей
+    QVERIFY(history.senders().size() <= kKept + 1);
+}
+
+void HistoryStorageTest::clearForgetsSenders()
+{
+    MessageHistory history(kUnlimited, kUnlimited, QString());
+    append(history, senderName(1), QStringLiteral("x"));
+    append(history, senderName(2), QStringLiteral("y"));
+
+    history.clear();
+    QCOMPARE(history.bytesUsed(), 0);
+    QCOMPARE(history.senders().size(), 0);
+
+    // После очистки имена заводятся заново и снова учитываются
+    append(history, senderName(3), QStringLiteral("z"));
+    QCOMPARE(history.senders().size(), 1);
+    QVERIFY(history.bytesUsed() > SenderTable::footprint(senderName(3)));
+}
+
+void HistoryStorageTest::batchCacheWithinBudget()
+{
+    constexpr qsizetype kBudget = 64 * 1024;
+    MessageHistory history(kBudget, kUnlimited, QString());
+    for (quint64 i = 0; i < MessageHistory::kBatchSize; ++i) {
+        append(history, senderName(1), QStringLiteral("сообщение"));
+    }
+    const qsizetype size = history.size();
+    const qsizetype used = history.bytesUsed();
+
+    // Пакет больше свободного объёма не кэшируется и не вытесняет сообщения
+    QVERIFY(!history.cacheBatch(0, QByteArray(kBudget - used + 1, 'x')));
+    QCOMPARE(history.bytesUsed(), used);
+    QCOMPARE(history.size(), size);
+    QVERIFY(history.cachedBatch(0) == nullptr);
+
+    QVERIFY(history.cacheBatch(0, QByteArray(16, 'x')));
+    QVERIFY(history.cachedBatch(0) != nullptr);
+    QVERIFY(history.bytesUsed() <= kBudget);
+}
+
+void HistoryStorageTest::reloadEvictsAfterLoading()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const JsonMessageSerializer serializer;
+    const QString text(500, QLatin1Char('x'));
+
+    // Больше мегабайта кадров — на диске несколько сегментов
+    {
+        MessageHistory history(kUnlimited, kUnlimited, directory.path());
+        QVERIFY(history.openSegments(serializer));
+        for (int i = 0; i < 3000; ++i) {
+            append(history, senderName(i % 10), text);
+        }
+    }
+    const auto segmentCount = [&directory]() { return QDir(directory.path()).entryList(QDir::Files).size(); };
+    QVERIFY(segmentCount() > 1);
+
+    // Загрузка с меньшим лимитом вытесняет записи по ходу перебора сегментов;
+    // ненужные сегменты удаляются только после него
+    MessageHistory history(kUnlimited, 10, directory.path());
+    QVERIFY(history.openSegments(serializer));
+    QCOMPARE(history.size(), 10);
+    QCOMPARE(segmentCount(), 1);
+    QCOMPARE(history.entries().back().message.textUtf8(), text.toUtf8());
+}
+
+void HistoryStorageTest::messageIndex()
+{
+    MessageHistory history(kUnlimited, kUnlimited, QString());
+    appendAt(history, senderName(1), 1000);
+    appendAt(history, senderName(2), 1000);
+    appendAt(history, senderName(1), 900);
+
+    QCOMPARE(history.findMessage(senderName(1), 1000), history.firstSeq());
+    QCOMPARE(history.findMessage(senderName(2), 1000), history.firstSeq() + 1);
+    QCOMPARE(history.findMessage(senderName(1), 900), history.firstSeq() + 2);
+    QCOMPARE(history.findMessage(senderName(1), 901), quint64(0));
+    QCOMPARE(history.findMessage(senderName(3), 1000), quint64(0));
+
+    // Свободное время для нового сообщения: занятые миллисекунды пропускаются
+    QCOMPARE(history.freeTimestampMs(senderName(1), 999), qint64(999));
+    QCOMPARE(history.freeTimestampMs(senderName(1), 900), qint64(901));
+    appendAt(history, senderName(1), 901);
+    QCOMPARE(history.freeTimestampMs(senderName(1), 900), qint64(902));
+    QCOMPARE(history.freeTimestampMs(senderName(3), 900), qint64(900));
+
+    // Совпадение отправителя и времени (например, с другого узла) — находится последнее
+    appendAt(history, senderName(2), 1000);
+    QCOMPARE(history.findMessage(senderName(2), 1000), history.endSeq() - 1);
+
+    history.clear();
+    QCOMPARE(history.findMessage(senderName(1), 1000), quint64(0));
+}
+
+void HistoryStorageTest::messageIndexFollowsEviction()
+{
+    MessageHistory history(kUnlimited, 2, QString());
+    appendAt(history, senderName(1), 1000);
+    appendAt(history, senderName(1), 1000);
+    const quint64 newer = history.endSeq() - 1;
+    // Вытеснение старшей из двух записей с одним ключом не теряет младшую
+    appendAt(history, senderName(2), 2000);
+    QCOMPARE(history.findMessage(senderName(1), 1000), newer);
+
+    appendAt(history, senderName(3), 3000);
+    QVERIFY(!history.senders().contains(senderName(1)));
+    QCOMPARE(history.findMessage(senderName(1), 1000), quint64(0));
+
+    // Идентификатор ушедшего отправителя достаётся новому, старые ключи ему не видны
+    appendAt(history, senderName(4), 4000);
+    QCOMPARE(history.findMessage(senderName(4), 1000), quint64(0));
+    QCOMPARE(history.findMessage(senderName(4), 4000), history.endSeq() - 1);
+}
+
+QTEST_GUILESS_MAIN(HistoryStorageTest)
+
+#include "tst_historystorage.moc"
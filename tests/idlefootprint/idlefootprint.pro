@@ -0,0 +1,6 @@
+TARGET = tst_idlefootprint
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_idlefootprint.cpp
@@ -0,0 +1,96 @@
+#include "ClientConnection.h"
+#include "IMessageSink.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QtTest>
+
+#include <memory>
+#include <vector>
+
+namespace {
+// Столько соединений держим одновременно: среднее сглаживает выделение слэбов пула
+constexpr int kConnections = 256;
+
+class NullSink final : public IMessageSink {
+public:
+    void onMessageReceived(ChatMessage &&, ClientConnection *) override {}
+    void onControlReceived(ControlMessage &&, ClientConnection *) override {}
+    void onConnectionDrained(ClientConnection *) override {}
+};
+
+// Принятые дескрипторы не оборачиваются в QTcpSocket: их заберут ClientConnection
+class DescriptorCollector final : public QTcpServer {
+public:
+    std::vector<qintptr> descriptors;
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override
+    {
+        descriptors.push_back(socketDescriptor);
+    }
+};
+} // namespace
+
+// Бюджет памяти простаивающего соединения: объект в слоте пула и вся куча,
+// которую занимает соединение вместе с приватными данными QTcpSocket.
+class IdleFootprintTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void objectFitsSlot();
+    void idleHeapWithinBudget();
+};
+
+void IdleFootprintTest::objectFitsSlot()
+{
+    QVERIFY(sizeof(ClientConnection) <= ClientConnection::kIdleFootprintBudget);
+}
+
+void IdleFootprintTest::idleHeapWithinBudget()
+{
+    if (ClientConnection::heapBytesInUse() < 0) {
+        QSKIP("Аллокатор не сообщает занятую кучу");
+    }
+
+    DescriptorCollector listener;
+    QVERIFY(listener.listen(QHostAddress::LocalHost));
+
+    // Клиентская сторона подключается заранее, чтобы в замер попала только серверная
+    std::vector<std::unique_ptr<QTcpSocket>> peers;
+    peers.reserve(kConnections);
+    listener.descriptors.reserve(kConnections);
+    for (int i = 0; i < kConnections; ++i) {
+        auto peer = std::make_unique<QTcpSocket>();
+        peer->connectToHost(QHostAddress::LocalHost, listener.serverPort());
+        QVERIFY(listener.waitForNewConnection(5000));
+        QVERIFY(peer->waitForConnected(5000));
+        peers.push_back(std::move(peer));
+    }
+    QCOMPARE(int(listener.descriptors.size()), kConnections);
+
+    NullSink sink;
+    std::vector<ClientConnection *> connections;
+    connections.reserve(kConnections);
+
+    const qint64 before = ClientConnection::heapBytesInUse();
+    for (const qintptr descriptor : listener.descriptors) {
+        auto *connection = new ClientConnection(&sink);
+        QVERIFY(connection->setSocketDescriptor(descriptor));
+        connections.push_back(connection);
+    }
+    const qint64 after = ClientConnection::heapBytesInUse();
+
+    const qint64 perConnection = (after - before) / kConnections;
+    qInfo() << "Куча на простаивающее соединение:" << perConnection << "байт, бюджет"
+            << ClientConnection::kIdleHeapBudget;
+    for (ClientConnection *connection : connections) {
+        delete connection;
+    }
+    QVERIFY2(perConnection <= ClientConnection::kIdleHeapBudget,
+             qPrintable(QStringLiteral("%1 байт на соединение").arg(perConnection)));
+}
+
+QTEST_GUILESS_MAIN(IdleFootprintTest)
+
+#include "tst_idlefootprint.moc"
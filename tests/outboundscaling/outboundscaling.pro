@@ -0,0 +1,6 @@
+TARGET = tst_outboundscaling
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_outboundscaling.cpp
@@ -0,0 +1,148 @@
+#include "Actor.h"
+#include "ClientConnection.h"
+#include "HeaderCompression.h"
+#include "SessionEncoder.h"
+#include "WorkStealingPool.h"
+
+#include <QElapsedTimer>
+#include <QThread>
+#include <QtTest>
+
+#include <latch>
+#include <memory>
+#include <vector>
+
+namespace {
+constexpr int kRooms = 64;
+constexpr int kSessionsPerRoom = 8;
+constexpr int kMessagesPerRoom = 200;
+constexpr int kCompressionLevel = 6;
+
+// Комната со своими получателями: её состояние трогает только её актор
+struct Room {
+    explicit Room(WorkStealingPool *pool)
+        : actor(pool)
+    {
+    }
+
+    Actor actor;
+    std::vector<std::unique_ptr<SessionEncoder>> sessions;
+    // Закодированные кадры по получателям, в порядке кодирования
+    std::vector<QByteArray> output;
+};
+
+std::vector<std::unique_ptr<Room>> makeRooms(WorkStealingPool *pool, bool headerCompression)
+{
+    std::vector<std::unique_ptr<Room>> rooms;
+    for (int i = 0; i < kRooms; ++i) {
+        auto room = std::make_unique<Room>(pool);
+        for (int j = 0; j < kSessionsPerRoom; ++j) {
+            room->sessions.push_back(std::make_unique<SessionEncoder>(
+                std::make_unique<StreamCompression>(kCompressionLevel), headerCompression));
+        }
+        room->output.resize(kSessionsPerRoom);
+        rooms.push_back(std::move(room));
+    }
+    return rooms;
+}
+
+ChatMessage messageOf(int room, int index)
+{
+    return ChatMessage(QStringLiteral("user%1").arg(index % 16),
+                       QStringLiteral("Сообщение %1 в комнате %2: обычный текст чата средней длины").arg(index).arg(room));
+}
+
+// Рассылает все сообщения всем комнатам сразу и ждёт, пока акторы их закодируют
+void runRooms(std::vector<std::unique_ptr<Room>> &rooms)
+{
+    std::latch done(std::ptrdiff_t(rooms.size()) * kMessagesPerRoom);
+    for (int index = 0; index < kMessagesPerRoom; ++index) {
+        for (std::size_t r = 0; r < rooms.size(); ++r) {
+            Room *room = rooms[r].get();
+            const ChatMessage message = messageOf(int(r), index);
+            room->actor.post([room, message, frame = ClientConnection::encodeFrame(message),
+                              encodedText = HeaderEncoder::encodeText(message.text()), &done]() {
+                for (std::size_t s = 0; s < room->sessions.size(); ++s) {
+                    room->output[s].append(room->sessions[s]->encodeChatMessage(message, frame, encodedText));
+                }
+                done.count_down();
+            });
+        }
+    }
+    done.wait();
+}
+
+QList<int> threadCounts()
+{
+    QList<int> counts{1, 2, 4};
+    const int cores = QThread::idealThreadCount();
+    counts.removeIf([cores](int count) { return count > cores; });
+    if (!counts.contains(cores)) {
+        counts.append(cores);
+    }
+    return counts;
+}
+} // namespace
+
+// Комнаты-акторы на пуле с перехватом работы: кадры каждого получателя
+// кодируются по порядку, а занятые комнаты загружают все ядра.
+class OutboundScalingTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void orderPreservedPerSession();
+    void scaling();
+};
+
+void OutboundScalingTest::orderPreservedPerSession()
+{
+    // Комнаты объявлены раньше пула: пул разрушается первым и дожидается хвостов акторов
+    std::vector<std::unique_ptr<Room>> rooms;
+    WorkStealingPool pool(4);
+    rooms = makeRooms(&pool, false);
+    runRooms(rooms);
+
+    for (std::size_t r = 0; r < rooms.size(); ++r) {
+        QByteArray expected;
+        for (int index = 0; index < kMessagesPerRoom; ++index) {
+            expected.append(ClientConnection::encodeFrame(messageOf(int(r), index)));
+        }
+        for (const QByteArray &packed : rooms[r]->output) {
+            StreamCompression receiver(kCompressionLevel);
+            QByteArray restored;
+            QVERIFY(receiver.decompress(packed, restored));
+            QCOMPARE(restored, expected);
+        }
+    }
+}
+
+void OutboundScalingTest::scaling()
+{
+    const qint64 frames = qint64(kRooms) * kSessionsPerRoom * kMessagesPerRoom;
+    double baseline = 0;
+    for (const int threads : threadCounts()) {
+        std::vector<std::unique_ptr<Room>> rooms;
+        WorkStealingPool pool(threads);
+        rooms = makeRooms(&pool, true);
+
+        QElapsedTimer timer;
+        timer.start();
+        runRooms(rooms);
+        const double seconds = qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9;
+
+        const double perSecond = frames / seconds;
+        if (baseline == 0) {
+            baseline = perSecond;
+        }
+        qInfo("%d threads: %.0f frames/s, x%.2f", threads, perSecond, perSecond / baseline);
+        for (const auto &room : rooms) {
+            for (const QByteArray &packed : room->output) {
+                QVERIFY(!packed.isEmpty());
+            }
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(OutboundScalingTest)
+
+#include "tst_outboundscaling.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_presence
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_presence.cpp
@@ -0,0 +1,91 @@
+#include "PresenceDirectory.h"
+
+#include <QtTest>
+
+namespace {
+constexpr qint64 kMaxAgeMs = 15000;
+
+// Запись узла node с одним пользователем, как её присылает сосед
+QByteArray entryOf(const QString &node, const QString &user, quint64 version = 1)
+{
+    PresenceDirectory remote;
+    remote.reset(node, 7);
+    for (quint64 i = 1; i < version; ++i) {
+        remote.addLocal(QStringLiteral("tmp"), 0);
+        remote.removeLocal(QStringLiteral("tmp"));
+    }
+    remote.addLocal(user, 1000);
+    return remote.encodeLocal();
+}
+} // namespace
+
+// Сходимость каталога присутствия: после разрыва и восстановления связи и для
+// узлов, доступных только через посредника.
+class PresenceTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void healedLinkRestoresUsers();
+    void olderEntryDoesNotRestore();
+    void unrefreshedEntryExpires();
+    void refreshKeepsEntry();
+};
+
+void PresenceTest::healedLinkRestoresUsers()
+{
+    PresenceDirectory directory;
+    directory.reset(QStringLiteral("a"), 1);
+    const QByteArray entry = entryOf(QStringLiteral("b"), QStringLiteral("bob"));
+    QVERIFY(directory.merge(entry, 0).changed);
+    QVERIFY(directory.markLost(QStringLiteral("b")));
+    QVERIFY(!directory.contains(QStringLiteral("bob")));
+
+    // После восстановления сосед присылает ту же запись — её версия не выросла
+    QVERIFY(directory.merge(entry, 100).changed);
+    QVERIFY(directory.contains(QStringLiteral("bob")));
+}
+
+void PresenceTest::olderEntryDoesNotRestore()
+{
+    PresenceDirectory directory;
+    directory.reset(QStringLiteral("a"), 1);
+    QVERIFY(directory.merge(entryOf(QStringLiteral("b"), QStringLiteral("bob"), 3), 0).changed);
+    QVERIFY(directory.markLost(QStringLiteral("b")));
+
+    QVERIFY(!directory.merge(entryOf(QStringLiteral("b"), QStringLiteral("bob"), 1), 100).changed);
+    QVERIFY(!directory.contains(QStringLiteral("bob")));
+}
+
+void PresenceTest::unrefreshedEntryExpires()
+{
+    // Узел c за посредником: о разрыве с ним прямой сосед не сообщит
+    PresenceDirectory directory;
+    directory.reset(QStringLiteral("a"), 1);
+    const QByteArray entry = entryOf(QStringLiteral("c"), QStringLiteral("carol"));
+    QVERIFY(directory.merge(entry, 0).changed);
+
+    QVERIFY(directory.expire(kMaxAgeMs, kMaxAgeMs).isEmpty());
+    QCOMPARE(directory.expire(kMaxAgeMs + 1, kMaxAgeMs), QStringList{QStringLiteral("c")});
+    QVERIFY(!directory.contains(QStringLiteral("carol")));
+
+    // Узел снова доступен: его периодический повтор возвращает пользователей
+    QVERIFY(directory.merge(entry, kMaxAgeMs + 5000).changed);
+    QVERIFY(directory.contains(QStringLiteral("carol")));
+}
+
+void PresenceTest::refreshKeepsEntry()
+{
+    PresenceDirectory directory;
+    directory.reset(QStringLiteral("a"), 1);
+    const QByteArray entry = entryOf(QStringLiteral("b"), QStringLiteral("bob"));
+    QVERIFY(directory.merge(entry, 0).changed);
+
+    // Повтор той же записи ничего не меняет, но продлевает её
+    QVERIFY(!directory.merge(entry, 10000).changed);
+    QVERIFY(directory.expire(20000, kMaxAgeMs).isEmpty());
+    QVERIFY(directory.contains(QStringLiteral("bob")));
+}
+
+QTEST_GUILESS_MAIN(PresenceTest)
+
+#include "tst_presence.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_sinkdispatch
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_sinkdispatch.cpp
@@ -0,0 +1,146 @@
+#include "ChatMessage.h"
+#include "ClientConnection.h"
+#include "IMessageSink.h"
+#include "JsonCodec.h"
+
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QtTest>
+
+#include <utility>
+
+namespace {
+// Кадров в одной порции сквозного замера
+constexpr int kFramesPerRound = 1000;
+
+class CountingSink final : public IMessageSink {
+public:
+    int messages = 0;
+    qsizetype textBytes = 0;
+
+    void onMessageReceived(ChatMessage &&message, ClientConnection *) override
+    {
+        // Сообщение забирается перемещением, как это делает сервер
+        const ChatMessage taken = std::move(message);
+        textBytes += taken.text().size();
+        ++messages;
+    }
+    void onControlReceived(ControlMessage &&, ClientConnection *) override {}
+    void onConnectionDrained(ClientConnection *) override {}
+};
+
+class DescriptorCollector final : public QTcpServer {
+public:
+    qintptr descriptor = -1;
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override
+    {
+        descriptor = socketDescriptor;
+    }
+};
+
+ChatMessage sampleMessage()
+{
+    return ChatMessage(QStringLiteral("alice"), QStringLiteral("Привет, как дела? Обычное сообщение чата."));
+}
+} // namespace
+
+// Прежний путь: сигнал с копией сообщения в слот получателя
+class SignalSource final : public QObject {
+    Q_OBJECT
+
+signals:
+    void messageReceived(const ChatMessage &message);
+};
+
+class SignalReceiver final : public QObject {
+    Q_OBJECT
+
+public:
+    int messages = 0;
+    qsizetype textBytes = 0;
+
+public slots:
+    void onMessage(const ChatMessage &message)
+    {
+        const ChatMessage copy = message;
+        textBytes += copy.text().size();
+        ++messages;
+    }
+};
+
+// Стоимость доставки одного сообщения от соединения к ядру сервера.
+class SinkDispatchTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void directSink();
+    void signalSlot();
+    void socketToSink();
+};
+
+void SinkDispatchTest::directSink()
+{
+    CountingSink sink;
+    IMessageSink *target = &sink;
+    const ChatMessage prototype = sampleMessage();
+    QBENCHMARK {
+        ChatMessage message = prototype;
+        target->onMessageReceived(std::move(message), nullptr);
+    }
+    QVERIFY(sink.messages > 0);
+}
+
+void SinkDispatchTest::signalSlot()
+{
+    SignalSource source;
+    SignalReceiver receiver;
+    connect(&source, &SignalSource::messageReceived, &receiver, &SignalReceiver::onMessage);
+    const ChatMessage prototype = sampleMessage();
+    QBENCHMARK {
+        ChatMessage message = prototype;
+        emit source.messageReceived(message);
+    }
+    QVERIFY(receiver.messages > 0);
+}
+
+void SinkDispatchTest::socketToSink()
+{
+    DescriptorCollector listener;
+    QVERIFY(listener.listen(QHostAddress::LocalHost));
+    QTcpSocket peer;
+    peer.connectToHost(QHostAddress::LocalHost, listener.serverPort());
+    QVERIFY(listener.waitForNewConnection(5000));
+    QVERIFY(peer.waitForConnected(5000));
+
+    CountingSink sink;
+    auto *connection = new ClientConnection(&sink);
+    QVERIFY(connection->setSocketDescriptor(listener.descriptor));
+
+    QByteArray round;
+    const QByteArray frame = JsonCodec<ChatMessage>::encode(sampleMessage()) + '\n';
+    for (int i = 0; i < kFramesPerRound; ++i) {
+        round += frame;
+    }
+
+    // Замер сквозной: чтение сокета, разбор JSON, проверка UTF-8 и вызов получателя
+    QElapsedTimer timer;
+    timer.start();
+    int rounds = 0;
+    QBENCHMARK {
+        const int expected = sink.messages + kFramesPerRound;
+        peer.write(round);
+        peer.flush();
+        QTRY_COMPARE_WITH_TIMEOUT(sink.messages, expected, 10000);
+        ++rounds;
+    }
+    const qint64 elapsedNs = timer.nsecsElapsed();
+    qInfo() << "Сквозная доставка:" << elapsedNs / (qint64(rounds) * kFramesPerRound) << "нс на сообщение";
+    delete connection;
+}
+
+QTEST_GUILESS_MAIN(SinkDispatchTest)
+
+#include "tst_sinkdispatch.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_streamcompression
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_streamcompression.cpp
@@ -0,0 +1,79 @@
+#include "StreamCompression.h"
+
+#include <QtTest>
+
+namespace {
+constexpr qsizetype kStep = 16 * 1024;
+
+QByteArray frames(int count)
+{
+    QByteArray data;
+    for (int i = 0; i < count; ++i) {
+        data.append(R"({"sender":"alice","text":"сообщение )").append(QByteArray::number(i)).append("\"}\n");
+    }
+    return data;
+}
+} // namespace
+
+// Пошаговая распаковка входящего потока: порция сжатых байт любой длины
+// распаковывается кусками не больше шага, без потерь на границах кусков.
+class StreamCompressionTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void stepsAreBounded();
+    void oneShotMatchesSteps();
+    void corruptedStreamFails();
+};
+
+void StreamCompressionTest::stepsAreBounded()
+{
+    StreamCompression sender(6);
+    StreamCompression receiver(6);
+    QVERIFY(sender.isValid() && receiver.isValid());
+
+    // Много коротких кадров в одной сжатой порции: вместе они больше предела кадра сервера
+    const QByteArray plain = frames(20000);
+    QVERIFY(plain.size() > 256 * 1024);
+    const QByteArray packed = sender.compress(plain);
+
+    QByteArray restored;
+    qsizetype offset = 0;
+    int steps = 0;
+    StreamCompression::InflateResult result;
+    do {
+        QByteArray step;
+        result = receiver.inflateStep(packed, offset, step, kStep);
+        QVERIFY(result != StreamCompression::InflateResult::Error);
+        QVERIFY(step.size() <= kStep);
+        restored.append(step);
+        ++steps;
+    } while (result == StreamCompression::InflateResult::Progress);
+
+    QCOMPARE(offset, packed.size());
+    QCOMPARE(restored, plain);
+    QVERIFY(steps >= plain.size() / kStep);
+}
+
+void StreamCompressionTest::oneShotMatchesSteps()
+{
+    StreamCompression sender(1);
+    StreamCompression receiver(1);
+    QByteArray restored;
+    for (int round = 0; round < 3; ++round) {
+        const QByteArray plain = frames(100 * (round + 1));
+        QVERIFY(receiver.decompress(sender.compress(plain), restored));
+        QVERIFY(restored.endsWith(plain));
+    }
+}
+
+void StreamCompressionTest::corruptedStreamFails()
+{
+    StreamCompression receiver(6);
+    QByteArray output;
+    QVERIFY(!receiver.decompress(QByteArray(64, '\xff'), output));
+}
+
+QTEST_GUILESS_MAIN(StreamCompressionTest)
+
+#include "tst_streamcompression.moc"
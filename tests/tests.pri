@@ -0,0 +1,10 @@
+# Общие настройки тестов: сервер собирается из исходников, common — готовой библиотекой
+
+QT += core network testlib
+QT -= gui
+
+CONFIG += console c++20 testcase
+
+include($$PWD/../server/server.pri)
+
+LIBS += -L$$OUT_PWD/../../common -lKukarachaCommon -lz
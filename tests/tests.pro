@@ -0,0 +1,14 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    idlefootprint \
+    sinkdispatch \
+    allocations \
+    historystorage \
+    streamcompression \
+    handshake \
+    utf8validator \
+    clusterrelay \
+    presence \
+    outboundscaling \
+    historyblocks
@@ -0,0 +1,168 @@
+#include "TextSanitizer.h"
+
+#include <QRandomGenerator>
+#include <QtTest>
+
+namespace {
+// Сдвиги проверяемой последовательности: она попадает на границы 16- и 32-байтных блоков
+constexpr int kMaxOffset = 70;
+constexpr int kFuzzRounds = 200000;
+
+QByteArray bytes(std::initializer_list<unsigned char> values)
+{
+    QByteArray result;
+    for (const unsigned char value : values) {
+        result.append(char(value));
+    }
+    return result;
+}
+
+// Текст для замера: в основном кириллица с латиницей и эмодзи
+QByteArray sampleText(qsizetype size)
+{
+    const QByteArray chunk = QStringLiteral("Привет, мир! Hello, world! Обычное сообщение чата \U0001F600 ").toUtf8();
+    QByteArray text;
+    while (text.size() + chunk.size() <= size) {
+        text.append(chunk);
+    }
+    return text;
+}
+} // namespace
+
+// Векторная проверка UTF-8 против побайтовой: совпадение на граничных и
+// некорректных последовательностях и на случайных данных, плюс пропускная способность.
+class Utf8ValidatorTest final : public QObject {
+    Q_OBJECT
+
+private slots:
+    void sequences_data();
+    void sequences();
+    void truncatedAtBlockEnd();
+    void fuzzMatchesScalar();
+    void throughput_data();
+    void throughput();
+};
+
+void Utf8ValidatorTest::sequences_data()
+{
+    QTest::addColumn<QByteArray>("sequence");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("ascii") << QByteArray("a") << true;
+    QTest::newRow("U+0080") << bytes({0xc2, 0x80}) << true;
+    QTest::newRow("U+07FF") << bytes({0xdf, 0xbf}) << true;
+    QTest::newRow("U+0800") << bytes({0xe0, 0xa0, 0x80}) << true;
+    QTest::newRow("U+D7FF") << bytes({0xed, 0x9f, 0xbf}) << true;
+    QTest::newRow("U+E000") << bytes({0xee, 0x80, 0x80}) << true;
+    QTest::newRow("U+FFFF") << bytes({0xef, 0xbf, 0xbf}) << true;
+    QTest::newRow("U+10000") << bytes({0xf0, 0x90, 0x80, 0x80}) << true;
+    QTest::newRow("U+10FFFF") << bytes({0xf4, 0x8f, 0xbf, 0xbf}) << true;
+
+    QTest::newRow("избыточная 2") << bytes({0xc0, 0x80}) << false;
+    QTest::newRow("избыточная 2 (C1)") << bytes({0xc1, 0xbf}) << false;
+    QTest::newRow("избыточная 3") << bytes({0xe0, 0x80, 0x80}) << false;
+    QTest::newRow("избыточная 3 (U+07FF)") << bytes({0xe0, 0x9f, 0xbf}) << false;
+    QTest::newRow("избыточная 4") << bytes({0xf0, 0x80, 0x80, 0x80}) << false;
+    QTest::newRow("избыточная 4 (U+FFFF)") << bytes({0xf0, 0x8f, 0xbf, 0xbf}) << false;
+    QTest::newRow("суррогат D800") << bytes({0xed, 0xa0, 0x80}) << false;
+    QTest::newRow("суррогат DFFF") << bytes({0xed, 0xbf, 0xbf}) << false;
+    QTest::newRow("U+110000") << bytes({0xf4, 0x90, 0x80, 0x80}) << false;
+    QTest::newRow("ведущий F5") << bytes({0xf5, 0x80, 0x80, 0x80}) << false;
+    QTest::newRow("байт FF") << bytes({0xff}) << false;
+    QTest::newRow("лишнее продолжение") << bytes({0x80}) << false;
+    QTest::newRow("продолжение после пары") << bytes({0xc2, 0x80, 0x80}) << false;
+    QTest::newRow("обрыв 2") << bytes({0xc2}) << false;
+    QTest::newRow("обрыв 3") << bytes({0xe0, 0xa0}) << false;
+    QTest::newRow("обрыв 4") << bytes({0xf0, 0x90, 0x80}) << false;
+    QTest::newRow("обрыв перед ascii") << bytes({0xe0, 0xa0, 'a'}) << false;
+}
+
+void Utf8ValidatorTest::sequences()
+{
+    QFETCH(QByteArray, sequence);
+    QFETCH(bool, valid);
+
+    for (int offset = 0; offset <= kMaxOffset; ++offset) {
+        // ASCII до и после: последовательность оказывается в любом месте блока и на стыке блоков
+        QByteArray data(offset, 'x');
+        data.append(sequence);
+        data.append(QByteArray(kMaxOffset - offset, 'y'));
+        QCOMPARE(TextSanitizer::isValidUtf8Scalar(data), valid);
+        QCOMPARE(TextSanitizer::isValidUtf8(data), valid);
+    }
+}
+
+void Utf8ValidatorTest::truncatedAtBlockEnd()
+{
+    // Оборванная последовательность в самом конце входа любой длины вокруг границ блоков
+    const QByteArray lead4 = bytes({0xf0, 0x90, 0x80});
+    for (int size = lead4.size(); size <= 66; ++size) {
+        for (int cut = 1; cut <= lead4.size(); ++cut) {
+            QByteArray data(size - cut, 'x');
+            data.append(lead4.first(cut));
+            QCOMPARE(TextSanitizer::isValidUtf8Scalar(data), false);
+            QCOMPARE(TextSanitizer::isValidUtf8(data), false);
+        }
+        QByteArray complete(size, 'x');
+        complete.append(char(0x80));
+        complete[size - 1] = char(0xc2);
+        QCOMPARE(TextSanitizer::isValidUtf8(complete), true);
+    }
+}
+
+void Utf8ValidatorTest::fuzzMatchesScalar()
+{
+    // Смесь корректных кусков, их обрывков и случайных байт; генератор с фиксированным зерном
+    static const QByteArray pieces[] = {
+        bytes({'a'}), bytes({0xd0, 0x9f}), bytes({0xe2, 0x82, 0xac}), bytes({0xf0, 0x9f, 0x98, 0x80}),
+        bytes({0xed, 0xa0, 0x80}), bytes({0xc0, 0xaf}), bytes({0xf4, 0x90, 0x80, 0x80}), bytes({0x80}),
+    };
+    QRandomGenerator random(20261018);
+    for (int round = 0; round < kFuzzRounds; ++round) {
+        QByteArray data;
+        const int length = int(random.bounded(96));
+        if (random.bounded(2) == 0) {
+            for (int i = 0; i < length; ++i) {
+                data.append(char(random.bounded(256)));
+            }
+        } else {
+            while (data.size() < length) {
+                // Некорректные куски реже, чтобы заметная доля входов оставалась корректной
+                const int index = random.bounded(20) == 0 ? int(random.bounded(8)) : int(random.bounded(4));
+                data.append(pieces[index]);
+                if (random.bounded(40) == 0) {
+                    data.chop(1);
+                }
+            }
+        }
+        const bool expected = TextSanitizer::isValidUtf8Scalar(data);
+        if (TextSanitizer::isValidUtf8(data) != expected) {
+            QFAIL(qPrintable(QStringLiteral("Расхождение на %1").arg(QString::fromLatin1(data.toHex(' ')))));
+        }
+    }
+}
+
+void Utf8ValidatorTest::throughput_data()
+{
+    QTest::addColumn<bool>("scalar");
+
+    QTest::newRow("векторная") << false;
+    QTest::newRow("побайтовая") << true;
+}
+
+void Utf8ValidatorTest::throughput()
+{
+    QFETCH(bool, scalar);
+
+    const QByteArray text = sampleText(64 * 1024);
+    QVERIFY(TextSanitizer::isValidUtf8Scalar(text));
+    bool valid = false;
+    QBENCHMARK {
+        valid = scalar ? TextSanitizer::isValidUtf8Scalar(text) : TextSanitizer::isValidUtf8(text);
+    }
+    QVERIFY(valid);
+}
+
+QTEST_GUILESS_MAIN(Utf8ValidatorTest)
+
+#include "tst_utf8validator.moc"
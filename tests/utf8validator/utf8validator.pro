@@ -0,0 +1,6 @@
+TARGET = tst_utf8validator
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_utf8validator.cpp